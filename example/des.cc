@@ -263,8 +263,8 @@ bits DES(const bits &data, const bits &key)
 
         // Right rotate
         uint32_t shift = Shift[rnd];
-        c = cat(c(shift - 1, 0), c(28 - 1, shift));
-        d = cat(d(shift - 1, 0), d(28 - 1, shift));
+        c.rotr(shift);
+        d.rotr(shift);
 
         // cd means c is in the lower bit position
         bits cd = cat(d, c);
@@ -5,6 +5,8 @@
 #include <cctype>
 #include <cmath>    // for log2()
 #include <cstddef>  // for size_t
+#include <cstdint>
+#include <cstring>  // for memcpy
 #include <exception>
 #include <functional>
 #include <initializer_list>
@@ -13,6 +15,7 @@
 #include <memory>
 #include <stdexcept>
 #include <string>  // for string
+#include <type_traits>
 #include <vector>
 
 
@@ -20,12 +23,14 @@ namespace bitsel
 {
 
 /*
- * Value: bits per digit
+ * Value: bits per digit. Decimal digits do not map to whole bits, so dec
+ * is converted through multi-precision arithmetic instead.
  */
 enum class num_base : std::size_t {
     bin = 1,
     oct = 3,
     hex = 4,
+    dec = 10,
     unknown = 0,
 };
 
@@ -42,6 +47,15 @@ struct blkpos {
     }
 };
 
+/* The 64 bits of x in reverse order */
+uint64_t reverse_bits(uint64_t x)
+{
+    x = (x >> 1 & 0x5555555555555555ULL) | (x & 0x5555555555555555ULL) << 1;
+    x = (x >> 2 & 0x3333333333333333ULL) | (x & 0x3333333333333333ULL) << 2;
+    x = (x >> 4 & 0x0F0F0F0F0F0F0F0FULL) | (x & 0x0F0F0F0F0F0F0F0FULL) << 4;
+    return __builtin_bswap64(x);
+}
+
 template <typename T>
 uint64_t get_nbits(const T *arr,
                    std::size_t blkdg,
@@ -100,6 +114,612 @@ std::size_t guess_width(uint64_t val)
     return val ? static_cast<std::size_t>(ceil(log2(val + 1))) : 1;
 }
 
+/* Fold the 128-bit product of two words, as in wyhash */
+uint64_t mum(uint64_t a, uint64_t b)
+{
+    __uint128_t r = static_cast<__uint128_t>(a) * b;
+    return static_cast<uint64_t>(r) ^ static_cast<uint64_t>(r >> 64);
+}
+
+constexpr bool is_little_endian = __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__;
+
+void store_le64(uint8_t *buf, uint64_t val)
+{
+    for (std::size_t i = 0; i < sizeof(uint64_t); i++) {
+        buf[i] = static_cast<uint8_t>(val >> (8 * i));
+    }
+}
+
+uint64_t load_le64(const uint8_t *buf)
+{
+    uint64_t val = 0;
+    for (std::size_t i = sizeof(uint64_t); i-- > 0;) {
+        val = (val << 8) | buf[i];
+    }
+    return val;
+}
+
+/* Transpose a 64x64 bit matrix: bit j of a[i] swaps with bit i of a[j] */
+void transpose64(uint64_t *a)
+{
+    uint64_t m = 0x00000000FFFFFFFFULL;
+    for (std::size_t j = 32; j != 0; j >>= 1, m ^= m << j) {
+        for (std::size_t k = 0; k < 64; k = ((k | j) + 1) & ~j) {
+            uint64_t t = ((a[k] >> j) ^ a[k | j]) & m;
+            a[k] ^= t << j;
+            a[k | j] ^= t;
+        }
+    }
+}
+
+
+/*
+ * Multi-precision kernels on little-endian arrays of 64-bit limbs
+ */
+using limb = uint64_t;
+
+/* Operand size in limbs from which Karatsuba beats schoolbook */
+constexpr std::size_t karatsuba_threshold = 32;
+
+/* dst[0, n) += src[0, len), return the carry out of dst[n - 1] */
+limb add_limbs(limb *dst, std::size_t n, const limb *src, std::size_t len)
+{
+    limb carry = 0;
+    for (std::size_t i = 0; i < n && (i < len || carry); i++) {
+        __uint128_t s = static_cast<__uint128_t>(dst[i]) + carry +
+                        (i < len ? src[i] : 0);
+        dst[i] = static_cast<limb>(s);
+        carry = static_cast<limb>(s >> 64);
+    }
+    return carry;
+}
+
+/* dst[0, n) -= src[0, len), return the borrow out of dst[n - 1] */
+limb sub_limbs(limb *dst, std::size_t n, const limb *src, std::size_t len)
+{
+    limb borrow = 0;
+    for (std::size_t i = 0; i < n && (i < len || borrow); i++) {
+        limb y = i < len ? src[i] : 0;
+        limb d = dst[i] - y - borrow;
+        borrow = static_cast<limb>(dst[i] < y || (dst[i] == y && borrow));
+        dst[i] = d;
+    }
+    return borrow;
+}
+
+/*
+ * out[0, outn) += low outn limbs of a * b. Partial products that land at
+ * or above outn are never computed.
+ */
+void mul_schoolbook(const limb *a,
+                    std::size_t an,
+                    const limb *b,
+                    std::size_t bn,
+                    limb *out,
+                    std::size_t outn)
+{
+    for (std::size_t i = 0; i < an && i < outn; i++) {
+        limb carry = 0;
+        std::size_t j = 0;
+        for (; j < bn && i + j < outn; j++) {
+            __uint128_t p = static_cast<__uint128_t>(a[i]) * b[j] +
+                            out[i + j] + carry;
+            out[i + j] = static_cast<limb>(p);
+            carry = static_cast<limb>(p >> 64);
+        }
+        if (i + j < outn) {
+            add_limbs(out + i + j, outn - i - j, &carry, 1);
+        }
+    }
+}
+
+/* out[0, 2n) = a * b for operands of n limbs each */
+void mul_karatsuba(const limb *a, const limb *b, std::size_t n, limb *out)
+{
+    std::fill(out, out + 2 * n, 0);
+    if (n < karatsuba_threshold) {
+        mul_schoolbook(a, n, b, n, out, 2 * n);
+        return;
+    }
+
+    /* a = a1 * B^m + a0, b = b1 * B^m + b0 */
+    std::size_t m = n / 2, h = n - m;
+    const limb *a0 = a, *a1 = a + m, *b0 = b, *b1 = b + m;
+
+    /* z0 = a0 * b0 and z2 = a1 * b1 go straight into place */
+    std::vector<limb> z0(2 * h, 0);
+    mul_karatsuba(a0, b0, m, z0.data());
+    mul_karatsuba(a1, b1, h, out + 2 * m);
+    std::copy_n(z0.data(), 2 * m, out);
+
+    /* z1 = (a0 + a1)(b0 + b1) - z0 - z2 */
+    std::vector<limb> sa(a1, a1 + h), sb(b1, b1 + h);
+    sa.push_back(add_limbs(sa.data(), h, a0, m));
+    sb.push_back(add_limbs(sb.data(), h, b0, m));
+
+    std::vector<limb> z1(2 * (h + 1), 0);
+    mul_karatsuba(sa.data(), sb.data(), h + 1, z1.data());
+    sub_limbs(z1.data(), z1.size(), z0.data(), 2 * m);
+    sub_limbs(z1.data(), z1.size(), out + 2 * m, 2 * h);
+
+    add_limbs(out + m, 2 * n - m, z1.data(), z1.size());
+}
+
+/*
+ * out[0, n) = low n limbs of a * b for operands of n limbs each. The low
+ * halves multiply in full, the cross products recurse on their low halves
+ * and the product of the high halves is skipped but for its lowest limb.
+ */
+void mul_low(const limb *a, const limb *b, std::size_t n, limb *out)
+{
+    std::fill(out, out + n, 0);
+    if (n < karatsuba_threshold) {
+        mul_schoolbook(a, n, b, n, out, n);
+        return;
+    }
+
+    std::size_t m = n / 2, h = n - m;
+    std::vector<limb> z0(2 * m);
+    mul_karatsuba(a, b, m, z0.data());
+    std::copy(z0.begin(), z0.end(), out);
+
+    /* a0 * b1 + a1 * b0 below B^h, with a0 and b0 padded to h limbs */
+    std::vector<limb> lo(h, 0), cross(h);
+    std::copy_n(a, m, lo.data());
+    mul_low(lo.data(), b + m, h, cross.data());
+    add_limbs(out + m, h, cross.data(), h);
+    std::copy_n(b, m, lo.data());
+    mul_low(a + m, lo.data(), h, cross.data());
+    add_limbs(out + m, h, cross.data(), h);
+
+    /* For odd n the high halves still reach the top limb */
+    if (2 * m < n) {
+        out[n - 1] += a[m] * b[m];
+    }
+}
+
+/*
+ * out[0, outn) = low outn limbs of a * b, picking schoolbook or
+ * Karatsuba by operand size. Karatsuba runs on slices of the longer
+ * operand that match the shorter one, and a slice that reaches outn within
+ * the width of the shorter operand takes the truncated product.
+ */
+void mul_limbs(const limb *a,
+               std::size_t an,
+               const limb *b,
+               std::size_t bn,
+               limb *out,
+               std::size_t outn)
+{
+    std::fill(out, out + outn, 0);
+    if (an < bn) {
+        std::swap(a, b);
+        std::swap(an, bn);
+    }
+
+    if (bn < karatsuba_threshold) {
+        mul_schoolbook(a, an, b, bn, out, outn);
+        return;
+    }
+
+    std::vector<limb> prod(2 * bn);
+    for (std::size_t off = 0; off < an && off < outn; off += bn) {
+        std::size_t len = std::min(bn, an - off);
+        std::size_t need = std::min(len + bn, outn - off);
+
+        /* A short last slice is the longer operand of its own product */
+        if (len < bn) {
+            mul_limbs(a + off, len, b, bn, prod.data(), need);
+            add_limbs(out + off, outn - off, prod.data(), need);
+            break;
+        }
+
+        /* Below B^need only the low need limbs of each operand matter */
+        if (need <= bn) {
+            mul_low(a + off, b, need, prod.data());
+        } else {
+            mul_karatsuba(a + off, b, bn, prod.data());
+        }
+        add_limbs(out + off, outn - off, prod.data(), need);
+    }
+}
+
+/*
+ * q[0, m - n + 1) = u / v and r[0, n) = u % v by Knuth's algorithm D, for
+ * u of m limbs and v of n limbs with v[n - 1] != 0 and m >= n.
+ */
+void divmod_limbs(const limb *u,
+                  std::size_t m,
+                  const limb *v,
+                  std::size_t n,
+                  limb *q,
+                  limb *r)
+{
+    constexpr __uint128_t base = static_cast<__uint128_t>(1) << 64;
+
+    /* Single-limb divisor: one hardware division per limb */
+    if (n == 1) {
+        __uint128_t rem = 0;
+        for (std::size_t i = m; i-- > 0;) {
+            __uint128_t cur = rem << 64 | u[i];
+            q[i] = static_cast<limb>(cur / v[0]);
+            rem = cur % v[0];
+        }
+        r[0] = static_cast<limb>(rem);
+        return;
+    }
+
+    /* Normalize so that the top limb of v has its top bit set */
+    int sh = __builtin_clzll(v[n - 1]);
+    std::vector<limb> vn(n), un(m + 1);
+    for (std::size_t i = n; i-- > 0;) {
+        vn[i] = v[i] << sh | (sh && i > 0 ? v[i - 1] >> (64 - sh) : 0);
+    }
+    un[m] = sh ? u[m - 1] >> (64 - sh) : 0;
+    for (std::size_t i = m; i-- > 0;) {
+        un[i] = u[i] << sh | (sh && i > 0 ? u[i - 1] >> (64 - sh) : 0);
+    }
+
+    for (std::size_t j = m - n + 1; j-- > 0;) {
+        /* Estimate the quotient limb from the top two limbs */
+        __uint128_t num = static_cast<__uint128_t>(un[j + n]) << 64 |
+                          un[j + n - 1];
+        __uint128_t qhat = num / vn[n - 1];
+        __uint128_t rhat = num % vn[n - 1];
+        while (qhat >= base ||
+               qhat * vn[n - 2] > (rhat << 64 | un[j + n - 2])) {
+            qhat--;
+            rhat += vn[n - 1];
+            if (rhat >= base) {
+                break;
+            }
+        }
+
+        /* Multiply and subtract */
+        limb carry = 0, borrow = 0;
+        for (std::size_t i = 0; i < n; i++) {
+            __uint128_t p = qhat * vn[i] + carry;
+            carry = static_cast<limb>(p >> 64);
+            limb lo = static_cast<limb>(p);
+            limb d = un[i + j] - lo;
+            limb b = static_cast<limb>(un[i + j] < lo);
+            un[i + j] = d - borrow;
+            borrow = b | static_cast<limb>(d < borrow);
+        }
+        limb top = un[j + n];
+        un[j + n] = top - carry - borrow;
+        bool negative = top < carry || top - carry < borrow;
+
+        q[j] = static_cast<limb>(qhat);
+
+        /* The estimate was one too large: add back */
+        if (negative) {
+            q[j]--;
+            limb c = add_limbs(un.data() + j, n, vn.data(), n);
+            un[j + n] += c;
+        }
+    }
+
+    for (std::size_t i = 0; i < n; i++) {
+        r[i] = un[i] >> sh | (sh ? un[i + 1] << (64 - sh) : 0);
+    }
+}
+
+/* Limbs without the leading zero limbs */
+std::size_t num_limbs(const std::vector<limb> &v)
+{
+    std::size_t n = v.size();
+    while (n > 0 && v[n - 1] == 0) {
+        n--;
+    }
+    return n;
+}
+
+/* Compare a[0, an) with b[0, bn) as values */
+int cmp_limbs(const limb *a, std::size_t an, const limb *b, std::size_t bn)
+{
+    for (std::size_t i = std::max(an, bn); i-- > 0;) {
+        limb x = i < an ? a[i] : 0, y = i < bn ? b[i] : 0;
+        if (x != y) {
+            return x < y ? -1 : 1;
+        }
+    }
+    return 0;
+}
+
+/*
+ * floor(B^(2n) / d) in n + 2 limbs, for d of n limbs with d[n - 1] != 0,
+ * possibly a unit or two below. Newton's iteration from the reciprocal of
+ * the top half: the start is an underestimate and one step squares its
+ * error, so the cost is a constant number of n-limb products.
+ */
+std::vector<limb> recip_limbs(const limb *d, std::size_t n)
+{
+    std::vector<limb> x(n + 2, 0);
+    if (n < karatsuba_threshold) {
+        std::vector<limb> u(2 * n + 1, 0), r(n);
+        u[2 * n] = 1;
+        divmod_limbs(u.data(), u.size(), d, n, x.data(), r.data());
+        return x;
+    }
+
+    /* x = floor(B^(2h) / (dh + 1)) * B^(n - h) is below B^(2n) / d */
+    std::size_t h = (n + 5) / 2;
+    std::vector<limb> dh(d + n - h, d + n);
+    limb one = 1;
+    if (add_limbs(dh.data(), h, &one, 1)) {
+        x[n] = 1;
+    } else {
+        auto y = recip_limbs(dh.data(), h);
+        std::copy_n(y.begin(), h + 1, x.begin() + (n - h));
+    }
+
+    /* e = B^(2n) - d * x, which stays non-negative */
+    std::vector<limb> dx(2 * n + 2), e(2 * n + 1);
+    auto residual = [&]() {
+        mul_limbs(d, n, x.data(), x.size(), dx.data(), dx.size());
+        std::fill(e.begin(), e.end(), 0);
+        e[2 * n] = 1;
+        sub_limbs(e.data(), e.size(), dx.data(), e.size());
+    };
+
+    /* x += x * e / B^(2n) */
+    residual();
+    std::size_t en = num_limbs(e);
+    std::vector<limb> t(x.size() + en);
+    mul_limbs(x.data(), x.size(), e.data(), en, t.data(), t.size());
+    if (t.size() > 2 * n) {
+        add_limbs(x.data(), x.size(), t.data() + 2 * n, t.size() - 2 * n);
+    }
+    return x;
+}
+
+/*
+ * q[0, m - n + 1) = u / d and r[0, n) = u % d by Barrett reduction, for u
+ * of n <= m <= 2n limbs and d of n limbs with mu from recip_limbs(d, n).
+ * The quotient estimated from the top limbs of u is a few units too small
+ * at most, and the remainder below B^(n + 1).
+ */
+void barrett_step(const limb *u,
+                  std::size_t m,
+                  const limb *d,
+                  std::size_t n,
+                  const std::vector<limb> &mu,
+                  limb *q,
+                  limb *r)
+{
+    std::size_t qn = m - n + 1;
+    std::vector<limb> q2(qn + mu.size());
+    mul_limbs(u + n - 1, qn, mu.data(), mu.size(), q2.data(), q2.size());
+    std::fill(q, q + qn, 0);
+    std::copy_n(q2.begin() + (n + 1), std::min(qn, q2.size() - (n + 1)), q);
+
+    /* Only the low n + 1 limbs of u - q * d are needed */
+    std::vector<limb> rr(n + 1, 0), prod(n + 1), dn(d, d + n);
+    dn.push_back(0);
+    std::copy_n(u, std::min(m, n + 1), rr.data());
+    mul_limbs(q, qn, dn.data(), n + 1, prod.data(), n + 1);
+    sub_limbs(rr.data(), n + 1, prod.data(), n + 1);
+
+    limb one = 1;
+    while (cmp_limbs(rr.data(), n + 1, d, n) >= 0) {
+        sub_limbs(rr.data(), n + 1, d, n);
+        add_limbs(q, qn, &one, 1);
+    }
+    std::copy_n(rr.begin(), n, r);
+}
+
+/*
+ * Like divmod_limbs for m >= n, given mu from recip_limbs(d, n): a long
+ * division whose digits are n limbs, each step one barrett_step.
+ */
+void divmod_barrett(const limb *u,
+                    std::size_t m,
+                    const limb *d,
+                    std::size_t n,
+                    const std::vector<limb> &mu,
+                    limb *q,
+                    limb *r)
+{
+    /* The top n limbs first, then the remainder with the next digit */
+    std::size_t pos = m - n;
+    std::vector<limb> cur(u + pos, u + m), qd(n + 1), rem(n);
+    barrett_step(cur.data(), n, d, n, mu, qd.data(), rem.data());
+    q[pos] = qd[0];
+
+    while (pos > 0) {
+        std::size_t len = std::min(n, pos);
+        pos -= len;
+        cur.assign(u + pos, u + pos + len);
+        cur.insert(cur.end(), rem.begin(), rem.end());
+        barrett_step(cur.data(), len + n, d, n, mu, qd.data(), rem.data());
+        std::copy_n(qd.begin(), len, q + pos);
+    }
+    std::copy(rem.begin(), rem.end(), r);
+}
+
+/* 10^19 is the largest power of ten in a limb */
+constexpr std::size_t limb_dec_digits = 19;
+constexpr limb limb_dec_base = 10000000000000000000ULL;
+
+/* Decimal conversion splits at 10^(19 * 2^i) once values reach this size */
+constexpr std::size_t dec_split_threshold = 16;
+/* Divisor size from which the splits use Barrett rather than Knuth */
+constexpr std::size_t barrett_threshold = 2 * karatsuba_threshold;
+
+/* pow[i] = 10^(19 * 2^i) for as long as it fits in n limbs */
+std::vector<std::vector<limb>> dec_powers(std::size_t n)
+{
+    std::vector<std::vector<limb>> pow{{limb_dec_base}};
+    while (2 * pow.back().size() <= n) {
+        const auto &p = pow.back();
+        std::vector<limb> sq(2 * p.size());
+        mul_limbs(p.data(), p.size(), p.data(), p.size(), sq.data(),
+                  sq.size());
+        sq.resize(num_limbs(sq));
+        pow.push_back(std::move(sq));
+    }
+    return pow;
+}
+
+/*
+ * inv[i] = recip_limbs(pow[i]) for the powers that split values of up to
+ * n limbs by Barrett division, empty for the others
+ */
+std::vector<std::vector<limb>> dec_reciprocals(
+    const std::vector<std::vector<limb>> &pow,
+    std::size_t n)
+{
+    std::vector<std::vector<limb>> inv(pow.size());
+    for (std::size_t i = 0; i < pow.size(); i++) {
+        const auto &p = pow[i];
+        if (2 * p.size() > n + 1) {
+            break;
+        }
+        if (p.size() >= barrett_threshold) {
+            inv[i] = recip_limbs(p.data(), p.size());
+        }
+    }
+    return inv;
+}
+
+void limbs_to_dec(std::vector<limb> v,
+                  const std::vector<std::vector<limb>> &pow,
+                  const std::vector<std::vector<limb>> &inv,
+                  std::size_t width,
+                  std::string &out)
+{
+    v.resize(num_limbs(v));
+
+    /*
+     * Divide and conquer on a power of ten about half the size. Large
+     * powers divide by Barrett reduction, so a split costs a few products.
+     */
+    std::size_t k = pow.size();
+    while (k > 0 && 2 * pow[k - 1].size() > v.size() + 1) {
+        k--;
+    }
+    if (v.size() >= dec_split_threshold && k > 0) {
+        const auto &d = pow[--k];
+        std::vector<limb> q(v.size() - d.size() + 1), r(d.size());
+        if (d.size() < barrett_threshold) {
+            divmod_limbs(v.data(), v.size(), d.data(), d.size(), q.data(),
+                         r.data());
+        } else {
+            divmod_barrett(v.data(), v.size(), d.data(), d.size(), inv[k],
+                           q.data(), r.data());
+        }
+
+        std::size_t lo_width = limb_dec_digits << k;
+        limbs_to_dec(q, pow, inv, width > lo_width ? width - lo_width : 0,
+                     out);
+        limbs_to_dec(r, pow, inv, lo_width, out);
+        return;
+    }
+
+    /* Peel off 19 digits at a time */
+    std::string digits;
+    while (!v.empty()) {
+        limb rem;
+        divmod_limbs(v.data(), v.size(), &limb_dec_base, 1, v.data(), &rem);
+        v.resize(num_limbs(v));
+        for (std::size_t i = 0; i < limb_dec_digits && (rem || !v.empty());
+             i++) {
+            digits.push_back(static_cast<char>('0' + rem % 10));
+            rem /= 10;
+        }
+    }
+    if (digits.size() < width) {
+        digits.append(width - digits.size(), '0');
+    }
+    out.append(digits.rbegin(), digits.rend());
+}
+
+/* Value of a string of decimal digits */
+std::vector<limb> dec_to_limbs(const char *str,
+                               std::size_t len,
+                               const std::vector<std::vector<limb>> &pow)
+{
+    if (len <= limb_dec_digits) {
+        limb val = 0;
+        for (std::size_t i = 0; i < len; i++) {
+            val = val * 10 + static_cast<limb>(str[i] - '0');
+        }
+        return {val};
+    }
+
+    /* value = hi * 10^(19 * 2^k) + lo, with lo as long as possible */
+    std::size_t k = 0;
+    while (k + 1 < pow.size() && (limb_dec_digits << (k + 1)) < len) {
+        k++;
+    }
+    std::size_t lo_len = limb_dec_digits << k;
+
+    auto hi = dec_to_limbs(str, len - lo_len, pow);
+    auto lo = dec_to_limbs(str + len - lo_len, lo_len, pow);
+
+    std::vector<limb> res(hi.size() + pow[k].size() + 1);
+    mul_limbs(hi.data(), hi.size(), pow[k].data(), pow[k].size(), res.data(),
+              res.size());
+    add_limbs(res.data(), res.size(), lo.data(), lo.size());
+    res.resize(std::max<std::size_t>(num_limbs(res), 1));
+    return res;
+}
+
+std::vector<limb> dec_to_limbs(const std::string &str)
+{
+    /* 10^19 < 2^64, so a limb per 19 digits is enough */
+    auto pow = dec_powers(str.length() / limb_dec_digits + 1);
+    return dec_to_limbs(str.data(), str.length(), pow);
+}
+
+/* Native integers usable as operands of bits, the 128-bit ones included */
+template <class T>
+struct is_native_int
+    : std::integral_constant<bool,
+                             (std::is_integral<T>::value &&
+                              !std::is_same<T, bool>::value) ||
+                                 std::is_same<T, __int128>::value ||
+                                 std::is_same<T, unsigned __int128>::value> {
+};
+
+/*
+ * A native integer operand of bits: its two's complement value and whether
+ * it extends with ones. Operations read it block by block, so no bits is
+ * created for it.
+ */
+class int_operand
+{
+private:
+    __uint128_t m_val;
+    bool m_neg;
+
+public:
+    template <class T, class = std::enable_if_t<is_native_int<T>::value>>
+    int_operand(T val)
+    {
+        if (std::is_same<T, unsigned __int128>::value) {
+            m_val = static_cast<__uint128_t>(val);
+            m_neg = false;
+        } else {
+            /* Every other type fits in __int128 */
+            __int128 v = static_cast<__int128>(val);
+            m_val = static_cast<__uint128_t>(v);
+            m_neg = v < 0;
+        }
+    }
+
+    static constexpr std::size_t num_blocks = 4;
+
+    bool is_negative() const { return m_neg; }
+    uint32_t block(std::size_t i) const
+    {
+        return i < num_blocks ? static_cast<uint32_t>(m_val >> (32 * i))
+               : m_neg        ? ~uint32_t{0}
+                              : 0;
+    }
+};
+
 }  // namespace utils
 
 
@@ -115,6 +735,9 @@ private:
 
     std::unique_ptr<Block[]> m_bitarr;
     std::size_t m_len;
+    bool m_signed = false;
+    /* Blocks allocated; those past get_arr_size() are kept zero */
+    std::size_t m_cap = 0;
 
     std::pair<std::size_t, std::size_t> get_num_block() const
     {
@@ -138,10 +761,52 @@ private:
 
     bits &do_operation(const bits &,
                        const std::function<Block(Block, Block)> &,
-                       const std::function<Block(Block, Block)> &);
+                       const std::function<Block(Block, Block)> &,
+                       Block);
 
     void trim_last_block();
     void shrink(std::size_t len);
+    void fill_ones(std::size_t s, std::size_t e);
+    /* Move the bits from pos to the top so that they start at dst */
+    void move_tail(std::size_t pos, std::size_t dst);
+    /* Copy v over the bits from pos */
+    void overwrite(std::size_t pos, const bits &v);
+    /* Reverse the order of the bits in [lo, hi) in place */
+    void reverse_range(std::size_t lo, std::size_t hi);
+
+    /* Concatenate [first, last) in one allocation, the first on top */
+    template <class It>
+    static bits concat(It first, It last);
+    static const bits &piece(const bits &b) { return b; }
+    static const bits &piece(const bits *b) { return *b; }
+
+    /* Block i of the value extended with zeros, or ones when neg */
+    Block ext_block(std::size_t i, bool neg) const;
+    /* block_size bits starting at pos, zeros beyond the width */
+    Block funnel_block(std::size_t pos) const;
+
+    /* Add (or subtract) rhs fitted to the width in place, return carry */
+    bool add_fitted(const bits &, bool, bool);
+    void saturate(bool neg);
+
+    template <class Op>
+    bits &int_bitwise(utils::int_operand, Op);
+    bits &int_add(utils::int_operand, bool);
+
+    friend int compare(const bits &, const bits &);
+    friend int compare(const bits &, utils::int_operand);
+    friend bits mul_lo(const bits &, const bits &, std::size_t);
+    friend std::pair<bits, bits> divmod(const bits &, const bits &);
+    friend bits mux(bool, const bits &, const bits &);
+    friend bits blend(const bits &, const bits &, const bits &);
+    friend bits mux1h(const bits &, const std::vector<bits> &);
+    friend bits priority_mux(const bits &, const std::vector<bits> &);
+    friend bits cat(const bits &, const bits &);
+    template <class... Rest>
+    friend bits cat(const bits &, const bits &, const bits &, const Rest &...);
+
+    std::vector<utils::limb> to_limbs() const;
+    void from_limbs(const std::vector<utils::limb> &);
 
 public:
     class bitstring
@@ -166,6 +831,7 @@ public:
         bool check_valid(const std::string &str, num_base base);
         std::string normalize(const std::string &str);
         std::size_t guess_width(const std::string &bs, num_base base);
+        std::string dec_to_hex(const std::string &str);
     };
 
     bits() : bits{0, 0} {}
@@ -202,11 +868,57 @@ public:
     bits reverse();
     constexpr std::size_t width() const { return m_len; }
 
+    /*
+     *  Signedness: signed values are two's complement, are sign-extended by
+     *  arithmetic, comparisons and operator>>=, and print as bit patterns
+     */
+    bool is_signed() const { return m_signed; }
+    bool is_negative() const { return m_signed && m_len > 0 && test(m_len - 1); }
+    bits as_signed() const &;
+    bits as_signed() &&;
+    bits as_unsigned() const &;
+    bits as_unsigned() &&;
+
+    bits sext(std::size_t len) const;
+    bits zext(std::size_t len) const;
+    bits &asr(std::size_t);
+
+    /*
+     *  Raw block access, for containers built on top of bits
+     */
+    using block_type = Block;
+    static constexpr std::size_t block_digits = block_size;
+
+    block_type *data() { return m_bitarr.get(); }
+    const block_type *data() const { return m_bitarr.get(); }
+    std::size_t num_blocks() const { return get_arr_size(); }
+
     bits &repeat(uint64_t);
     bits &append(const bits &);
 
+    /*
+     *  In-place edits: only the bits above the edited range move, and the
+     *  buffer is reused when the result fits in capacity()
+     */
+    bits &insert(std::size_t pos, const bits &);
+    bits &erase(std::size_t s, std::size_t e);
+    bits &replace(std::size_t s, std::size_t e, const bits &);
+    void reserve(std::size_t len);
+    std::size_t capacity() const { return m_cap * block_size; }
+
     std::string to_string(num_base base = num_base::hex) const;
     uint64_t to_uint64() const { return get_nbits(0, 64); }
+    int64_t to_int64() const;
+
+    /*
+     *  Binary serialization: the width as a little-endian 64-bit header
+     *  followed by the bits as little-endian 64-bit words
+     */
+    std::size_t serialized_size() const;
+    std::size_t serialize_into(uint8_t *buf, std::size_t size) const;
+    std::size_t deserialize_from(const uint8_t *buf, std::size_t size);
+    void write(std::ostream &os) const;
+    void read(std::istream &is);
 
     /*
      *  Slice operations
@@ -218,7 +930,13 @@ public:
     void set_nbits(uint64_t val,
                    std::size_t pos,
                    std::size_t digit = block_size);
-    std::size_t count();
+    std::size_t count() const;
+
+    /* Reductions over every bit, like Verilog's unary &, | and ^ */
+    bool all() const;
+    bool any() const;
+    bool none() const { return !any(); }
+    bool parity() const;
 
     bool empty() const;
     bool test(std::size_t pos) const;
@@ -227,15 +945,45 @@ public:
     void set(std::size_t pos, bool val) const;
 
     bool operator==(const bits &) const;
+    bool operator!=(const bits &rhs) const { return !(*this == rhs); }
+
+    /* Hash of the width, signedness and value, consistent with operator== */
+    std::size_t hash() const;
 
     bits &operator>>=(std::size_t);
     bits &operator<<=(std::size_t);
+    bits &rotl(std::size_t);
+    bits &rotr(std::size_t);
     bits &operator&=(const bits &);
     bits &operator|=(const bits &);
     bits &operator^=(const bits &);
     bits &operator+=(const bits &);
     bits &operator-=(const bits &);
+    bits &operator*=(const bits &);
+    bits &operator/=(const bits &);
+    bits &operator%=(const bits &);
+
+    /*
+     * Arithmetic keeping the width: rhs is truncated or extended to it and
+     * the result is computed in place without allocating.
+     */
+    bits &add_wrap(const bits &);
+    bits &sub_wrap(const bits &);
+    /* Clamp to the largest or smallest value instead of wrapping */
+    bits &add_sat(const bits &);
+    bits &sub_sat(const bits &);
+    /* Return the carry out of the top bit */
+    bool add_with_carry(const bits &, bool carry = false);
+
+    /* The integer is taken modulo 2^width(), the width is unchanged */
+    bits &operator&=(utils::int_operand);
+    bits &operator|=(utils::int_operand);
+    bits &operator^=(utils::int_operand);
+    bits &operator+=(utils::int_operand);
+    bits &operator-=(utils::int_operand);
+
     bits operator~() const;
+    bits operator-() const;
 };
 
 
@@ -255,8 +1003,8 @@ bits::bitstring::bitstring(std::size_t w, const std::string &str)
         throw std::invalid_argument("Bit string contain illegal characters!");
     }
 
-    bitstr = res;
-    base = b;
+    bitstr = b == num_base::dec ? dec_to_hex(res) : res;
+    base = b == num_base::dec ? num_base::hex : b;
     width = w;
 }
 
@@ -275,9 +1023,15 @@ bits::bitstring::bitstring(const std::string &str)
         throw std::invalid_argument("Bit string contain illegal characters!");
     }
 
-    bitstr = res;
-    base = b;
+    bitstr = b == num_base::dec ? dec_to_hex(res) : res;
+    base = b == num_base::dec ? num_base::hex : b;
     width = guess_width(bitstr, base);
+
+    /* Decimal strings are as wide as their value */
+    if (b == num_base::dec && !bitstr.empty()) {
+        const char c = bitstr[0];
+        width -= 4 - utils::guess_width(c >= 'a' ? c - 'a' + 10 : c - '0');
+    }
 }
 
 uint64_t bits::bitstring::get_nbits(std::size_t pos, std::size_t len) const
@@ -305,6 +1059,7 @@ std::pair<num_base, std::string> bits::bitstring::detect_base_by_prefix(
      *  0xdeadbeef -> deadbeef
      *  0b00000    -> 00000
      *  0o1122     -> 1122
+     *  0d1234     -> 1234
      *  010101     -> error
      *  xAAAA      -> error
      */
@@ -316,6 +1071,7 @@ std::pair<num_base, std::string> bits::bitstring::detect_base_by_prefix(
     return std::make_pair(str[1] == 'x'   ? num_base::hex
                           : str[1] == 'o' ? num_base::oct
                           : str[1] == 'b' ? num_base::bin
+                          : str[1] == 'd' ? num_base::dec
                                           : num_base::unknown,
                           str_wo_prefix);
 }
@@ -327,6 +1083,7 @@ bool bits::bitstring::check_valid(const std::string &str, num_base base)
                    ? (c >= '0' && c <= '9') || (c >= 'a' && c <= 'f')
                : base == num_base::bin ? c == '0' || c == '1'
                : base == num_base::oct ? c >= '0' && c <= '7'
+               : base == num_base::dec ? c >= '0' && c <= '9'
                                        : false;
     });
 }
@@ -354,10 +1111,28 @@ std::size_t bits::bitstring::guess_width(const std::string &bs, num_base base)
     return bs.length() * static_cast<std::size_t>(base);
 }
 
+std::string bits::bitstring::dec_to_hex(const std::string &str)
+{
+    if (str.empty()) {
+        return str;
+    }
+
+    auto limbs = utils::dec_to_limbs(str);
+    std::string hex;
+    for (std::size_t i = limbs.size() * 16; i-- > 0;) {
+        unsigned d = (limbs[i / 16] >> (i % 16 * 4)) & 0xF;
+        if (d != 0 || !hex.empty() || i == 0) {
+            hex.push_back("0123456789abcdef"[d]);
+        }
+    }
+    return hex;
+}
+
 bits::bits(std::size_t len, uint64_t val) : m_bitarr{nullptr}, m_len{len}
 {
     std::size_t arr_size = get_arr_size();
     m_bitarr = std::make_unique<Block[]>(arr_size);
+    m_cap = arr_size;
     for (std::size_t i = 0, j = 0; j < arr_size; i += block_size, j++) {
         m_bitarr[j] = val & ((1ULL << std::min(m_len - i, block_size)) - 1);
         val >>= block_size;
@@ -368,6 +1143,7 @@ bits::bits(std::size_t len, const bitstring &bs) : m_bitarr{nullptr}, m_len{len}
 {
     std::size_t arr_size = get_arr_size();
     m_bitarr = std::make_unique<Block[]>(arr_size);
+    m_cap = arr_size;
 
     for (std::size_t i = 0, j = 0; i < arr_size; i++, j += block_size) {
         std::size_t nbits = std::min(m_len - j, block_size);
@@ -375,24 +1151,59 @@ bits::bits(std::size_t len, const bitstring &bs) : m_bitarr{nullptr}, m_len{len}
     }
 }
 
-bits::bits(std::initializer_list<bits> l) : m_len(0)
+bits::bits(std::initializer_list<bits> l) : bits(concat(l.begin(), l.end()))
+{
+}
+
+template <class It>
+bits bits::concat(It first, It last)
 {
-    *this = bits{};
-    for (auto it = std::rbegin(l); it != std::rend(l); it++) {
-        this->append(*it);
+    std::size_t len = 0;
+    for (It it = first; it != last; ++it) {
+        len += piece(*it).m_len;
+    }
+
+    bits res{len, 0};
+    std::size_t arr_size = res.get_arr_size();
+    Block *out = res.m_bitarr.get();
+
+    /* From the bottom up, so the last piece lands at bit 0 */
+    std::size_t pos = 0;
+    for (It it = last; it != first;) {
+        const bits &b = piece(*--it);
+        const Block *src = b.m_bitarr.get();
+        std::size_t n = b.get_arr_size();
+        auto p = res.get_num_block(pos);
+
+        if (p.second == 0) {
+            std::copy_n(src, n, out + p.first);
+        } else {
+            /* Each block straddles two output blocks */
+            for (std::size_t i = 0, j = p.first; i < n; i++, j++) {
+                out[j] |= src[i] << p.second;
+                if (j + 1 < arr_size) {
+                    out[j + 1] |= src[i] >> (block_size - p.second);
+                }
+            }
+        }
+        pos += b.m_len;
     }
+    return res;
 }
 
-bits::bits(const bits &other) : m_len{other.m_len}
+bits::bits(const bits &other) : m_len{other.m_len}, m_signed{other.m_signed}
 {
     std::size_t arr_size = other.get_arr_size();
     m_bitarr = std::make_unique<Block[]>(arr_size);
+    m_cap = arr_size;
     std::copy_n(other.m_bitarr.get(), arr_size, m_bitarr.get());
 }
 
-bits::bits(bits &&other) : m_bitarr{nullptr}, m_len{other.m_len}
+bits::bits(bits &&other)
+    : m_bitarr{nullptr}, m_len{other.m_len}, m_signed{other.m_signed}
 {
     std::swap(other.m_bitarr, m_bitarr);
+    std::swap(other.m_cap, m_cap);
 }
 
 bits &bits::operator=(const bits &rhs)
@@ -404,7 +1215,9 @@ bits &bits::operator=(const bits &rhs)
     std::size_t arr_size = rhs.get_arr_size();
     auto new_bitarr = std::make_unique<Block[]>(arr_size);
     m_bitarr = std::move(new_bitarr);
+    m_cap = arr_size;
     m_len = rhs.m_len;
+    m_signed = rhs.m_signed;
 
     std::copy_n(rhs.m_bitarr.get(), arr_size, m_bitarr.get());
     return *this;
@@ -417,6 +1230,8 @@ bits &bits::operator=(bits &&rhs)
     }
     std::swap(rhs.m_bitarr, m_bitarr);
     std::swap(rhs.m_len, m_len);
+    std::swap(rhs.m_signed, m_signed);
+    std::swap(rhs.m_cap, m_cap);
 
     return *this;
 }
@@ -464,28 +1279,83 @@ bits bits::reverse()
 }
 
 
-bits &bits::repeat(uint64_t times)
+bits bits::as_signed() const &
 {
-    if (times == 0) {
-        *this = bits{};
-        return *this;
-    }
-
-    /* Save the origin value; */
-    /* Use () rather than {} to avoid applying initializer_list ctor */
-    const bits b(*this);
+    return bits(*this).as_signed();
+}
 
-    for (uint64_t i = 0; i < times - 1; i++) {
-        this->append(b);
-    }
-    return *this;
+bits bits::as_signed() &&
+{
+    m_signed = true;
+    return std::move(*this);
 }
 
-bits &bits::append(const bits &rhs)
+bits bits::as_unsigned() const &
 {
-    if (rhs.empty()) {
-        return *this;
-    }
+    return bits(*this).as_unsigned();
+}
+
+bits bits::as_unsigned() &&
+{
+    m_signed = false;
+    return std::move(*this);
+}
+
+bits bits::sext(std::size_t len) const
+{
+    bits b{len, 0};
+    b.m_signed = m_signed;
+    std::copy_n(m_bitarr.get(), std::min(get_arr_size(), b.get_arr_size()),
+                b.m_bitarr.get());
+
+    if (len > m_len && m_len > 0 && (*this)[m_len - 1]) {
+        b.fill_ones(m_len, len);
+    }
+    b.trim_last_block();
+    return b;
+}
+
+bits bits::zext(std::size_t len) const
+{
+    bits b{len, 0};
+    b.m_signed = m_signed;
+    std::copy_n(m_bitarr.get(), std::min(get_arr_size(), b.get_arr_size()),
+                b.m_bitarr.get());
+    b.trim_last_block();
+    return b;
+}
+
+int64_t bits::to_int64() const
+{
+    uint64_t val = get_nbits(0, 64);
+    if (is_negative() && m_len < 64) {
+        val |= ~0ULL << m_len;
+    }
+    return static_cast<int64_t>(val);
+}
+
+bits &bits::repeat(uint64_t times)
+{
+    if (times == 0) {
+        *this = bits{};
+        return *this;
+    }
+
+    /* Save the origin value; */
+    /* Use () rather than {} to avoid applying initializer_list ctor */
+    const bits b(*this);
+
+    for (uint64_t i = 0; i < times - 1; i++) {
+        this->append(b);
+    }
+    return *this;
+}
+
+bits &bits::append(const bits &rhs)
+{
+    if (rhs.empty()) {
+        return *this;
+    }
 
     const auto p = get_num_block();
 
@@ -513,13 +1383,144 @@ bits &bits::append(const bits &rhs)
 
     m_len = m_len + rhs.m_len;
     m_bitarr = std::move(new_bitarr);
+    m_cap = new_arr_size;
+
+    trim_last_block();
+    return *this;
+}
+
+void bits::reserve(std::size_t len)
+{
+    std::size_t arr_size = get_arr_size(len);
+    if (arr_size <= m_cap) {
+        return;
+    }
+
+    auto new_bitarr = std::make_unique<Block[]>(arr_size);
+    std::copy_n(m_bitarr.get(), get_arr_size(), new_bitarr.get());
+    m_bitarr = std::move(new_bitarr);
+    m_cap = arr_size;
+}
+
+void bits::move_tail(std::size_t pos, std::size_t dst)
+{
+    std::size_t len = m_len - pos + dst;
+    std::size_t first = dst / block_size;
+    std::size_t arr_size = get_arr_size(len);
+    /* The bits below dst in its block are kept */
+    Block keep = static_cast<Block>((1ULL << (dst % block_size)) - 1);
+
+    if (dst > pos) {
+        /* Top down, so that each source block is read before it moves */
+        reserve(len);
+        std::size_t shift = dst - pos;
+        for (std::size_t i = arr_size; i-- > first;) {
+            std::size_t at = i * block_size;
+            Block blk = at >= shift ? funnel_block(at - shift)
+                                    : funnel_block(0) << (shift - at);
+            if (i == first) {
+                blk = (m_bitarr[i] & keep) | (blk & ~keep);
+            }
+            m_bitarr[i] = blk;
+        }
+    } else if (dst < pos) {
+        std::size_t shift = pos - dst;
+        for (std::size_t i = first; i < arr_size; i++) {
+            Block blk = funnel_block(i * block_size + shift);
+            if (i == first) {
+                blk = (m_bitarr[i] & keep) | (blk & ~keep);
+            }
+            m_bitarr[i] = blk;
+        }
+        std::fill(m_bitarr.get() + arr_size, m_bitarr.get() + get_arr_size(),
+                  0);
+    }
 
+    m_len = len;
     trim_last_block();
+}
+
+void bits::overwrite(std::size_t pos, const bits &v)
+{
+    constexpr std::size_t digits = std::numeric_limits<uint64_t>::digits;
+    for (std::size_t i = 0; i < v.m_len; i += digits) {
+        set_nbits(v.get_nbits(i, digits), pos + i,
+                  std::min(digits, v.m_len - i));
+    }
+}
+
+void bits::reverse_range(std::size_t lo, std::size_t hi)
+{
+    using utils::reverse_bits;
+
+    /* Swap reversed words from both ends towards the middle */
+    for (; hi - lo >= 128; lo += 64, hi -= 64) {
+        uint64_t a = get_nbits(lo, 64), b = get_nbits(hi - 64, 64);
+        set_nbits(reverse_bits(b), lo, 64);
+        set_nbits(reverse_bits(a), hi - 64, 64);
+    }
+
+    /* Less than two words are left in the middle */
+    std::size_t n = hi - lo;
+    if (n > 64) {
+        uint64_t a = get_nbits(lo, 64), b = get_nbits(lo + 64, n - 64);
+        set_nbits(reverse_bits(b) >> (128 - n), lo, n - 64);
+        set_nbits(reverse_bits(a), lo + n - 64, 64);
+    } else if (n > 1) {
+        set_nbits(reverse_bits(get_nbits(lo, n)) >> (64 - n), lo, n);
+    }
+}
+
+bits &bits::insert(std::size_t pos, const bits &v)
+{
+    if (pos > m_len) {
+        throw std::out_of_range("Position is out of range");
+    }
+    if (&v == this) {
+        return insert(pos, bits(v));
+    }
+
+    move_tail(pos, pos + v.m_len);
+    overwrite(pos, v);
+    return *this;
+}
+
+bits &bits::erase(std::size_t s, std::size_t e)
+{
+    if (!check_range(s, e)) {
+        throw std::out_of_range("range error");
+    }
+
+    move_tail(s + 1, e);
+    return *this;
+}
+
+bits &bits::replace(std::size_t s, std::size_t e, const bits &v)
+{
+    if (!check_range(s, e)) {
+        throw std::out_of_range("range error");
+    }
+    if (&v == this) {
+        return replace(s, e, bits(v));
+    }
+
+    move_tail(s + 1, e + v.m_len);
+    overwrite(e, v);
     return *this;
 }
 
 std::string bits::to_string(num_base base) const
 {
+    if (base == num_base::dec) {
+        /* Signed values print their numeric value */
+        std::string res = is_negative() ? "-" : "";
+        auto limbs = (is_negative() ? -*this : *this).to_limbs();
+        auto pow = utils::dec_powers(limbs.size());
+        auto inv = utils::dec_reciprocals(pow, limbs.size());
+        utils::limbs_to_dec(std::move(limbs), pow, inv, 1, res);
+        return res;
+    }
+
     std::string bitstr;
     bitstr.reserve(m_len);
 
@@ -534,22 +1535,155 @@ std::string bits::to_string(num_base base) const
     return bitstr;
 }
 
+std::size_t bits::serialized_size() const
+{
+    std::size_t num_words =
+        m_len / 64 + static_cast<std::size_t>(m_len % 64 != 0);
+    return sizeof(uint64_t) * (1 + num_words);
+}
+
+std::size_t bits::serialize_into(uint8_t *buf, std::size_t size) const
+{
+    std::size_t total = serialized_size();
+    if (size < total) {
+        throw std::out_of_range("Buffer is too small");
+    }
+
+    utils::store_le64(buf, m_len);
+
+    uint8_t *payload = buf + sizeof(uint64_t);
+    std::size_t arr_size = get_arr_size();
+    if (utils::is_little_endian) {
+        std::memcpy(payload, m_bitarr.get(), arr_size * sizeof(Block));
+    } else {
+        for (std::size_t i = 0; i < arr_size * sizeof(Block); i++) {
+            payload[i] = static_cast<uint8_t>(
+                m_bitarr[i / sizeof(Block)] >> (8 * (i % sizeof(Block))));
+        }
+    }
+
+    /* Pad up to a whole word */
+    std::fill(payload + arr_size * sizeof(Block), buf + total, 0);
+    return total;
+}
+
+std::size_t bits::deserialize_from(const uint8_t *buf, std::size_t size)
+{
+    if (size < sizeof(uint64_t)) {
+        throw std::out_of_range("Buffer is too small");
+    }
+
+    uint64_t len = utils::load_le64(buf);
+    uint64_t num_words = len / 64 + static_cast<uint64_t>(len % 64 != 0);
+    if (num_words > size / sizeof(uint64_t) - 1) {
+        throw std::out_of_range("Buffer is too small");
+    }
+
+    bits b{static_cast<std::size_t>(len), 0};
+    const uint8_t *payload = buf + sizeof(uint64_t);
+    std::size_t arr_size = b.get_arr_size();
+    if (utils::is_little_endian) {
+        std::memcpy(b.m_bitarr.get(), payload, arr_size * sizeof(Block));
+    } else {
+        for (std::size_t i = 0; i < arr_size * sizeof(Block); i++) {
+            b.m_bitarr[i / sizeof(Block)] |=
+                static_cast<Block>(payload[i]) << (8 * (i % sizeof(Block)));
+        }
+    }
+    b.trim_last_block();
+
+    *this = std::move(b);
+    return sizeof(uint64_t) * (1 + num_words);
+}
+
+void bits::write(std::ostream &os) const
+{
+    if (!utils::is_little_endian) {
+        std::vector<uint8_t> buf(serialized_size());
+        serialize_into(buf.data(), buf.size());
+        os.write(reinterpret_cast<const char *>(buf.data()), buf.size());
+        return;
+    }
+
+    /* The blocks are already laid out as little-endian words */
+    uint8_t header[sizeof(uint64_t)];
+    utils::store_le64(header, m_len);
+    os.write(reinterpret_cast<const char *>(header), sizeof(header));
+
+    std::size_t arr_bytes = get_arr_size() * sizeof(Block);
+    os.write(reinterpret_cast<const char *>(m_bitarr.get()), arr_bytes);
+
+    const char padding[sizeof(uint64_t)] = {};
+    os.write(padding, serialized_size() - sizeof(uint64_t) - arr_bytes);
+}
+
+void bits::read(std::istream &is)
+{
+    uint8_t header[sizeof(uint64_t)];
+    if (!is.read(reinterpret_cast<char *>(header), sizeof(header))) {
+        throw std::runtime_error("Failed to read bits from stream");
+    }
+
+    uint64_t len = utils::load_le64(header);
+    uint64_t num_words = len / 64 + static_cast<uint64_t>(len % 64 != 0);
+    std::size_t max_words =
+        std::numeric_limits<std::size_t>::max() / sizeof(uint64_t);
+    if (num_words > max_words) {
+        throw std::runtime_error("Failed to read bits from stream");
+    }
+
+    /*
+     * The header cannot be checked against the stream length up front, so
+     * the payload is read in bounded chunks: a corrupt width fails at the
+     * end of the stream instead of allocating all of it first
+     */
+    constexpr std::size_t chunk_size = std::size_t{1} << 20;
+    std::size_t payload_size = num_words * sizeof(uint64_t);
+    std::vector<uint8_t> payload;
+    while (payload.size() < payload_size) {
+        std::size_t off = payload.size();
+        std::size_t n = std::min(chunk_size, payload_size - off);
+        payload.resize(off + n);
+        if (!is.read(reinterpret_cast<char *>(payload.data() + off), n)) {
+            throw std::runtime_error("Failed to read bits from stream");
+        }
+    }
+
+    bits b{static_cast<std::size_t>(len), 0};
+    std::size_t arr_bytes = b.get_arr_size() * sizeof(Block);
+    if (utils::is_little_endian && arr_bytes != 0) {
+        std::memcpy(b.m_bitarr.get(), payload.data(), arr_bytes);
+    } else {
+        for (std::size_t i = 0; i < arr_bytes; i++) {
+            b.m_bitarr[i / sizeof(Block)] |=
+                static_cast<Block>(payload[i]) << (8 * (i % sizeof(Block)));
+        }
+    }
+    b.trim_last_block();
+
+    *this = std::move(b);
+}
+
 bits bits::operator()(std::size_t s, std::size_t e) const
 {
     if (!check_range(s, e)) {
         throw std::out_of_range("range error");
     }
 
+    /* Slices are unsigned */
     bits b{*this};
+    b.m_signed = false;
     b >>= e;
-    b.shrink(s - e + 1);
+    if (s - e + 1 < m_len) {
+        b.shrink(s - e + 1);
+    }
 
     return b;
 }
 
 bool bits::operator==(const bits &rhs) const
 {
-    if (m_len != rhs.m_len) {
+    if (m_len != rhs.m_len || m_signed != rhs.m_signed) {
         return false;
     }
 
@@ -563,6 +1697,40 @@ bool bits::operator==(const bits &rhs) const
     return true;
 }
 
+std::size_t bits::hash() const
+{
+    constexpr uint64_t p[] = {0xa0761d6478bd642f, 0xe7037ed1a0b428db,
+                              0x8ebc6af09c88c6e3, 0x589965cc75374cc3};
+
+    std::size_t arr_size = get_arr_size();
+    auto word = [&](std::size_t i) {
+        uint64_t lo = m_bitarr[2 * i];
+        uint64_t hi = 2 * i + 1 < arr_size ? m_bitarr[2 * i + 1] : 0;
+        return lo | hi << 32;
+    };
+
+    static_assert(block_size == 32, "words are assembled from two blocks");
+    std::size_t num_words = (arr_size + 1) / 2;
+
+    /* Four independent lanes keep the multipliers busy on wide values */
+    uint64_t acc[4] = {p[0], p[1], p[2], p[3]};
+    std::size_t i = 0;
+    for (; i + 4 <= num_words; i += 4) {
+        for (std::size_t j = 0; j < 4; j++) {
+            acc[j] = utils::mum(acc[j] ^ word(i + j), p[j] ^ p[(j + 1) % 4]);
+        }
+    }
+
+    uint64_t h = utils::mum((m_len << 1 | m_signed) ^ p[0], p[1]);
+    for (std::size_t j = 0; j < 4; j++) {
+        h = utils::mum(h ^ acc[j], p[(j + 2) % 4]);
+    }
+    for (; i < num_words; i++) {
+        h = utils::mum(h ^ word(i), p[i % 4] ^ p[3]);
+    }
+    return static_cast<std::size_t>(utils::mum(h, p[0] ^ p[2]));
+}
+
 // Bits &Bits::operator+=(const Bits &rhs)
 //{
 //    m_len += rhs.m_len;
@@ -593,51 +1761,33 @@ void bits::set_nbits(uint64_t val, std::size_t pos, std::size_t digits)
         return;
     }
 
-    /* Closed start */
-    auto p_start = get_num_block(pos);
-
-    /* Open end */
-    auto p_end = pos + digits <= m_len ? get_num_block(pos + digits)
-                                       : get_num_block(m_len);
-
+    /* Clip the field to the width */
+    digits = std::min(digits, m_len - pos);
 
-    /* Ensure val is at most n-bit long */
-    val &= ((1ULL << digits) - 1);
+    while (digits > 0) {
+        auto p = get_num_block(pos);
+        std::size_t nbits = std::min(block_size - p.second, digits);
+        Block mask = static_cast<Block>((1ULL << nbits) - 1) << p.second;
 
-    if (p_start.first == p_end.first) {
-        Block mask = ((1 << digits) - 1) << p_start.second;
-        m_bitarr[p_start.first] &= ~mask;
-        m_bitarr[p_start.first] |= static_cast<Block>(val) << p_start.second;
-        return;
-    }
+        m_bitarr[p.first] &= ~mask;
+        m_bitarr[p.first] |= static_cast<Block>(val << p.second) & mask;
 
-    for (std::size_t pos = p_start.first; pos <= p_end.first; pos++) {
-        if (pos == p_start.first) {
-            Block mask = ((1 << (block_size - p_start.second)) - 1)
-                         << p_start.second;
-            std::size_t b = block_size - p_start.second;
-            m_bitarr[pos] &= ~mask;
-            m_bitarr[pos] |= static_cast<Block>(val & ((1 << b) - 1))
-                             << p_start.second;
-            val >>= b;
-        } else if (pos == p_end.first) {
-            if (p_end.second > 0) {
-                Block mask = (1 << p_end.second) - 1;
-                m_bitarr[pos] &= ~mask;
-                m_bitarr[pos] |= val & mask;
-            }
-        } else {
-            /* m_bitarr[pos] = (val & (1ULL << block_size) - 1); */
-            m_bitarr[pos] = (val & static_cast<Block>(-1));
-            val >>= block_size;
-        }
+        val >>= nbits;
+        pos += nbits;
+        digits -= nbits;
     }
 }
-std::size_t bits::count()
+std::size_t bits::count() const
 {
     std::size_t sz = get_arr_size();
     std::size_t res = 0;
-    for (std::size_t i = 0; i < sz; i++) {
+    std::size_t i = 0;
+    for (; i + 1 < sz; i += 2) {
+        uint64_t w;
+        std::memcpy(&w, m_bitarr.get() + i, sizeof(w));
+        res += __builtin_popcountll(w);
+    }
+    if (i < sz) {
         res += __builtin_popcount(m_bitarr[i]);
     }
     return res;
@@ -653,6 +1803,47 @@ void bits::trim_last_block()
     }
 }
 
+void bits::fill_ones(std::size_t s, std::size_t e)
+{
+    /* Set the bits in [s, e) */
+    while (s < e) {
+        auto p = get_num_block(s);
+        std::size_t nbits = std::min(block_size - p.second, e - s);
+        m_bitarr[p.first] |= static_cast<Block>((1ULL << nbits) - 1)
+                             << p.second;
+        s += nbits;
+    }
+}
+
+bits::Block bits::ext_block(std::size_t i, bool neg) const
+{
+    auto p = get_num_block();
+    Block fill = neg ? static_cast<Block>(-1) : 0;
+
+    if (i < p.first) {
+        return m_bitarr[i];
+    }
+    if (i == p.first && p.second != 0) {
+        return m_bitarr[i] | static_cast<Block>(fill << p.second);
+    }
+    return fill;
+}
+
+bits::Block bits::funnel_block(std::size_t pos) const
+{
+    auto p = get_num_block(pos);
+    std::size_t arr_size = get_arr_size();
+
+    if (p.first >= arr_size) {
+        return 0;
+    }
+    Block lo = m_bitarr[p.first] >> p.second;
+    if (p.second == 0 || p.first + 1 >= arr_size) {
+        return lo;
+    }
+    return lo | m_bitarr[p.first + 1] << (block_size - p.second);
+}
+
 void bits::shrink(std::size_t len)
 {
     if (len >= m_len) {
@@ -673,12 +1864,26 @@ void bits::shrink(std::size_t len)
 
 bits &bits::operator>>=(std::size_t val)
 {
+    bool neg = is_negative();
     std::size_t arr_size = get_arr_size();
 
     for (std::size_t i = 0, j = val; i < arr_size; i++, j += block_size) {
-        /* TODO: padded with the sign bit */
         m_bitarr[i] = get_nbits(j, block_size);
     }
+
+    /* Padded with the sign bit */
+    if (neg) {
+        fill_ones(m_len - std::min<std::size_t>(val, m_len), m_len);
+    }
+    return *this;
+}
+
+bits &bits::asr(std::size_t val)
+{
+    bool is_signed = m_signed;
+    m_signed = true;
+    *this >>= val;
+    m_signed = is_signed;
     return *this;
 }
 
@@ -706,8 +1911,10 @@ bits &bits::operator<<=(std::size_t val)
             pos -= block_size;
             m_bitarr[--arr_pos] = get_nbits(pos, block_size);
         } else {
-            /* residue */
-            m_bitarr[--arr_pos] = m_bitarr[0] << (block_size - pos);
+            /* residue, none when val is a multiple of the block size */
+            if (pos > 0) {
+                m_bitarr[--arr_pos] = m_bitarr[0] << (block_size - pos);
+            }
             break;
         }
     }
@@ -720,6 +1927,50 @@ bits &bits::operator<<=(std::size_t val)
     return *this;
 }
 
+bits &bits::rotl(std::size_t val)
+{
+    if (m_len == 0 || (val %= m_len) == 0) {
+        return *this;
+    }
+
+    /* A single rotate on one word */
+    if (m_len <= 64) {
+        uint64_t v = get_nbits(0, 64);
+        uint64_t mask = m_len == 64 ? ~0ULL : (1ULL << m_len) - 1;
+        v = ((v << val) | (v >> (m_len - val))) & mask;
+        for (std::size_t i = 0; i < get_arr_size(); i++) {
+            m_bitarr[i] = static_cast<Block>(v >> (i * block_size));
+        }
+        return *this;
+    }
+
+    /* Three reversals in the buffer: the top val bits end up at the bottom */
+    reverse_range(0, m_len);
+    reverse_range(0, val);
+    reverse_range(val, m_len);
+    return *this;
+}
+
+bits &bits::rotr(std::size_t val)
+{
+    if (m_len == 0) {
+        return *this;
+    }
+    return rotl(m_len - val % m_len);
+}
+
+bits rotl(bits b, std::size_t val)
+{
+    b.rotl(val);
+    return b;
+}
+
+bits rotr(bits b, std::size_t val)
+{
+    b.rotr(val);
+    return b;
+}
+
 bits operator>>(bits b, uint64_t val)
 {
     b >>= val;
@@ -760,41 +2011,258 @@ bits operator-(bits lhs, const bits &rhs)
     return lhs;
 }
 
-std::ostream &operator<<(std::ostream &os, const bits &b)
+/*
+ * Sum and difference one bit wider than the wider operand, so that the
+ * carry or borrow is kept (chisel's +& and -&).
+ */
+bits add_expand(const bits &lhs, const bits &rhs)
 {
-    os << b.to_string();
-    return os;
+    std::size_t len = std::max(lhs.width(), rhs.width()) + 1;
+    bool is_signed = lhs.is_signed() && rhs.is_signed();
+    bits res = is_signed ? lhs.sext(len) : lhs.zext(len).as_unsigned();
+    return res.add_wrap(rhs);
 }
 
-bits &bits::do_operation(
-    const bits &rhs,
-    const std::function<Block(Block, Block)> &op,
-    const std::function<Block(Block, Block)> &carry = [](Block x, Block y) {
-        (void) x;
-        (void) y;
-        return 0;
-    })
+bits sub_expand(const bits &lhs, const bits &rhs)
 {
-    std::size_t old_arr_size = this->get_arr_size();
-    std::size_t rhs_arr_size = rhs.get_arr_size();
-    std::size_t new_arr_size = std::max(old_arr_size, rhs_arr_size);
-
-    auto new_bitarr = std::make_unique<Block[]>(new_arr_size);
-    Block car_val = 0;
-
-    for (size_t i = 0; i < new_arr_size; i++) {
-        Block x = i >= old_arr_size ? 0 : m_bitarr[i];
-        Block y = i >= rhs_arr_size ? 0 : rhs.m_bitarr[i];
-
-        new_bitarr[i] = op(x, y) + car_val;
-        car_val = carry(x, y);
-    }
-
-    m_bitarr = std::move(new_bitarr);
-    m_len = std::max(m_len, rhs.m_len);
-
-    trim_last_block();
-    return (*this);
+    std::size_t len = std::max(lhs.width(), rhs.width()) + 1;
+    bool is_signed = lhs.is_signed() && rhs.is_signed();
+    bits res = is_signed ? lhs.sext(len) : lhs.zext(len).as_unsigned();
+    return res.sub_wrap(rhs);
+}
+
+/* With a native integer, the result is as wide as the bits operand */
+bits operator&(bits lhs, utils::int_operand rhs)
+{
+    lhs &= rhs;
+    return lhs;
+}
+bits operator&(utils::int_operand lhs, bits rhs)
+{
+    rhs &= lhs;
+    return rhs;
+}
+bits operator|(bits lhs, utils::int_operand rhs)
+{
+    lhs |= rhs;
+    return lhs;
+}
+bits operator|(utils::int_operand lhs, bits rhs)
+{
+    rhs |= lhs;
+    return rhs;
+}
+bits operator^(bits lhs, utils::int_operand rhs)
+{
+    lhs ^= rhs;
+    return lhs;
+}
+bits operator^(utils::int_operand lhs, bits rhs)
+{
+    rhs ^= lhs;
+    return rhs;
+}
+bits operator+(bits lhs, utils::int_operand rhs)
+{
+    lhs += rhs;
+    return lhs;
+}
+bits operator+(utils::int_operand lhs, bits rhs)
+{
+    rhs += lhs;
+    return rhs;
+}
+bits operator-(bits lhs, utils::int_operand rhs)
+{
+    lhs -= rhs;
+    return lhs;
+}
+bits operator-(utils::int_operand lhs, bits rhs)
+{
+    rhs = -rhs;
+    rhs += lhs;
+    return rhs;
+}
+
+std::vector<utils::limb> bits::to_limbs() const
+{
+    static_assert(block_size == 32, "limbs are assembled from two blocks");
+
+    std::size_t arr_size = get_arr_size();
+    std::vector<utils::limb> limbs((arr_size + 1) / 2);
+    for (std::size_t i = 0; i < arr_size; i++) {
+        limbs[i / 2] |= static_cast<utils::limb>(m_bitarr[i])
+                        << (block_size * (i % 2));
+    }
+    return limbs;
+}
+
+void bits::from_limbs(const std::vector<utils::limb> &limbs)
+{
+    for (std::size_t i = 0; i < get_arr_size(); i++) {
+        m_bitarr[i] = i / 2 < limbs.size()
+                          ? static_cast<Block>(limbs[i / 2] >>
+                                               (block_size * (i % 2)))
+                          : 0;
+    }
+    trim_last_block();
+}
+
+/*
+ * Low len bits of the product. Partial products wholly above len are
+ * skipped, except within a slice whose truncation point falls in its upper
+ * half. Signed operands multiply as signed when both are signed.
+ */
+bits mul_lo(const bits &lhs, const bits &rhs, std::size_t len)
+{
+    bool is_signed = lhs.is_signed() && rhs.is_signed();
+    bool negate = is_signed && (lhs.is_negative() != rhs.is_negative());
+
+    /* Multiply magnitudes, then restore the sign */
+    auto a = (is_signed && lhs.is_negative() ? -lhs : lhs).to_limbs();
+    auto b = (is_signed && rhs.is_negative() ? -rhs : rhs).to_limbs();
+
+    bits res{len, 0};
+    std::vector<utils::limb> out((len + 63) / 64);
+    utils::mul_limbs(a.data(), a.size(), b.data(), b.size(), out.data(),
+                     out.size());
+    res.from_limbs(out);
+    res.m_signed = is_signed;
+
+    return negate ? -res : res;
+}
+
+bits mul_lo(const bits &lhs, const bits &rhs)
+{
+    return mul_lo(lhs, rhs, std::max(lhs.width(), rhs.width()));
+}
+
+/*
+ * Quotient as wide as lhs and remainder as wide as the narrower operand,
+ * as in chisel. Signed operands (both signed) divide with truncation
+ * toward zero and the remainder takes the sign of lhs.
+ */
+std::pair<bits, bits> divmod(const bits &lhs, const bits &rhs)
+{
+    bool is_signed = lhs.is_signed() && rhs.is_signed();
+    bool l_neg = is_signed && lhs.is_negative();
+    bool r_neg = is_signed && rhs.is_negative();
+
+    auto u = (l_neg ? -lhs : lhs).to_limbs();
+    auto v = (r_neg ? -rhs : rhs).to_limbs();
+    std::size_t m = utils::num_limbs(u), n = utils::num_limbs(v);
+    if (n == 0) {
+        throw std::domain_error("Division by zero");
+    }
+
+    std::vector<utils::limb> q(m >= n ? m - n + 1 : 0), r(n);
+    if (m >= n) {
+        utils::divmod_limbs(u.data(), m, v.data(), n, q.data(), r.data());
+    } else {
+        std::copy_n(u.data(), m, r.data());
+    }
+
+    bits quot{lhs.width(), 0};
+    bits rem{std::min(lhs.width(), rhs.width()), 0};
+    quot.from_limbs(q);
+    rem.from_limbs(r);
+    quot.m_signed = rem.m_signed = is_signed;
+
+    if (l_neg != r_neg) {
+        quot = -quot;
+    }
+    if (l_neg) {
+        rem = -rem;
+    }
+    return std::make_pair(std::move(quot), std::move(rem));
+}
+
+bits operator/(const bits &lhs, const bits &rhs)
+{
+    return divmod(lhs, rhs).first;
+}
+
+bits operator%(const bits &lhs, const bits &rhs)
+{
+    return divmod(lhs, rhs).second;
+}
+
+bits &bits::operator/=(const bits &rhs)
+{
+    *this = divmod(*this, rhs).first;
+    return *this;
+}
+
+bits &bits::operator%=(const bits &rhs)
+{
+    *this = divmod(*this, rhs).second;
+    return *this;
+}
+
+/* Full product, as wide as both operands together */
+bits operator*(const bits &lhs, const bits &rhs)
+{
+    return mul_lo(lhs, rhs, lhs.width() + rhs.width());
+}
+
+bits &bits::operator*=(const bits &rhs)
+{
+    *this = *this * rhs;
+    return *this;
+}
+
+std::ostream &operator<<(std::ostream &os, const bits &b)
+{
+    os << b.to_string();
+    return os;
+}
+
+bits &bits::do_operation(
+    const bits &rhs,
+    const std::function<Block(Block, Block)> &op,
+    const std::function<Block(Block, Block)> &carry =
+        [](Block x, Block y) {
+            (void) x;
+            (void) y;
+            return 0;
+        },
+    Block car_val = 0)
+{
+    std::size_t old_arr_size = this->get_arr_size();
+    std::size_t rhs_arr_size = rhs.get_arr_size();
+    std::size_t new_arr_size = std::max(old_arr_size, rhs_arr_size);
+
+    /* Signed operands are sign-extended to the wider one */
+    bool is_signed = m_signed && rhs.m_signed;
+    bool neg = is_signed && is_negative();
+    bool rhs_neg = is_signed && rhs.is_negative();
+
+    /* Work in place unless rhs needs more blocks */
+    std::unique_ptr<Block[]> new_bitarr;
+    Block *out = m_bitarr.get();
+    if (new_arr_size > old_arr_size) {
+        new_bitarr = std::make_unique<Block[]>(new_arr_size);
+        out = new_bitarr.get();
+    }
+
+    for (size_t i = 0; i < new_arr_size; i++) {
+        Block x = ext_block(i, neg);
+        Block y = rhs.ext_block(i, rhs_neg);
+
+        Block res = op(x, y);
+        out[i] = res + car_val;
+        car_val = carry(x, y) | static_cast<Block>(out[i] < res);
+    }
+
+    if (new_bitarr) {
+        m_bitarr = std::move(new_bitarr);
+        m_cap = new_arr_size;
+    }
+    m_len = std::max(m_len, rhs.m_len);
+    m_signed = is_signed;
+
+    trim_last_block();
+    return (*this);
 }
 
 bits &bits::operator&=(const bits &rhs)
@@ -816,17 +2284,211 @@ bits &bits::operator+=(const bits &rhs)
 {
     return do_operation(
         rhs, [](Block x, Block y) { return x + y; },
-        [](Block x, Block y) { return x + y <= x && x + y <= y; });
+        [](Block x, Block y) { return static_cast<Block>(x + y < x); });
 }
 
 bits &bits::operator-=(const bits &rhs)
 {
-    if (!rhs.empty()) {
-        (*this) += ~rhs + bits::ones(1);
+    /* x - y == x + ~y + 1, with the +1 as the initial carry */
+    return do_operation(
+        rhs, [](Block x, Block y) { return x + ~y; },
+        [](Block x, Block y) { return static_cast<Block>(x + ~y < x); }, 1);
+}
+
+bool bits::add_fitted(const bits &rhs, bool sub, bool carry)
+{
+    auto p = get_num_block();
+    std::size_t arr_size = get_arr_size();
+    bool rhs_neg = m_signed && rhs.m_signed && rhs.is_negative();
+    Block car_val = carry ? 1 : 0;
+
+    for (std::size_t i = 0; i < arr_size; i++) {
+        Block x = m_bitarr[i];
+        Block y = rhs.ext_block(i, rhs_neg);
+        y = sub ? ~y : y;
+
+        if (i == p.first) {
+            /* Partial last block: the carry out is the bit above the width */
+            y &= (Block{1} << p.second) - 1;
+            Block res = x + y + car_val;
+            m_bitarr[i] = res;
+            trim_last_block();
+            return static_cast<bool>((res >> p.second) & 1);
+        }
+
+        Block res = x + y;
+        m_bitarr[i] = res + car_val;
+        car_val = static_cast<Block>(res < x) |
+                  static_cast<Block>(m_bitarr[i] < res);
+    }
+    return static_cast<bool>(car_val);
+}
+
+void bits::saturate(bool neg)
+{
+    /* Signed values clamp to their extremes, unsigned to all ones or zeros */
+    Block fill = neg ? 0 : ~Block{0};
+    for (std::size_t i = 0; i < get_arr_size(); i++) {
+        m_bitarr[i] = fill;
+    }
+    trim_last_block();
+    if (m_signed && m_len > 0) {
+        set(m_len - 1, neg);
+    }
+}
+
+bits &bits::add_wrap(const bits &rhs)
+{
+    add_fitted(rhs, false, false);
+    return *this;
+}
+
+bits &bits::sub_wrap(const bits &rhs)
+{
+    add_fitted(rhs, true, true);
+    return *this;
+}
+
+bool bits::add_with_carry(const bits &rhs, bool carry)
+{
+    return add_fitted(rhs, false, carry);
+}
+
+bits &bits::add_sat(const bits &rhs)
+{
+    if (m_len == 0) {
+        return *this;
+    }
+
+    if (m_signed && rhs.m_signed) {
+        /* Overflow when both signs agree and the result sign differs */
+        bool x_neg = is_negative();
+        bool y_neg = static_cast<bool>(
+            (rhs.ext_block((m_len - 1) / block_size, rhs.is_negative()) >>
+             ((m_len - 1) % block_size)) &
+            1);
+        add_fitted(rhs, false, false);
+        if (x_neg == y_neg && is_negative() != x_neg) {
+            saturate(x_neg);
+        }
+    } else if (add_fitted(rhs, false, false)) {
+        saturate(false);
+    }
+    return *this;
+}
+
+bits &bits::sub_sat(const bits &rhs)
+{
+    if (m_len == 0) {
+        return *this;
+    }
+
+    if (m_signed && rhs.m_signed) {
+        /* Overflow when the signs differ and the result sign follows rhs */
+        bool x_neg = is_negative();
+        bool y_neg = static_cast<bool>(
+            (rhs.ext_block((m_len - 1) / block_size, rhs.is_negative()) >>
+             ((m_len - 1) % block_size)) &
+            1);
+        add_fitted(rhs, true, true);
+        if (x_neg != y_neg && is_negative() != x_neg) {
+            saturate(x_neg);
+        }
+    } else if (!add_fitted(rhs, true, true)) {
+        /* No carry out of x + ~y + 1 means a borrow */
+        saturate(true);
+    }
+    return *this;
+}
+
+/* Apply op with the blocks of an integer operand */
+template <class Op>
+bits &bits::int_bitwise(utils::int_operand rhs, Op op)
+{
+    constexpr std::size_t int_blocks = utils::int_operand::num_blocks;
+    std::size_t arr_size = get_arr_size();
+
+    /* Blocks past the integer are untouched when op with its fill is */
+    Block fill = rhs.block(int_blocks);
+    if (op(Block{0}, fill) == 0 && op(~Block{0}, fill) == ~Block{0}) {
+        arr_size = std::min(arr_size, int_blocks);
     }
+
+    for (std::size_t i = 0; i < arr_size; i++) {
+        m_bitarr[i] = op(m_bitarr[i], rhs.block(i));
+    }
+
+    trim_last_block();
     return *this;
 }
 
+/* Add an integer operand, or subtract it as x + ~y + 1 */
+bits &bits::int_add(utils::int_operand rhs, bool sub)
+{
+    std::size_t arr_size = get_arr_size();
+    Block car_val = sub ? 1 : 0;
+
+    for (std::size_t i = 0; i < arr_size; i++) {
+        Block y = sub ? ~rhs.block(i) : rhs.block(i);
+
+        /*
+         * Past the integer, y is all zeros or all ones. Adding zeros with no
+         * carry, or ones with a carry, leaves the block and the carry as
+         * they are, and so every block after it.
+         */
+        if (i >= utils::int_operand::num_blocks &&
+            (y == 0) == (car_val == 0)) {
+            break;
+        }
+
+        Block res = m_bitarr[i] + y;
+        Block next = res + car_val;
+        car_val = static_cast<Block>(res < y) | static_cast<Block>(next < res);
+        m_bitarr[i] = next;
+    }
+
+    trim_last_block();
+    return *this;
+}
+
+bits &bits::operator&=(utils::int_operand rhs)
+{
+    return int_bitwise(rhs, [](Block x, Block y) { return x & y; });
+}
+
+bits &bits::operator|=(utils::int_operand rhs)
+{
+    return int_bitwise(rhs, [](Block x, Block y) { return x | y; });
+}
+
+bits &bits::operator^=(utils::int_operand rhs)
+{
+    return int_bitwise(rhs, [](Block x, Block y) { return x ^ y; });
+}
+
+bits &bits::operator+=(utils::int_operand rhs)
+{
+    return int_add(rhs, false);
+}
+
+bits &bits::operator-=(utils::int_operand rhs)
+{
+    return int_add(rhs, true);
+}
+
+bits bits::operator-() const
+{
+    /* Two's complement negation, ~b + 1 in a single pass */
+    bits b(*this);
+    Block car_val = 1;
+    for (std::size_t i = 0; i < b.get_arr_size(); i++) {
+        b.m_bitarr[i] = ~b.m_bitarr[i] + car_val;
+        car_val &= static_cast<Block>(b.m_bitarr[i] == 0);
+    }
+    b.trim_last_block();
+    return b;
+}
+
 bits bits::operator~() const
 {
     bits b(*this);
@@ -837,16 +2499,622 @@ bits bits::operator~() const
     return b;
 }
 
+/*
+ * Compare the values extended to a common width (sign-extended if signed,
+ * zero-extended otherwise), scanning from the most significant block down.
+ * Return a negative value, zero or a positive value when lhs is less than,
+ * equal to or greater than rhs.
+ */
+int compare(const bits &lhs, const bits &rhs)
+{
+    bool l_neg = lhs.is_negative(), r_neg = rhs.is_negative();
+    if (l_neg != r_neg) {
+        return l_neg ? -1 : 1;
+    }
+
+    /* Same sign: the extended blocks compare as unsigned */
+    for (std::size_t i = std::max(lhs.num_blocks(), rhs.num_blocks());
+         i-- > 0;) {
+        bits::Block l = lhs.ext_block(i, l_neg);
+        bits::Block r = rhs.ext_block(i, r_neg);
+        if (l != r) {
+            return l < r ? -1 : 1;
+        }
+    }
+    return 0;
+}
+
+/*
+ * Total order for ordered containers: by value, then by width, then
+ * unsigned before signed, so that values equal under compare() stay
+ * distinct keys exactly when they differ under operator==.
+ */
+bool operator<(const bits &lhs, const bits &rhs)
+{
+    int c = compare(lhs, rhs);
+    if (c != 0) {
+        return c < 0;
+    }
+    if (lhs.width() != rhs.width()) {
+        return lhs.width() < rhs.width();
+    }
+    return !lhs.is_signed() && rhs.is_signed();
+}
+
+bool operator>(const bits &lhs, const bits &rhs)
+{
+    return rhs < lhs;
+}
+
+bool operator<=(const bits &lhs, const bits &rhs)
+{
+    return !(rhs < lhs);
+}
+
+bool operator>=(const bits &lhs, const bits &rhs)
+{
+    return !(lhs < rhs);
+}
+
+/*
+ * Compare the value of bits (signed if it is signed) with a native integer.
+ * Unlike between two bits, the width plays no part.
+ */
+int compare(const bits &lhs, utils::int_operand rhs)
+{
+    bool l_neg = lhs.is_negative(), r_neg = rhs.is_negative();
+    if (l_neg != r_neg) {
+        return l_neg ? -1 : 1;
+    }
+
+    for (std::size_t i = std::max(lhs.num_blocks(),
+                                  utils::int_operand::num_blocks);
+         i-- > 0;) {
+        bits::Block l = lhs.ext_block(i, l_neg);
+        bits::Block r = rhs.block(i);
+        if (l != r) {
+            return l < r ? -1 : 1;
+        }
+    }
+    return 0;
+}
+
+bool operator==(const bits &lhs, utils::int_operand rhs)
+{
+    return compare(lhs, rhs) == 0;
+}
+bool operator==(utils::int_operand lhs, const bits &rhs)
+{
+    return compare(rhs, lhs) == 0;
+}
+bool operator!=(const bits &lhs, utils::int_operand rhs)
+{
+    return compare(lhs, rhs) != 0;
+}
+bool operator!=(utils::int_operand lhs, const bits &rhs)
+{
+    return compare(rhs, lhs) != 0;
+}
+bool operator<(const bits &lhs, utils::int_operand rhs)
+{
+    return compare(lhs, rhs) < 0;
+}
+bool operator<(utils::int_operand lhs, const bits &rhs)
+{
+    return compare(rhs, lhs) > 0;
+}
+bool operator>(const bits &lhs, utils::int_operand rhs)
+{
+    return compare(lhs, rhs) > 0;
+}
+bool operator>(utils::int_operand lhs, const bits &rhs)
+{
+    return compare(rhs, lhs) < 0;
+}
+bool operator<=(const bits &lhs, utils::int_operand rhs)
+{
+    return compare(lhs, rhs) <= 0;
+}
+bool operator<=(utils::int_operand lhs, const bits &rhs)
+{
+    return compare(rhs, lhs) >= 0;
+}
+bool operator>=(const bits &lhs, utils::int_operand rhs)
+{
+    return compare(lhs, rhs) >= 0;
+}
+bool operator>=(utils::int_operand lhs, const bits &rhs)
+{
+    return compare(rhs, lhs) <= 0;
+}
+
+/*
+ * Selection without branches on the data, in one pass over the operands.
+ * The result is as wide as the widest operand and, as with the bitwise
+ * operators, the operands are sign-extended only when all of them are
+ * signed. Each block is computed as b ^ ((a ^ b) & m), which compilers
+ * turn into a single ternary-logic or blend instruction where available.
+ */
+bits mux(bool cond, const bits &a, const bits &b)
+{
+    bool is_signed = a.is_signed() && b.is_signed();
+    bool a_neg = is_signed && a.is_negative();
+    bool b_neg = is_signed && b.is_negative();
+    bits::Block m = cond ? ~bits::Block{0} : 0;
+
+    bits res{std::max(a.width(), b.width()), 0};
+    for (std::size_t i = 0; i < res.num_blocks(); i++) {
+        bits::Block x = a.ext_block(i, a_neg), y = b.ext_block(i, b_neg);
+        res.m_bitarr[i] = y ^ ((x ^ y) & m);
+    }
+    res.trim_last_block();
+    return is_signed ? std::move(res).as_signed() : res;
+}
+
+/* The bit of a where mask is set, the bit of b elsewhere */
+bits blend(const bits &mask, const bits &a, const bits &b)
+{
+    bool is_signed = a.is_signed() && b.is_signed();
+    bool a_neg = is_signed && a.is_negative();
+    bool b_neg = is_signed && b.is_negative();
+
+    bits res{std::max({mask.width(), a.width(), b.width()}), 0};
+    for (std::size_t i = 0; i < res.num_blocks(); i++) {
+        bits::Block m = mask.ext_block(i, false);
+        bits::Block x = a.ext_block(i, a_neg), y = b.ext_block(i, b_neg);
+        res.m_bitarr[i] = y ^ ((x ^ y) & m);
+    }
+    res.trim_last_block();
+    return is_signed ? std::move(res).as_signed() : res;
+}
+
+namespace utils
+{
+
+void check_mux_inputs(const bits &sel, const std::vector<bits> &in)
+{
+    if (in.empty() || sel.width() != in.size()) {
+        throw std::invalid_argument(
+            "The width of the select must be the number of inputs");
+    }
+}
+
+/* Width and signedness of a result holding any of in */
+std::pair<std::size_t, bool> mux_result_type(const std::vector<bits> &in)
+{
+    std::size_t len = 0;
+    bool is_signed = true;
+    for (const auto &b : in) {
+        len = std::max(len, b.width());
+        is_signed = is_signed && b.is_signed();
+    }
+    return {len, is_signed};
+}
+
+}  // namespace utils
+
+/*
+ * chisel's Mux1H: the OR of the inputs whose bit is set in sel, which is
+ * the selected input when sel is one-hot. Only the selected inputs are
+ * read.
+ */
+bits mux1h(const bits &sel, const std::vector<bits> &in)
+{
+    utils::check_mux_inputs(sel, in);
+    auto type = utils::mux_result_type(in);
+
+    bits res{type.first, 0};
+    for (std::size_t pos = 0; pos < sel.width(); pos += 64) {
+        for (uint64_t w = sel.get_nbits(pos, 64); w != 0; w &= w - 1) {
+            const bits &b = in[pos + __builtin_ctzll(w)];
+            bool neg = type.second && b.is_negative();
+            for (std::size_t i = 0; i < res.num_blocks(); i++) {
+                res.m_bitarr[i] |= b.ext_block(i, neg);
+            }
+        }
+    }
+    res.trim_last_block();
+    return type.second ? std::move(res).as_signed() : res;
+}
+
+/*
+ * chisel's PriorityMux: the input of the lowest set bit of sel, or the
+ * last input when none is set.
+ */
+bits priority_mux(const bits &sel, const std::vector<bits> &in)
+{
+    utils::check_mux_inputs(sel, in);
+    auto type = utils::mux_result_type(in);
+
+    std::size_t k = in.size() - 1;
+    for (std::size_t pos = 0; pos < sel.width(); pos += 64) {
+        uint64_t w = sel.get_nbits(pos, 64);
+        if (w != 0) {
+            k = pos + __builtin_ctzll(w);
+            break;
+        }
+    }
+
+    const bits &b = in[k];
+    bool neg = type.second && b.is_negative();
+    bits res{type.first, 0};
+    for (std::size_t i = 0; i < res.num_blocks(); i++) {
+        res.m_bitarr[i] = b.ext_block(i, neg);
+    }
+    res.trim_last_block();
+    return type.second ? std::move(res).as_signed() : res;
+}
+
 bits fill(uint64_t times, bits b)
 {
     return b.repeat(times);
 }
 
 
-bits cat(const bits &lhs, bits rhs)
+bits cat(const bits &lhs, const bits &rhs)
 {
-    rhs.append(lhs);
-    return rhs;
+    const bits *parts[] = {&lhs, &rhs};
+    return bits::concat(std::begin(parts), std::end(parts));
+}
+
+/* Any number of pieces, the first on top, in a single allocation */
+template <class... Rest>
+bits cat(const bits &a, const bits &b, const bits &c, const Rest &...rest)
+{
+    static_assert((std::is_same<Rest, bits>::value && ...),
+                  "Only bits can be concatenated");
+    const bits *parts[] = {&a, &b, &c, &rest...};
+    return bits::concat(std::begin(parts), std::end(parts));
+}
+
+
+/*
+ * Batch serialization: the number of values as a little-endian 64-bit
+ * header followed by each value
+ */
+std::size_t serialized_size(const std::vector<bits> &v)
+{
+    std::size_t total = sizeof(uint64_t);
+    for (const auto &b : v) {
+        total += b.serialized_size();
+    }
+    return total;
+}
+
+std::size_t serialize_into(const std::vector<bits> &v,
+                           uint8_t *buf,
+                           std::size_t size)
+{
+    std::size_t total = serialized_size(v);
+    if (size < total) {
+        throw std::out_of_range("Buffer is too small");
+    }
+
+    utils::store_le64(buf, v.size());
+    std::size_t off = sizeof(uint64_t);
+    for (const auto &b : v) {
+        off += b.serialize_into(buf + off, size - off);
+    }
+    return off;
+}
+
+std::size_t deserialize_from(std::vector<bits> &v,
+                             const uint8_t *buf,
+                             std::size_t size)
+{
+    if (size < sizeof(uint64_t)) {
+        throw std::out_of_range("Buffer is too small");
+    }
+
+    uint64_t n = utils::load_le64(buf);
+    std::size_t off = sizeof(uint64_t);
+
+    /* Every value takes at least its header */
+    if (n > (size - off) / sizeof(uint64_t)) {
+        throw std::out_of_range("Buffer is too small");
+    }
+
+    std::vector<bits> res(static_cast<std::size_t>(n));
+    for (auto &b : res) {
+        off += b.deserialize_from(buf + off, size - off);
+    }
+    v = std::move(res);
+    return off;
+}
+
+void write(std::ostream &os, const std::vector<bits> &v)
+{
+    std::vector<uint8_t> buf(serialized_size(v));
+    serialize_into(v, buf.data(), buf.size());
+    os.write(reinterpret_cast<const char *>(buf.data()), buf.size());
+}
+
+void read(std::istream &is, std::vector<bits> &v)
+{
+    uint8_t header[sizeof(uint64_t)];
+    if (!is.read(reinterpret_cast<char *>(header), sizeof(header))) {
+        throw std::runtime_error("Failed to read bits from stream");
+    }
+
+    std::vector<bits> res;
+    uint64_t n = utils::load_le64(header);
+    for (uint64_t i = 0; i < n; i++) {
+        res.emplace_back();
+        res.back().read(is);
+    }
+    v = std::move(res);
+}
+
+
+
+/*
+ * A non-owning, read-only view of a range of bits stored elsewhere, e.g.
+ * in a bits or a memory-mapped file. Slicing a view yields another view.
+ */
+class bits_view
+{
+private:
+    using Block = bits::block_type;
+    static constexpr std::size_t block_size = bits::block_digits;
+
+    const Block *m_data;
+    std::size_t m_offset;
+    std::size_t m_len;
+
+    bool check_range(std::size_t s, std::size_t e) const
+    {
+        return s < m_len && s >= e;
+    }
+
+    /*
+     * Call f(word, nbits) on consecutive words from the lowest bit until it
+     * returns false. Views starting on a block boundary are read a block at
+     * a time in place, others 64 bits at a time.
+     */
+    template <class F>
+    bool for_each_word(F f) const;
+
+public:
+    bits_view() : bits_view{nullptr, 0} {}
+    bits_view(const Block *data, std::size_t len, std::size_t offset = 0)
+        : m_data{data}, m_offset{offset}, m_len{len}
+    {
+    }
+    bits_view(const bits &b) : bits_view{b.data(), b.width()} {}
+
+    constexpr std::size_t width() const { return m_len; }
+    bool empty() const { return m_len == 0; }
+
+    const Block *data() const { return m_data; }
+    std::size_t offset() const { return m_offset; }
+
+    uint64_t get_nbits(std::size_t pos, std::size_t digits = block_size) const;
+    std::size_t count() const;
+
+    /* Reductions over every bit, stopping at the first deciding word */
+    bool all() const;
+    bool any() const;
+    bool none() const { return !any(); }
+    bool parity() const;
+
+    bool test(std::size_t pos) const;
+    bool operator[](std::size_t pos) const;
+
+    bits_view operator()(std::size_t, std::size_t) const;
+
+    bits to_bits() const;
+    std::string to_string(num_base base = num_base::hex) const;
+};
+
+uint64_t bits_view::get_nbits(std::size_t pos, std::size_t digits) const
+{
+    if (pos >= m_len) {
+        return 0;
+    }
+    return utils::get_nbits<Block>(m_data, block_size, m_offset + m_len,
+                                   m_offset + pos, digits);
+}
+
+std::size_t bits_view::count() const
+{
+    std::size_t res = 0;
+    for (std::size_t i = 0; i < m_len; i += 64) {
+        res += __builtin_popcountll(get_nbits(i, 64));
+    }
+    return res;
+}
+
+template <class F>
+bool bits_view::for_each_word(F f) const
+{
+    if (m_offset % block_size == 0) {
+        const Block *p = m_data + m_offset / block_size;
+        std::size_t n = m_len / block_size;
+        for (std::size_t i = 0; i < n; i++) {
+            if (!f(static_cast<uint64_t>(p[i]), block_size)) {
+                return false;
+            }
+        }
+        std::size_t rem = m_len % block_size;
+        return rem == 0 || f(get_nbits(n * block_size, rem), rem);
+    }
+
+    for (std::size_t i = 0; i < m_len; i += 64) {
+        std::size_t n = std::min<std::size_t>(64, m_len - i);
+        if (!f(get_nbits(i, n), n)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool bits_view::all() const
+{
+    return for_each_word([](uint64_t w, std::size_t n) {
+        return w == (n == 64 ? ~0ULL : (1ULL << n) - 1);
+    });
+}
+
+bool bits_view::any() const
+{
+    return !for_each_word([](uint64_t w, std::size_t) { return w == 0; });
+}
+
+bool bits_view::parity() const
+{
+    /* XOR-fold the words, the fold has the parity of the whole */
+    uint64_t acc = 0;
+    for_each_word([&acc](uint64_t w, std::size_t) {
+        acc ^= w;
+        return true;
+    });
+    return __builtin_parityll(acc);
+}
+
+bool bits_view::test(std::size_t pos) const
+{
+    if (pos >= m_len) {
+        throw std::out_of_range("Position is out of range");
+    }
+    return this->operator[](pos);
+}
+
+bool bits_view::operator[](std::size_t pos) const
+{
+    /* No need to check perform bound checking */
+    std::size_t p = m_offset + pos;
+    return static_cast<bool>((m_data[p / block_size] >> (p % block_size)) & 1);
+}
+
+bits_view bits_view::operator()(std::size_t s, std::size_t e) const
+{
+    if (!check_range(s, e)) {
+        throw std::out_of_range("range error");
+    }
+    return bits_view{m_data, s - e + 1, m_offset + e};
+}
+
+bits bits_view::to_bits() const
+{
+    bits b{m_len, 0};
+    for (std::size_t i = 0; i < b.num_blocks(); i++) {
+        b.data()[i] = static_cast<Block>(get_nbits(i * block_size));
+    }
+    return b;
+}
+
+std::string bits_view::to_string(num_base base) const
+{
+    return to_bits().to_string(base);
+}
+
+/* Free function so that bits and bits_view compare in either order */
+bool operator==(const bits_view &lhs, const bits_view &rhs)
+{
+    if (lhs.width() != rhs.width()) {
+        return false;
+    }
+
+    for (std::size_t i = 0; i < lhs.width(); i += 64) {
+        if (lhs.get_nbits(i, 64) != rhs.get_nbits(i, 64)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+std::ostream &operator<<(std::ostream &os, const bits_view &b)
+{
+    os << b.to_string();
+    return os;
+}
+
+bool bits::all() const
+{
+    return bits_view{*this}.all();
+}
+
+bool bits::any() const
+{
+    return bits_view{*this}.any();
+}
+
+bool bits::parity() const
+{
+    return bits_view{*this}.parity();
+}
+
+/*
+ * Chisel's andR, orR and xorR. No bits reduce to the identity of the
+ * operation, so and_reduce of an empty operand is true.
+ */
+bool and_reduce(const bits_view &v)
+{
+    return v.all();
+}
+
+bool or_reduce(const bits_view &v)
+{
+    return v.any();
+}
+
+bool xor_reduce(const bits_view &v)
+{
+    return v.parity();
+}
+
+/*
+ * Number of differing bits, i.e. (a ^ b).count() with the narrower operand
+ * zero-extended, computed without a temporary. Views starting on a block
+ * boundary are read a word at a time with four independent popcounts in
+ * flight.
+ */
+std::size_t hamming_distance(const bits_view &a, const bits_view &b)
+{
+    constexpr std::size_t block_size = bits::block_digits;
+    using Block = bits::block_type;
+
+    const bits_view &lng = a.width() >= b.width() ? a : b;
+    const bits_view &sht = a.width() >= b.width() ? b : a;
+    std::size_t res = 0;
+
+    if (lng.offset() % block_size != 0 || sht.offset() % block_size != 0) {
+        for (std::size_t i = 0; i < lng.width(); i += 64) {
+            res += __builtin_popcountll(lng.get_nbits(i, 64) ^
+                                        sht.get_nbits(i, 64));
+        }
+        return res;
+    }
+
+    const Block *x = lng.data() + lng.offset() / block_size;
+    const Block *y = sht.data() + sht.offset() / block_size;
+    auto load = [](const Block *p) {
+        uint64_t w;
+        std::memcpy(&w, p, sizeof(w));
+        return w;
+    };
+
+    /* Whole 64-bit words common to both */
+    std::size_t n = sht.width() / 64;
+    std::size_t acc[4] = {0, 0, 0, 0};
+    std::size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        for (std::size_t j = 0; j < 4; j++) {
+            acc[j] += __builtin_popcountll(load(x + 2 * (i + j)) ^
+                                           load(y + 2 * (i + j)));
+        }
+    }
+    for (; i < n; i++) {
+        acc[0] += __builtin_popcountll(load(x + 2 * i) ^ load(y + 2 * i));
+    }
+    res = acc[0] + acc[1] + acc[2] + acc[3];
+
+    /* The rest, masked to the widths */
+    for (std::size_t pos = n * 64; pos < lng.width(); pos += 64) {
+        res += __builtin_popcountll(lng.get_nbits(pos, 64) ^
+                                    sht.get_nbits(pos, 64));
+    }
+    return res;
 }
 
 
@@ -880,8 +3148,11 @@ auto operator"" _u(unsigned long long val)
 
 auto operator"" _s(unsigned long long val)
 {
+    /* One more bit than the unsigned width for the sign */
     return [=](bitwidth w = bitwidth{}) {
-        return w.empty ? bits{val} : bits{w.width, val};
+        return (w.empty ? bits{val ? utils::guess_width(val) + 1 : 1, val}
+                        : bits{w.width, val})
+            .as_signed();
     };
 }
 
@@ -896,8 +3167,9 @@ auto operator"" _u(const char *str, std::size_t sz)
 auto operator"" _s(const char *str, std::size_t sz)
 {
     return [=](bitwidth w = bitwidth{}) {
-        return w.empty ? bits{std::string{str, sz}}
-                       : bits{w.width, std::string{str, sz}};
+        return (w.empty ? bits{std::string{str, sz}}
+                        : bits{w.width, std::string{str, sz}})
+            .as_signed();
     };
 }
 
@@ -908,4 +3180,15 @@ auto operator"" _s(const char *str, std::size_t sz)
 }  // namespace bitsel
 
 
+namespace std
+{
+
+template <>
+struct hash<bitsel::bits> {
+    std::size_t operator()(const bitsel::bits &b) const { return b.hash(); }
+};
+
+}  // namespace std
+
+
 #endif  // INCLUDE_BITS_HPP_
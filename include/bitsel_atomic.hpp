@@ -0,0 +1,255 @@
+#ifndef INCLUDE_BITSEL_ATOMIC_HPP_
+#define INCLUDE_BITSEL_ATOMIC_HPP_
+
+#include <atomic>
+#include <cstddef>  // for size_t
+#include <limits>
+#include <memory>
+#include <stdexcept>
+
+#include "bitsel.hpp"
+
+
+namespace bitsel
+{
+
+/*
+ * A fixed-width sequence of bits that can be shared between threads.
+ *
+ * Every operation is lock-free and atomic with respect to the 64-bit word
+ * holding the bit. Operations on a range of bits are atomic per word, not
+ * across the whole range.
+ */
+class atomic_bits
+{
+private:
+    using Word = uint64_t;
+    static constexpr std::size_t word_size = std::numeric_limits<Word>::digits;
+    static constexpr std::size_t blocks_per_word =
+        word_size / bits::block_digits;
+
+    static_assert(word_size % bits::block_digits == 0,
+                  "word must be a multiple of the block of bits");
+
+    std::unique_ptr<std::atomic<Word>[]> m_words;
+    std::size_t m_len;
+
+    std::size_t get_arr_size() const
+    {
+        return m_len / word_size +
+               static_cast<std::size_t>(m_len % word_size != 0);
+    }
+    void check_pos(std::size_t pos) const
+    {
+        if (pos >= m_len) {
+            throw std::out_of_range("Position is out of range");
+        }
+    }
+    Word last_word_mask(std::size_t idx) const
+    {
+        std::size_t rem = m_len - idx * word_size;
+        return rem >= word_size ? ~Word{0} : (Word{1} << rem) - 1;
+    }
+
+public:
+    static constexpr std::size_t npos = std::numeric_limits<std::size_t>::max();
+
+    explicit atomic_bits(std::size_t len);
+    explicit atomic_bits(const bits &b);
+
+    atomic_bits(const atomic_bits &) = delete;
+    atomic_bits &operator=(const atomic_bits &) = delete;
+
+    ~atomic_bits() = default;
+
+    std::size_t width() const { return m_len; }
+
+    bool test(std::size_t pos,
+              std::memory_order order = std::memory_order_seq_cst) const;
+    void set(std::size_t pos,
+             bool val = true,
+             std::memory_order order = std::memory_order_seq_cst);
+    void reset(std::size_t pos,
+               std::memory_order order = std::memory_order_seq_cst);
+
+    /* Return the previous value of the bit */
+    bool test_and_set(std::size_t pos,
+                      std::memory_order order = std::memory_order_seq_cst);
+    bool test_and_reset(std::size_t pos,
+                        std::memory_order order = std::memory_order_seq_cst);
+
+    /* OR val into [pos + val.width() - 1, pos], return the previous bits */
+    bits fetch_or(const bits &val,
+                  std::size_t pos = 0,
+                  std::memory_order order = std::memory_order_seq_cst);
+
+    /*
+     * Claim the lowest zero bit at or above start by setting it, return its
+     * position or npos if every bit is set.
+     */
+    std::size_t find_first_zero_and_set(
+        std::size_t start = 0,
+        std::memory_order order = std::memory_order_seq_cst);
+
+    std::size_t count(
+        std::memory_order order = std::memory_order_seq_cst) const;
+
+    bits load(std::memory_order order = std::memory_order_seq_cst) const;
+    void store(const bits &b,
+               std::memory_order order = std::memory_order_seq_cst);
+};
+
+
+atomic_bits::atomic_bits(std::size_t len) : m_words{nullptr}, m_len{len}
+{
+    std::size_t arr_size = get_arr_size();
+    m_words = std::make_unique<std::atomic<Word>[]>(arr_size);
+    for (std::size_t i = 0; i < arr_size; i++) {
+        m_words[i].store(0, std::memory_order_relaxed);
+    }
+}
+
+atomic_bits::atomic_bits(const bits &b) : atomic_bits{b.width()}
+{
+    store(b, std::memory_order_relaxed);
+}
+
+bool atomic_bits::test(std::size_t pos, std::memory_order order) const
+{
+    check_pos(pos);
+    Word w = m_words[pos / word_size].load(order);
+    return static_cast<bool>((w >> (pos % word_size)) & 1);
+}
+
+void atomic_bits::set(std::size_t pos, bool val, std::memory_order order)
+{
+    if (val) {
+        test_and_set(pos, order);
+    } else {
+        test_and_reset(pos, order);
+    }
+}
+
+void atomic_bits::reset(std::size_t pos, std::memory_order order)
+{
+    test_and_reset(pos, order);
+}
+
+bool atomic_bits::test_and_set(std::size_t pos, std::memory_order order)
+{
+    check_pos(pos);
+    Word mask = Word{1} << (pos % word_size);
+    return static_cast<bool>(m_words[pos / word_size].fetch_or(mask, order) &
+                             mask);
+}
+
+bool atomic_bits::test_and_reset(std::size_t pos, std::memory_order order)
+{
+    check_pos(pos);
+    Word mask = Word{1} << (pos % word_size);
+    return static_cast<bool>(m_words[pos / word_size].fetch_and(~mask, order) &
+                             mask);
+}
+
+bits atomic_bits::fetch_or(const bits &val,
+                           std::size_t pos,
+                           std::memory_order order)
+{
+    if (pos > m_len || val.width() > m_len - pos) {
+        throw std::out_of_range("range error");
+    }
+
+    bits old{val.width(), 0};
+
+    for (std::size_t i = 0; i < val.width();) {
+        std::size_t idx = (pos + i) / word_size;
+        std::size_t offset = (pos + i) % word_size;
+        std::size_t nbits = std::min(word_size - offset, val.width() - i);
+
+        Word w = val.get_nbits(i, nbits) << offset;
+        Word prev = w ? m_words[idx].fetch_or(w, order)
+                      : m_words[idx].load(order);
+        old.set_nbits(prev >> offset, i, nbits);
+
+        i += nbits;
+    }
+    return old;
+}
+
+std::size_t atomic_bits::find_first_zero_and_set(std::size_t start,
+                                                 std::memory_order order)
+{
+    std::size_t arr_size = get_arr_size();
+
+    for (std::size_t idx = start / word_size; idx < arr_size; idx++) {
+        /* Bits below start and beyond the width count as taken */
+        Word taken = ~last_word_mask(idx);
+        if (idx == start / word_size) {
+            taken |= (Word{1} << (start % word_size)) - 1;
+        }
+
+        Word w = m_words[idx].load(std::memory_order_relaxed);
+        while (~(w | taken) != 0) {
+            /* Lowest zero bit of the word */
+            Word mask = ~(w | taken) & ((w | taken) + 1);
+            if (m_words[idx].compare_exchange_weak(
+                    w, w | mask, order, std::memory_order_relaxed)) {
+                return idx * word_size + __builtin_ctzll(mask);
+            }
+        }
+    }
+    return npos;
+}
+
+std::size_t atomic_bits::count(std::memory_order order) const
+{
+    std::size_t res = 0;
+    for (std::size_t i = 0; i < get_arr_size(); i++) {
+        res += __builtin_popcountll(m_words[i].load(order));
+    }
+    return res;
+}
+
+bits atomic_bits::load(std::memory_order order) const
+{
+    bits b{m_len, 0};
+    bits::block_type *blk = b.data();
+    std::size_t num_blocks = b.num_blocks();
+
+    for (std::size_t i = 0; i < get_arr_size(); i++) {
+        Word w = m_words[i].load(order);
+        for (std::size_t j = 0; j < blocks_per_word; j++) {
+            std::size_t n = i * blocks_per_word + j;
+            if (n < num_blocks) {
+                blk[n] = static_cast<bits::block_type>(w);
+            }
+            w >>= bits::block_digits;
+        }
+    }
+    return b;
+}
+
+void atomic_bits::store(const bits &b, std::memory_order order)
+{
+    if (b.width() != m_len) {
+        throw std::invalid_argument("The width of bits must be the same");
+    }
+
+    const bits::block_type *blk = b.data();
+    std::size_t num_blocks = b.num_blocks();
+
+    for (std::size_t i = 0; i < get_arr_size(); i++) {
+        Word w = 0;
+        for (std::size_t j = blocks_per_word; j-- > 0;) {
+            std::size_t n = i * blocks_per_word + j;
+            w <<= bits::block_digits;
+            w |= n < num_blocks ? blk[n] : 0;
+        }
+        m_words[i].store(w, order);
+    }
+}
+
+}  // namespace bitsel
+
+
+#endif  // INCLUDE_BITSEL_ATOMIC_HPP_
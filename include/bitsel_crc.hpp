@@ -0,0 +1,321 @@
+#ifndef INCLUDE_BITSEL_CRC_HPP_
+#define INCLUDE_BITSEL_CRC_HPP_
+
+#include <array>
+#include <cstddef>  // for size_t
+#include <stdexcept>
+#include <vector>
+
+#include "bitsel.hpp"
+
+
+namespace bitsel
+{
+
+namespace utils
+{
+
+/* Reverse the low width bits of val */
+uint64_t reflect(uint64_t val, std::size_t width)
+{
+    constexpr uint64_t m1 = 0x5555555555555555ULL;
+    constexpr uint64_t m2 = 0x3333333333333333ULL;
+    constexpr uint64_t m4 = 0x0F0F0F0F0F0F0F0FULL;
+
+    /* Reverse the bits in each byte, then the bytes */
+    val = (val & m1) << 1 | ((val >> 1) & m1);
+    val = (val & m2) << 2 | ((val >> 2) & m2);
+    val = (val & m4) << 4 | ((val >> 4) & m4);
+    return __builtin_bswap64(val) >> (64 - width);
+}
+
+}  // namespace utils
+
+
+/*
+ * CRC of up to 64 bits in the Rocksoft model: width, polynomial (without
+ * the x^width term), initial value, input/output reflection and final XOR.
+ *
+ * Messages are byte streams; bits and bits_view are read as their
+ * little-endian bytes, followed by the bits of an unaligned tail in the
+ * same order as within a byte (lowest first when reflected, else highest
+ * first). Bytes go through slicing-by-8 tables, 8 bytes per step.
+ *
+ * update() continues a finished CRC like zlib's crc32(), and combine()
+ * joins the CRCs of two adjacent messages without reading either.
+ */
+class crc_engine
+{
+private:
+    using table_type = std::array<uint64_t, 256>;
+
+    std::size_t m_width;
+    uint64_t m_poly;
+    uint64_t m_init;
+    uint64_t m_xorout;
+    bool m_refin;
+    bool m_refout;
+
+    /*
+     * Reflected CRCs keep the register in the low bits with the reflected
+     * polynomial; the others keep it in the top bits so that bytes can be
+     * XOR-ed in at bit 56 whatever the width.
+     */
+    uint64_t m_reg_poly;
+    std::vector<table_type> m_table;
+
+    uint64_t mask() const
+    {
+        return m_width == 64 ? ~0ULL : (1ULL << m_width) - 1;
+    }
+
+    /* Register from and to the value of the unreflected algorithm */
+    uint64_t to_reg(uint64_t val) const;
+    uint64_t from_reg(uint64_t reg) const;
+    uint64_t finish(uint64_t reg) const;
+    uint64_t unfinish(uint64_t crc) const;
+
+    uint64_t feed_bit(uint64_t reg, bool bit) const;
+    uint64_t feed_word(uint64_t reg, uint64_t word) const;
+    uint64_t feed_byte(uint64_t reg, uint8_t byte) const;
+    uint64_t feed_bytes(uint64_t reg,
+                        const uint8_t *data,
+                        std::size_t size) const;
+    uint64_t feed_bits(uint64_t reg, const bits_view &v) const;
+
+    /* Multiplication modulo the polynomial and x^n */
+    uint64_t mulmod(uint64_t a, uint64_t b) const;
+    uint64_t xpow(uint64_t n) const;
+
+public:
+    static constexpr std::size_t slices = 8;
+
+    crc_engine(std::size_t width,
+               uint64_t poly,
+               uint64_t init = 0,
+               uint64_t xorout = 0,
+               bool refin = false,
+               bool refout = false);
+
+    /* CRC-32 of zlib and Ethernet */
+    static crc_engine crc32()
+    {
+        return crc_engine{32, 0x04C11DB7, 0xFFFFFFFF, 0xFFFFFFFF, true, true};
+    }
+    /* CRC-32C (Castagnoli) of iSCSI and SSE4.2 */
+    static crc_engine crc32c()
+    {
+        return crc_engine{32, 0x1EDC6F41, 0xFFFFFFFF, 0xFFFFFFFF, true, true};
+    }
+    /* CRC-64 of xz */
+    static crc_engine crc64()
+    {
+        return crc_engine{64,   0x42F0E1EBA9EA3693, ~0ULL, ~0ULL,
+                          true, true};
+    }
+
+    std::size_t width() const { return m_width; }
+
+    /* CRC of the empty message */
+    uint64_t empty() const { return finish(to_reg(m_init)); }
+
+    uint64_t compute(const uint8_t *data, std::size_t size) const
+    {
+        return update(empty(), data, size);
+    }
+    uint64_t compute(const bits_view &v) const { return update(empty(), v); }
+
+    /* CRC of the message whose CRC is crc followed by more data */
+    uint64_t update(uint64_t crc, const uint8_t *data, std::size_t size) const;
+    uint64_t update(uint64_t crc, const bits_view &v) const;
+
+    /* CRC of a followed by b, where b is len bits long */
+    uint64_t combine(uint64_t crc_a, uint64_t crc_b, uint64_t len) const;
+};
+
+
+crc_engine::crc_engine(std::size_t width,
+                       uint64_t poly,
+                       uint64_t init,
+                       uint64_t xorout,
+                       bool refin,
+                       bool refout)
+    : m_width{width},
+      m_poly{poly},
+      m_init{init},
+      m_xorout{xorout},
+      m_refin{refin},
+      m_refout{refout},
+      m_reg_poly{0},
+      m_table(slices)
+{
+    if (width == 0 || width > 64) {
+        throw std::invalid_argument("The width of CRC must be 1 to 64");
+    }
+    m_poly &= mask();
+    m_init &= mask();
+    m_xorout &= mask();
+    m_reg_poly = m_refin ? utils::reflect(m_poly, m_width)
+                         : m_poly << (64 - m_width);
+
+    /* table[k][b]: register after byte b followed by k zero bytes */
+    for (std::size_t b = 0; b < 256; b++) {
+        uint64_t reg = m_refin ? b : static_cast<uint64_t>(b) << 56;
+        for (std::size_t i = 0; i < 8; i++) {
+            reg = feed_bit(reg, false);
+        }
+        m_table[0][b] = reg;
+    }
+    for (std::size_t k = 1; k < slices; k++) {
+        for (std::size_t b = 0; b < 256; b++) {
+            m_table[k][b] = feed_byte(m_table[k - 1][b], 0);
+        }
+    }
+}
+
+uint64_t crc_engine::to_reg(uint64_t val) const
+{
+    return m_refin ? utils::reflect(val, m_width) : val << (64 - m_width);
+}
+
+uint64_t crc_engine::from_reg(uint64_t reg) const
+{
+    return m_refin ? utils::reflect(reg, m_width) : reg >> (64 - m_width);
+}
+
+uint64_t crc_engine::finish(uint64_t reg) const
+{
+    uint64_t val = from_reg(reg);
+    return (m_refout ? utils::reflect(val, m_width) : val) ^ m_xorout;
+}
+
+uint64_t crc_engine::unfinish(uint64_t crc) const
+{
+    uint64_t val = (crc ^ m_xorout) & mask();
+    return m_refout ? utils::reflect(val, m_width) : val;
+}
+
+uint64_t crc_engine::feed_bit(uint64_t reg, bool bit) const
+{
+    if (m_refin) {
+        reg ^= static_cast<uint64_t>(bit);
+        return reg >> 1 ^ (reg & 1 ? m_reg_poly : 0);
+    }
+    reg ^= static_cast<uint64_t>(bit) << 63;
+    return reg << 1 ^ (reg >> 63 ? m_reg_poly : 0);
+}
+
+uint64_t crc_engine::feed_byte(uint64_t reg, uint8_t byte) const
+{
+    return m_refin ? reg >> 8 ^ m_table[0][(reg ^ byte) & 0xFF]
+                   : reg << 8 ^ m_table[0][(reg >> 56) ^ byte];
+}
+
+/* Eight bytes at once, with byte 0 in the low bits of word */
+uint64_t crc_engine::feed_word(uint64_t reg, uint64_t word) const
+{
+    /* The top byte of an unreflected register meets byte 0 */
+    uint64_t x = (m_refin ? reg : __builtin_bswap64(reg)) ^ word;
+    return m_table[7][x & 0xFF] ^ m_table[6][(x >> 8) & 0xFF] ^
+           m_table[5][(x >> 16) & 0xFF] ^ m_table[4][(x >> 24) & 0xFF] ^
+           m_table[3][(x >> 32) & 0xFF] ^ m_table[2][(x >> 40) & 0xFF] ^
+           m_table[1][(x >> 48) & 0xFF] ^ m_table[0][x >> 56];
+}
+
+uint64_t crc_engine::feed_bytes(uint64_t reg,
+                                const uint8_t *data,
+                                std::size_t size) const
+{
+    for (; size >= 8; size -= 8, data += 8) {
+        reg = feed_word(reg, utils::load_le64(data));
+    }
+    for (; size > 0; size--, data++) {
+        reg = feed_byte(reg, *data);
+    }
+    return reg;
+}
+
+uint64_t crc_engine::feed_bits(uint64_t reg, const bits_view &v) const
+{
+    std::size_t len = v.width();
+    std::size_t nbytes = len / 8;
+
+    /* Byte-aligned views are read in place */
+    if (utils::is_little_endian && v.offset() % 8 == 0) {
+        const uint8_t *p =
+            reinterpret_cast<const uint8_t *>(v.data()) + v.offset() / 8;
+        reg = feed_bytes(reg, p, nbytes);
+    } else {
+        std::size_t pos = 0;
+        for (; pos + 64 <= nbytes * 8; pos += 64) {
+            reg = feed_word(reg, v.get_nbits(pos, 64));
+        }
+        for (; pos < nbytes * 8; pos += 8) {
+            reg = feed_byte(reg, static_cast<uint8_t>(v.get_nbits(pos, 8)));
+        }
+    }
+
+    /* Unaligned tail, in the bit order of a byte */
+    for (std::size_t i = nbytes * 8; i < len; i++) {
+        std::size_t pos = m_refin ? i : len - 1 - (i - nbytes * 8);
+        reg = feed_bit(reg, v.test(pos));
+    }
+    return reg;
+}
+
+uint64_t crc_engine::update(uint64_t crc,
+                            const uint8_t *data,
+                            std::size_t size) const
+{
+    return finish(feed_bytes(to_reg(unfinish(crc)), data, size));
+}
+
+uint64_t crc_engine::update(uint64_t crc, const bits_view &v) const
+{
+    return finish(feed_bits(to_reg(unfinish(crc)), v));
+}
+
+uint64_t crc_engine::mulmod(uint64_t a, uint64_t b) const
+{
+    uint64_t top = 1ULL << (m_width - 1);
+    uint64_t res = 0;
+    for (std::size_t i = m_width; i-- > 0;) {
+        res = ((res << 1) ^ (res & top ? m_poly : 0)) & mask();
+        if ((b >> i) & 1) {
+            res ^= a;
+        }
+    }
+    return res;
+}
+
+uint64_t crc_engine::xpow(uint64_t n) const
+{
+    /* Square and multiply, starting from x mod P */
+    uint64_t res = 1;
+    uint64_t base = m_width == 1 ? m_poly : 2;
+    for (; n > 0; n >>= 1) {
+        if (n & 1) {
+            res = mulmod(res, base);
+        }
+        base = mulmod(base, base);
+    }
+    return res;
+}
+
+uint64_t crc_engine::combine(uint64_t crc_a,
+                             uint64_t crc_b,
+                             uint64_t len) const
+{
+    /*
+     * Processing is linear: feeding b into register r gives
+     * r * x^len + (what b gives from init) - init * x^len.
+     */
+    uint64_t a = unfinish(crc_a), b = unfinish(crc_b);
+    uint64_t val = mulmod(a ^ m_init, xpow(len)) ^ b;
+    return finish(to_reg(val));
+}
+
+}  // namespace bitsel
+
+
+#endif  // INCLUDE_BITSEL_CRC_HPP_
@@ -0,0 +1,395 @@
+#ifndef INCLUDE_BITSEL_EXPR_HPP_
+#define INCLUDE_BITSEL_EXPR_HPP_
+
+#include <cstddef>  // for size_t
+#include <type_traits>
+#include <utility>
+
+#include "bitsel.hpp"
+
+
+namespace bitsel
+{
+namespace expr
+{
+
+/*
+ * Lazy bitwise expressions over bits.
+ *
+ * Operators on expressions build a tree of small nodes holding references
+ * to their bits operands instead of computing a result. eval() or assign()
+ * then computes the whole tree block by block in a single loop, so a chain
+ * like (a ^ b) & ~c | d costs one allocation (none when assigning to bits
+ * of the same width) and one pass over memory.
+ *
+ * Widths and signedness follow the eager operators: binary nodes are as
+ * wide as the wider operand and sign-extend only when both are signed,
+ * shifts keep the width and >> fills with the sign bit of signed values.
+ *
+ * Leaves refer to their bits, so an expression must be evaluated before
+ * any operand is modified or destroyed.
+ */
+
+using Block = bits::block_type;
+constexpr std::size_t block_size = bits::block_digits;
+
+/* Base of every node, E is the node type */
+template <class E>
+class bit_expr
+{
+public:
+    const E &self() const { return static_cast<const E &>(*this); }
+
+    std::size_t num_blocks() const
+    {
+        return self().width() / block_size +
+               static_cast<std::size_t>(self().width() % block_size != 0);
+    }
+
+    bool is_negative() const
+    {
+        std::size_t w = self().width();
+        return self().is_signed() && w > 0 &&
+               ((self().block((w - 1) / block_size) >> ((w - 1) % block_size)) &
+                1);
+    }
+
+    /*
+     * Block i with the bits above the width replaced by zeros, or by ones
+     * when neg is set. Nodes may leave garbage above their width in
+     * block(), which is cleaned up here.
+     */
+    Block ext_block(std::size_t i, bool neg) const
+    {
+        std::size_t n = num_blocks();
+        if (i + 1 < n) {
+            return self().block(i);
+        }
+        if (i >= n) {
+            return neg ? ~Block{0} : 0;
+        }
+
+        std::size_t rem = self().width() % block_size;
+        Block blk = self().block(i);
+        if (rem == 0) {
+            return blk;
+        }
+        Block mask = (Block{1} << rem) - 1;
+        return neg ? blk | ~mask : blk & mask;
+    }
+};
+
+/* Leaf referring to a bits */
+class bits_ref : public bit_expr<bits_ref>
+{
+private:
+    const bits *m_bits;
+
+public:
+    explicit bits_ref(const bits &b) : m_bits{&b} {}
+
+    std::size_t width() const { return m_bits->width(); }
+    bool is_signed() const { return m_bits->is_signed(); }
+    Block block(std::size_t i) const { return m_bits->data()[i]; }
+
+    /* Whether the storage p is read through a shift */
+    bool shifts(const Block *) const { return false; }
+    bool reads(const Block *p) const { return m_bits->data() == p; }
+};
+
+/* Bitwise operation between two nodes */
+template <class Op, class L, class R>
+class binary_expr : public bit_expr<binary_expr<Op, L, R>>
+{
+private:
+    L m_lhs;
+    R m_rhs;
+    bool m_lhs_neg;
+    bool m_rhs_neg;
+
+public:
+    binary_expr(const L &lhs, const R &rhs)
+        : m_lhs{lhs},
+          m_rhs{rhs},
+          m_lhs_neg{is_signed() && lhs.is_negative()},
+          m_rhs_neg{is_signed() && rhs.is_negative()}
+    {
+    }
+
+    std::size_t width() const
+    {
+        return std::max(m_lhs.width(), m_rhs.width());
+    }
+    bool is_signed() const { return m_lhs.is_signed() && m_rhs.is_signed(); }
+    Block block(std::size_t i) const
+    {
+        return Op{}(m_lhs.ext_block(i, m_lhs_neg),
+                    m_rhs.ext_block(i, m_rhs_neg));
+    }
+
+    bool shifts(const Block *p) const
+    {
+        return m_lhs.shifts(p) || m_rhs.shifts(p);
+    }
+    bool reads(const Block *p) const
+    {
+        return m_lhs.reads(p) || m_rhs.reads(p);
+    }
+};
+
+template <class E>
+class not_expr : public bit_expr<not_expr<E>>
+{
+private:
+    E m_expr;
+
+public:
+    explicit not_expr(const E &e) : m_expr{e} {}
+
+    std::size_t width() const { return m_expr.width(); }
+    bool is_signed() const { return m_expr.is_signed(); }
+    Block block(std::size_t i) const { return ~m_expr.block(i); }
+
+    bool shifts(const Block *p) const { return m_expr.shifts(p); }
+    bool reads(const Block *p) const { return m_expr.reads(p); }
+};
+
+/* Shift by a constant, keeping the width */
+template <class E, bool Left>
+class shift_expr : public bit_expr<shift_expr<E, Left>>
+{
+private:
+    E m_expr;
+    std::size_t m_blocks;
+    std::size_t m_bits;
+    bool m_neg;
+
+public:
+    shift_expr(const E &e, std::size_t n)
+        : m_expr{e},
+          m_blocks{n / block_size},
+          m_bits{n % block_size},
+          m_neg{!Left && e.is_negative()}
+    {
+    }
+
+    std::size_t width() const { return m_expr.width(); }
+    bool is_signed() const { return m_expr.is_signed(); }
+    Block block(std::size_t i) const
+    {
+        if (Left) {
+            Block hi =
+                i >= m_blocks ? m_expr.ext_block(i - m_blocks, false) : 0;
+            if (m_bits == 0) {
+                return hi;
+            }
+            Block lo = i >= m_blocks + 1
+                           ? m_expr.ext_block(i - m_blocks - 1, false)
+                           : 0;
+            return hi << m_bits | lo >> (block_size - m_bits);
+        }
+
+        /* Blocks past the width extend with the sign for >> */
+        Block lo = m_expr.ext_block(i + m_blocks, m_neg);
+        if (m_bits == 0) {
+            return lo;
+        }
+        Block hi = m_expr.ext_block(i + m_blocks + 1, m_neg);
+        return lo >> m_bits | hi << (block_size - m_bits);
+    }
+
+    bool shifts(const Block *p) const { return m_expr.reads(p); }
+    bool reads(const Block *p) const { return m_expr.reads(p); }
+};
+
+/* Per-bit select: the bit of a where cond is set, the bit of b elsewhere */
+template <class C, class A, class B>
+class select_expr : public bit_expr<select_expr<C, A, B>>
+{
+private:
+    C m_cond;
+    A m_a;
+    B m_b;
+    bool m_a_neg;
+    bool m_b_neg;
+
+public:
+    select_expr(const C &cond, const A &a, const B &b)
+        : m_cond{cond},
+          m_a{a},
+          m_b{b},
+          m_a_neg{is_signed() && a.is_negative()},
+          m_b_neg{is_signed() && b.is_negative()}
+    {
+    }
+
+    std::size_t width() const
+    {
+        return std::max({m_cond.width(), m_a.width(), m_b.width()});
+    }
+    bool is_signed() const { return m_a.is_signed() && m_b.is_signed(); }
+    Block block(std::size_t i) const
+    {
+        Block c = m_cond.ext_block(i, false);
+        return (c & m_a.ext_block(i, m_a_neg)) |
+               (~c & m_b.ext_block(i, m_b_neg));
+    }
+
+    bool shifts(const Block *p) const
+    {
+        return m_cond.shifts(p) || m_a.shifts(p) || m_b.shifts(p);
+    }
+    bool reads(const Block *p) const
+    {
+        return m_cond.reads(p) || m_a.reads(p) || m_b.reads(p);
+    }
+};
+
+
+namespace detail
+{
+
+template <class T>
+struct is_node : std::is_base_of<bit_expr<T>, T> {
+};
+
+/* bits and nodes can be operands, as long as one of them is a node */
+template <class T>
+struct is_operand
+    : std::integral_constant<bool, is_node<T>::value ||
+                                       std::is_same<T, bits>::value> {
+};
+
+template <class L, class R>
+using enable_binary =
+    std::enable_if_t<is_operand<L>::value && is_operand<R>::value &&
+                     (is_node<L>::value || is_node<R>::value)>;
+
+inline bits_ref to_node(const bits &b)
+{
+    return bits_ref{b};
+}
+
+template <class E>
+const E &to_node(const bit_expr<E> &e)
+{
+    return e.self();
+}
+
+template <class T>
+using node_t = std::decay_t<decltype(to_node(std::declval<const T &>()))>;
+
+struct and_op {
+    Block operator()(Block x, Block y) const { return x & y; }
+};
+struct or_op {
+    Block operator()(Block x, Block y) const { return x | y; }
+};
+struct xor_op {
+    Block operator()(Block x, Block y) const { return x ^ y; }
+};
+
+}  // namespace detail
+
+
+/* Start a lazy expression from bits */
+inline bits_ref lazy(const bits &b)
+{
+    return bits_ref{b};
+}
+
+template <class L, class R, class = detail::enable_binary<L, R>>
+binary_expr<detail::and_op, detail::node_t<L>, detail::node_t<R>> operator&(
+    const L &lhs,
+    const R &rhs)
+{
+    return {detail::to_node(lhs), detail::to_node(rhs)};
+}
+
+template <class L, class R, class = detail::enable_binary<L, R>>
+binary_expr<detail::or_op, detail::node_t<L>, detail::node_t<R>> operator|(
+    const L &lhs,
+    const R &rhs)
+{
+    return {detail::to_node(lhs), detail::to_node(rhs)};
+}
+
+template <class L, class R, class = detail::enable_binary<L, R>>
+binary_expr<detail::xor_op, detail::node_t<L>, detail::node_t<R>> operator^(
+    const L &lhs,
+    const R &rhs)
+{
+    return {detail::to_node(lhs), detail::to_node(rhs)};
+}
+
+template <class E>
+not_expr<E> operator~(const bit_expr<E> &e)
+{
+    return not_expr<E>{e.self()};
+}
+
+template <class E>
+shift_expr<E, true> operator<<(const bit_expr<E> &e, std::size_t n)
+{
+    return {e.self(), n};
+}
+
+template <class E>
+shift_expr<E, false> operator>>(const bit_expr<E> &e, std::size_t n)
+{
+    return {e.self(), n};
+}
+
+template <class C,
+          class A,
+          class B,
+          class = std::enable_if_t<detail::is_operand<C>::value &&
+                                   detail::is_operand<A>::value &&
+                                   detail::is_operand<B>::value>>
+select_expr<detail::node_t<C>, detail::node_t<A>, detail::node_t<B>> select(
+    const C &cond,
+    const A &a,
+    const B &b)
+{
+    return {detail::to_node(cond), detail::to_node(a), detail::to_node(b)};
+}
+
+/* Evaluate into dst, reusing its storage when the width matches */
+template <class E>
+bits &assign(bits &dst, const bit_expr<E> &e)
+{
+    const E &node = e.self();
+
+    /* A shifted dst would be overwritten before it is read */
+    if (dst.width() != node.width() || node.shifts(dst.data())) {
+        bits res{node.width(), 0};
+        assign(res, e);
+        dst = std::move(res);
+        return dst;
+    }
+
+    Block *out = dst.data();
+    for (std::size_t i = 0; i < e.num_blocks(); i++) {
+        out[i] = node.ext_block(i, false);
+    }
+
+    if (dst.is_signed() != node.is_signed()) {
+        dst = node.is_signed() ? std::move(dst).as_signed()
+                               : std::move(dst).as_unsigned();
+    }
+    return dst;
+}
+
+template <class E>
+bits eval(const bit_expr<E> &e)
+{
+    bits res{e.self().width(), 0};
+    assign(res, e);
+    return res;
+}
+
+}  // namespace expr
+}  // namespace bitsel
+
+
+#endif  // INCLUDE_BITSEL_EXPR_HPP_
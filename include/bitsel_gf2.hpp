@@ -0,0 +1,339 @@
+#ifndef INCLUDE_BITSEL_GF2_HPP_
+#define INCLUDE_BITSEL_GF2_HPP_
+
+#include <algorithm>
+#include <cstddef>  // for size_t
+#include <stdexcept>
+#include <vector>
+
+#if defined(__PCLMUL__) && defined(__x86_64__)
+#include <wmmintrin.h>
+#endif
+
+#include "bitsel.hpp"
+
+
+namespace bitsel
+{
+
+/*
+ * Polynomials over GF(2): bit i of a bits is the coefficient of x^i, so
+ * addition is XOR and multiplication is carry-less.
+ */
+
+namespace utils
+{
+
+/* Carry-less Karatsuba kicks in at this many words */
+constexpr std::size_t clmul_karatsuba_threshold = 16;
+
+/* Carry-less product of two words, the high word goes to hi */
+limb clmul64(limb a, limb b, limb &hi)
+{
+#if defined(__PCLMUL__) && defined(__x86_64__)
+    __m128i x = _mm_cvtsi64_si128(static_cast<long long>(a));
+    __m128i y = _mm_cvtsi64_si128(static_cast<long long>(b));
+    __m128i p = _mm_clmulepi64_si128(x, y, 0);
+    hi = static_cast<limb>(_mm_cvtsi128_si64(_mm_unpackhi_epi64(p, p)));
+    return static_cast<limb>(_mm_cvtsi128_si64(p));
+#else
+    /* Four bits of a at a time against b times every nibble */
+    __uint128_t tab[16];
+    tab[0] = 0;
+    tab[1] = b;
+    for (std::size_t k = 2; k < 16; k += 2) {
+        tab[k] = tab[k / 2] << 1;
+        tab[k + 1] = tab[k] ^ b;
+    }
+
+    __uint128_t r = 0;
+    for (std::size_t i = 64; i > 0; i -= 4) {
+        r = r << 4 ^ tab[(a >> (i - 4)) & 0xF];
+    }
+    hi = static_cast<limb>(r >> 64);
+    return static_cast<limb>(r);
+#endif
+}
+
+/* out[0, an + bn) ^= a * b */
+void clmul_schoolbook(const limb *a,
+                      std::size_t an,
+                      const limb *b,
+                      std::size_t bn,
+                      limb *out)
+{
+    for (std::size_t i = 0; i < an; i++) {
+        for (std::size_t j = 0; j < bn; j++) {
+            limb hi;
+            out[i + j] ^= clmul64(a[i], b[j], hi);
+            out[i + j + 1] ^= hi;
+        }
+    }
+}
+
+/*
+ * out[0, 2n) = a * b for operands of n words each. Without carries the
+ * middle product is simply (a0 + a1)(b0 + b1) + z0 + z2.
+ */
+void clmul_karatsuba(const limb *a, const limb *b, std::size_t n, limb *out)
+{
+    std::fill(out, out + 2 * n, 0);
+    if (n < clmul_karatsuba_threshold) {
+        clmul_schoolbook(a, n, b, n, out);
+        return;
+    }
+
+    std::size_t m = n / 2, h = n - m;
+    const limb *a0 = a, *a1 = a + m, *b0 = b, *b1 = b + m;
+
+    std::vector<limb> z0(2 * m), z2(2 * h), z1(2 * h);
+    clmul_karatsuba(a0, b0, m, z0.data());
+    clmul_karatsuba(a1, b1, h, z2.data());
+
+    std::vector<limb> sa(a1, a1 + h), sb(b1, b1 + h);
+    for (std::size_t i = 0; i < m; i++) {
+        sa[i] ^= a0[i];
+        sb[i] ^= b0[i];
+    }
+    clmul_karatsuba(sa.data(), sb.data(), h, z1.data());
+    for (std::size_t i = 0; i < 2 * h; i++) {
+        z1[i] ^= z2[i] ^ (i < 2 * m ? z0[i] : 0);
+    }
+
+    std::copy(z0.begin(), z0.end(), out);
+    std::copy(z2.begin(), z2.end(), out + 2 * m);
+    for (std::size_t i = 0; i < 2 * h; i++) {
+        out[m + i] ^= z1[i];
+    }
+}
+
+/* out[0, an + bn) = a * b, Karatsuba on slices of the longer operand */
+void clmul_limbs(const limb *a,
+                 std::size_t an,
+                 const limb *b,
+                 std::size_t bn,
+                 limb *out)
+{
+    std::fill(out, out + an + bn, 0);
+    if (an < bn) {
+        std::swap(a, b);
+        std::swap(an, bn);
+    }
+
+    if (bn < clmul_karatsuba_threshold) {
+        clmul_schoolbook(a, an, b, bn, out);
+        return;
+    }
+
+    std::vector<limb> prod(2 * bn);
+    std::vector<limb> slice(bn);
+    for (std::size_t off = 0; off < an; off += bn) {
+        std::size_t len = std::min(bn, an - off);
+        std::fill(std::copy_n(a + off, len, slice.data()), slice.data() + bn,
+                  0);
+        clmul_karatsuba(slice.data(), b, bn, prod.data());
+        for (std::size_t i = 0; i < prod.size() && off + i < an + bn; i++) {
+            out[off + i] ^= prod[i];
+        }
+    }
+}
+
+/* Words of a polynomial, bits above len are zero */
+std::vector<limb> poly_words(const bits_view &v)
+{
+    std::size_t len = v.width();
+    std::vector<limb> w(len / 64 + static_cast<std::size_t>(len % 64 != 0));
+    for (std::size_t i = 0; i < w.size(); i++) {
+        w[i] = v.get_nbits(64 * i, std::min<std::size_t>(64, len - 64 * i));
+    }
+    return w;
+}
+
+bits poly_bits(const std::vector<limb> &w, std::size_t len)
+{
+    bits b{len, 0};
+    for (std::size_t i = 0; i < w.size() && 64 * i < len; i++) {
+        b.set_nbits(w[i], 64 * i, std::min<std::size_t>(64, len - 64 * i));
+    }
+    return b;
+}
+
+/* len bits of w starting at pos */
+std::vector<limb> poly_extract(const std::vector<limb> &w,
+                               std::size_t pos,
+                               std::size_t len)
+{
+    std::vector<limb> res(len / 64 + static_cast<std::size_t>(len % 64 != 0));
+    std::size_t q = pos / 64, r = pos % 64;
+    for (std::size_t i = 0; i < res.size(); i++) {
+        limb lo = q + i < w.size() ? w[q + i] : 0;
+        limb hi = r && q + i + 1 < w.size() ? w[q + i + 1] : 0;
+        res[i] = r ? lo >> r | hi << (64 - r) : lo;
+    }
+    if (len % 64 != 0) {
+        res.back() &= (limb{1} << (len % 64)) - 1;
+    }
+    return res;
+}
+
+/* dst ^= src * x^shift, dropping what falls past dst */
+void poly_xor_shifted(std::vector<limb> &dst,
+                      const std::vector<limb> &src,
+                      std::size_t shift)
+{
+    std::size_t q = shift / 64, r = shift % 64;
+    for (std::size_t i = 0; i < src.size() && q + i < dst.size(); i++) {
+        dst[q + i] ^= src[i] << r;
+        if (r && q + i + 1 < dst.size()) {
+            dst[q + i + 1] ^= src[i] >> (64 - r);
+        }
+    }
+}
+
+std::vector<limb> poly_mul(const std::vector<limb> &a,
+                           const std::vector<limb> &b)
+{
+    std::vector<limb> res(a.size() + b.size());
+    clmul_limbs(a.data(), a.size(), b.data(), b.size(), res.data());
+    return res;
+}
+
+}  // namespace utils
+
+
+/* Carry-less product, of degree at most the sum of the degrees */
+bits clmul(const bits_view &a, const bits_view &b)
+{
+    if (a.width() == 0 || b.width() == 0) {
+        return bits{0, 0};
+    }
+    return utils::poly_bits(
+        utils::poly_mul(utils::poly_words(a), utils::poly_words(b)),
+        a.width() + b.width() - 1);
+}
+
+/*
+ * Reduction modulo a fixed polynomial P of degree m by Barrett's method:
+ * mu = x^(2m) / P is computed once, after which each m bits of input cost
+ * two carry-less products instead of m shift-and-XOR steps. Over GF(2) the
+ * quotient estimate is exact, so no correction step is needed.
+ */
+class gf2_modulus
+{
+private:
+    using limb = utils::limb;
+
+    std::vector<limb> m_poly;
+    std::vector<limb> m_mu;
+    std::size_t m_deg;
+
+    /* c mod P for c of degree below 2m */
+    std::vector<limb> barrett(const std::vector<limb> &c) const;
+
+public:
+    explicit gf2_modulus(const bits_view &poly);
+
+    std::size_t degree() const { return m_deg; }
+    bits poly() const { return utils::poly_bits(m_poly, m_deg + 1); }
+
+    /* Remainder of a, m bits wide */
+    bits reduce(const bits_view &a) const;
+    /* Product in GF(2)[x] / P, i.e. GF(2^m) when P is irreducible */
+    bits mul(const bits_view &a, const bits_view &b) const;
+};
+
+
+gf2_modulus::gf2_modulus(const bits_view &p) : m_deg{0}
+{
+    std::size_t len = p.width();
+    while (len > 0 && !p.test(len - 1)) {
+        len--;
+    }
+    if (len == 0) {
+        throw std::domain_error("Division by zero");
+    }
+    m_deg = len - 1;
+    m_poly = utils::poly_words(p(m_deg, 0));
+
+    /* Long division of x^(2m) by P */
+    std::size_t m = m_deg;
+    std::vector<limb> rem((2 * m) / 64 + 1, 0);
+    rem[(2 * m) / 64] = limb{1} << ((2 * m) % 64);
+    m_mu.assign(m / 64 + 1, 0);
+    for (std::size_t i = 2 * m + 1; i-- > m;) {
+        if ((rem[i / 64] >> (i % 64)) & 1) {
+            m_mu[(i - m) / 64] |= limb{1} << ((i - m) % 64);
+            utils::poly_xor_shifted(rem, m_poly, i - m);
+        }
+    }
+}
+
+std::vector<utils::limb> gf2_modulus::barrett(const std::vector<limb> &c) const
+{
+    std::size_t m = m_deg;
+
+    /* q = ((c / x^m) * mu) / x^m, then c - q * P fits in m bits */
+    auto t = utils::poly_mul(utils::poly_extract(c, m, m), m_mu);
+    auto q = utils::poly_extract(t, m, m + 1);
+    auto qp = utils::poly_mul(q, m_poly);
+
+    auto r = utils::poly_extract(c, 0, m);
+    for (std::size_t i = 0; i < r.size(); i++) {
+        r[i] ^= qp[i];
+    }
+    if (m % 64 != 0) {
+        r.back() &= (limb{1} << (m % 64)) - 1;
+    }
+    return r;
+}
+
+bits gf2_modulus::reduce(const bits_view &a) const
+{
+    std::size_t m = m_deg;
+    std::size_t len = a.width();
+    if (m == 0) {
+        return bits{0, 0};
+    }
+    if (len <= m) {
+        return a.to_bits().zext(m);
+    }
+
+    /* Horner's rule on m-bit chunks from the top: r = r * x^m + chunk */
+    auto w = utils::poly_words(a);
+    std::size_t num_chunks = (len + m - 1) / m;
+    auto r = utils::poly_extract(w, (num_chunks - 1) * m,
+                                 len - (num_chunks - 1) * m);
+    r.resize(m / 64 + static_cast<std::size_t>(m % 64 != 0), 0);
+
+    std::vector<limb> c((2 * m) / 64 + 1);
+    for (std::size_t j = num_chunks - 1; j-- > 0;) {
+        std::fill(c.begin(), c.end(), 0);
+        utils::poly_xor_shifted(c, utils::poly_extract(w, j * m, m), 0);
+        utils::poly_xor_shifted(c, r, m);
+        r = barrett(c);
+    }
+    return utils::poly_bits(r, m);
+}
+
+bits gf2_modulus::mul(const bits_view &a, const bits_view &b) const
+{
+    return reduce(clmul(a, b));
+}
+
+
+/* Remainder of a divided by poly, as wide as the degree of poly */
+bits gf2_mod(const bits_view &a, const bits_view &poly)
+{
+    return gf2_modulus{poly}.reduce(a);
+}
+
+/* a * b mod poly; reuse a gf2_modulus when poly stays the same */
+bits gf2_mul(const bits_view &a, const bits_view &b, const bits_view &poly)
+{
+    return gf2_modulus{poly}.mul(a, b);
+}
+
+}  // namespace bitsel
+
+
+#endif  // INCLUDE_BITSEL_GF2_HPP_
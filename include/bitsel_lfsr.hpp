@@ -0,0 +1,258 @@
+#ifndef INCLUDE_BITSEL_LFSR_HPP_
+#define INCLUDE_BITSEL_LFSR_HPP_
+
+#include <algorithm>
+#include <array>
+#include <cstddef>  // for size_t
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
+#include "bitsel.hpp"
+#include "bitsel_gf2.hpp"
+
+
+namespace bitsel
+{
+
+/*
+ * Linear feedback shift register of any width n, with characteristic
+ * polynomial P = x^n + taps, bit i of taps being the coefficient of x^i.
+ *
+ * Galois form: the state is a polynomial S of degree below n. Each step
+ * outputs bit n-1 of S, shifts S left by one and XORs in taps when the
+ * output was set, i.e. S becomes x * S mod P.
+ *
+ * Fibonacci form: the state holds the next n outputs, the next one in
+ * bit 0. Each step outputs bit 0, shifts right by one and feeds the
+ * parity of state & taps into bit n-1.
+ *
+ * Both forms run as a Galois register internally: 64 steps are one table
+ * lookup per byte of the outgoing word, and jump() multiplies by x^k mod P
+ * in O(log k) products. Copies share the tables, so a long sequence can be
+ * split across threads by jumping copies to different offsets.
+ */
+class lfsr
+{
+public:
+    enum class form { fibonacci, galois };
+
+private:
+    using Word = uint64_t;
+    static constexpr std::size_t word_size = 64;
+
+    /* For each byte of the word leaving in 64 steps, what it feeds back */
+    struct tables {
+        std::vector<Word> rem;
+        std::array<Word, 8 * 256> out;
+    };
+
+    std::size_t m_width;
+    std::size_t m_words;
+    form m_form;
+    std::vector<Word> m_taps;
+    std::vector<Word> m_state;
+    std::shared_ptr<const tables> m_tables;
+    std::shared_ptr<const gf2_modulus> m_mod;
+
+    bits poly() const;
+    /* One Galois step of s, return the output */
+    bool shift(std::vector<Word> &s) const;
+    void build_tables();
+
+public:
+    lfsr(const bits_view &taps, const bits_view &seed, form f = form::galois);
+
+    std::size_t width() const { return m_width; }
+    form type() const { return m_form; }
+
+    /* Set or get the state in the convention of the form */
+    void seed(const bits_view &s);
+    bits state() const;
+
+    bool next_bit() { return shift(m_state); }
+    /* The next 64 outputs, the first in bit 0 */
+    uint64_t next64();
+    /* The next len outputs, the first in bit 0 */
+    bits generate(std::size_t len);
+
+    /* Advance by n steps without producing output */
+    void jump(uint64_t n);
+};
+
+
+lfsr::lfsr(const bits_view &taps, const bits_view &seed, form f)
+    : m_width{taps.width()},
+      m_words{taps.width() / word_size +
+              static_cast<std::size_t>(taps.width() % word_size != 0)},
+      m_form{f},
+      m_taps(utils::poly_words(taps)),
+      m_state(m_words, 0)
+{
+    if (m_width == 0) {
+        throw std::invalid_argument("The width of an LFSR must be positive");
+    }
+    m_mod = std::make_shared<const gf2_modulus>(poly());
+    build_tables();
+    this->seed(seed);
+}
+
+/* P with the x^n term */
+bits lfsr::poly() const
+{
+    bits p = utils::poly_bits(m_taps, m_width).zext(m_width + 1);
+    p.set(m_width, true);
+    return p;
+}
+
+bool lfsr::shift(std::vector<Word> &s) const
+{
+    std::size_t top = m_width - 1;
+    bool out = (s[top / word_size] >> (top % word_size)) & 1;
+
+    for (std::size_t i = m_words; i-- > 1;) {
+        s[i] = s[i] << 1 | s[i - 1] >> (word_size - 1);
+    }
+    s[0] <<= 1;
+    if (m_width % word_size != 0) {
+        s.back() &= (Word{1} << (m_width % word_size)) - 1;
+    }
+
+    if (out) {
+        for (std::size_t i = 0; i < m_words; i++) {
+            s[i] ^= m_taps[i];
+        }
+    }
+    return out;
+}
+
+void lfsr::build_tables()
+{
+    /*
+     * The word leaving in 64 steps is the whole state when n <= 64, else
+     * its top 64 bits; the rest only shifts up by one word. Run 64 steps
+     * from each single bit of that word, then combine per byte.
+     */
+    std::size_t base = m_width > word_size ? m_width - word_size : 0;
+    std::vector<Word> rem(word_size * m_words, 0);
+    std::array<Word, word_size> out{};
+    for (std::size_t k = 0; k < word_size && base + k < m_width; k++) {
+        std::vector<Word> s(m_words, 0);
+        s[(base + k) / word_size] = Word{1} << ((base + k) % word_size);
+        for (std::size_t t = 0; t < word_size; t++) {
+            out[k] |= static_cast<Word>(shift(s)) << t;
+        }
+        std::copy(s.begin(), s.end(), rem.begin() + k * m_words);
+    }
+
+    auto t = std::make_shared<tables>();
+    t->rem.assign(8 * 256 * m_words, 0);
+    t->out.fill(0);
+    for (std::size_t j = 0; j < 8; j++) {
+        for (std::size_t b = 1; b < 256; b++) {
+            std::size_t k = 8 * j + __builtin_ctzll(b);
+            std::size_t prev = j * 256 + (b & (b - 1));
+            Word *dst = &t->rem[(j * 256 + b) * m_words];
+            for (std::size_t i = 0; i < m_words; i++) {
+                dst[i] = t->rem[prev * m_words + i] ^ rem[k * m_words + i];
+            }
+            t->out[j * 256 + b] = t->out[prev] ^ out[k];
+        }
+    }
+    m_tables = std::move(t);
+}
+
+void lfsr::seed(const bits_view &s)
+{
+    if (s.width() != m_width) {
+        throw std::invalid_argument("The width of bits must be the same");
+    }
+    if (m_form == form::galois) {
+        m_state = utils::poly_words(s);
+        return;
+    }
+
+    /*
+     * The first n outputs of a Galois state S are the quotient of S * x^n
+     * by P, highest first. Going back, S is the top n bits of Q * P.
+     */
+    bits q{m_width, 0};
+    for (std::size_t t = 0; t < m_width; t++) {
+        q.set(m_width - 1 - t, s.test(t));
+    }
+    bits qp = clmul(q, poly());
+    m_state = utils::poly_words(bits_view{qp}(2 * m_width - 1, m_width));
+}
+
+bits lfsr::state() const
+{
+    if (m_form == form::galois) {
+        return utils::poly_bits(m_state, m_width);
+    }
+    lfsr copy{*this};
+    return copy.generate(m_width);
+}
+
+uint64_t lfsr::next64()
+{
+    Word f;
+    if (m_width <= word_size) {
+        f = m_state[0];
+        m_state[0] = 0;
+    } else {
+        std::size_t base = m_width - word_size;
+        f = utils::poly_extract(m_state, base, word_size)[0];
+        for (std::size_t i = m_words; i-- > 1;) {
+            m_state[i] = m_state[i - 1];
+        }
+        m_state[0] = 0;
+        if (m_width % word_size != 0) {
+            m_state.back() &= (Word{1} << (m_width % word_size)) - 1;
+        }
+    }
+
+    Word out = 0;
+    for (std::size_t j = 0; j < 8; j++) {
+        std::size_t idx = j * 256 + ((f >> (8 * j)) & 0xFF);
+        const Word *rem = &m_tables->rem[idx * m_words];
+        for (std::size_t i = 0; i < m_words; i++) {
+            m_state[i] ^= rem[i];
+        }
+        out ^= m_tables->out[idx];
+    }
+    return out;
+}
+
+bits lfsr::generate(std::size_t len)
+{
+    bits res{len, 0};
+    std::size_t pos = 0;
+    for (; pos + word_size <= len; pos += word_size) {
+        res.set_nbits(next64(), pos, word_size);
+    }
+    for (; pos < len; pos++) {
+        res.set(pos, next_bit());
+    }
+    return res;
+}
+
+void lfsr::jump(uint64_t n)
+{
+    /* x^n mod P by square and multiply */
+    bits xp{m_width, 1};
+    bits base = m_mod->reduce(bits{2, 2});
+    for (; n > 0; n >>= 1) {
+        if (n & 1) {
+            xp = m_mod->mul(xp, base);
+        }
+        base = m_mod->mul(base, base);
+    }
+
+    bits s = m_mod->mul(xp, utils::poly_bits(m_state, m_width));
+    m_state = utils::poly_words(s);
+}
+
+}  // namespace bitsel
+
+
+#endif  // INCLUDE_BITSEL_LFSR_HPP_
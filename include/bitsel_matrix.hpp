@@ -0,0 +1,391 @@
+#ifndef INCLUDE_BITSEL_MATRIX_HPP_
+#define INCLUDE_BITSEL_MATRIX_HPP_
+
+#include <algorithm>
+#include <cstddef>  // for size_t
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include "bitsel.hpp"
+
+
+namespace bitsel
+{
+
+/*
+ * A dense matrix over GF(2), stored row-major with each row packed into
+ * 64-bit words. Column j of a row is bit j of the bits for that row, so
+ * rows convert to and from bits directly. Bits past the last column are
+ * kept zero.
+ */
+class bit_matrix
+{
+private:
+    using Word = uint64_t;
+    static constexpr std::size_t word_size = 64;
+
+    /* Rows grouped per table in the Four Russians multiplication */
+    static constexpr std::size_t m4r_bits = 8;
+    /* Words of a row handled per table, to keep the table in cache */
+    static constexpr std::size_t m4r_block_words = 32;
+
+    std::size_t m_rows;
+    std::size_t m_cols;
+    std::size_t m_stride;
+    std::vector<Word> m_data;
+
+    Word *row_data(std::size_t r) { return m_data.data() + r * m_stride; }
+    const Word *row_data(std::size_t r) const
+    {
+        return m_data.data() + r * m_stride;
+    }
+
+    void check_pos(std::size_t r, std::size_t c) const;
+    void swap_rows(std::size_t a, std::size_t b);
+    /* Row dst ^= row src, from word from onwards */
+    void xor_row(std::size_t dst, std::size_t src, std::size_t from = 0);
+    /* Reduce to echelon form, applying the same row operations to other */
+    std::size_t eliminate(bit_matrix *other);
+
+    friend bit_matrix operator*(const bit_matrix &, const bit_matrix &);
+    friend bits operator*(const bit_matrix &, const bits_view &);
+    friend bits operator*(const bits_view &, const bit_matrix &);
+
+public:
+    bit_matrix() : bit_matrix{0, 0} {}
+    bit_matrix(std::size_t rows, std::size_t cols);
+    /* One row per bits, all of the same width */
+    explicit bit_matrix(const std::vector<bits> &rows);
+
+    static bit_matrix identity(std::size_t n);
+
+    std::size_t rows() const { return m_rows; }
+    std::size_t cols() const { return m_cols; }
+
+    bool test(std::size_t r, std::size_t c) const;
+    void set(std::size_t r, std::size_t c, bool val);
+    bits row(std::size_t r) const;
+    void set_row(std::size_t r, const bits_view &v);
+
+    bool operator==(const bit_matrix &rhs) const;
+    bool operator!=(const bit_matrix &rhs) const { return !(*this == rhs); }
+
+    /* Addition over GF(2) */
+    bit_matrix &operator^=(const bit_matrix &rhs);
+
+    /* Transposed copy, built from 64x64 tiles */
+    bit_matrix transpose() const;
+
+    /* Reduce to reduced row echelon form in place, return the rank */
+    std::size_t echelonize();
+    std::size_t rank() const;
+    /* Throws std::domain_error if the matrix is singular */
+    bit_matrix inverse() const;
+};
+
+
+bit_matrix::bit_matrix(std::size_t rows, std::size_t cols)
+    : m_rows{rows},
+      m_cols{cols},
+      m_stride{cols / word_size +
+               static_cast<std::size_t>(cols % word_size != 0)},
+      m_data(rows * m_stride, 0)
+{
+}
+
+bit_matrix::bit_matrix(const std::vector<bits> &rows)
+    : bit_matrix{rows.size(), rows.empty() ? 0 : rows[0].width()}
+{
+    for (std::size_t r = 0; r < m_rows; r++) {
+        set_row(r, rows[r]);
+    }
+}
+
+bit_matrix bit_matrix::identity(std::size_t n)
+{
+    bit_matrix m{n, n};
+    for (std::size_t i = 0; i < n; i++) {
+        m.row_data(i)[i / word_size] = Word{1} << (i % word_size);
+    }
+    return m;
+}
+
+void bit_matrix::check_pos(std::size_t r, std::size_t c) const
+{
+    if (r >= m_rows || c >= m_cols) {
+        throw std::out_of_range("Position is out of range");
+    }
+}
+
+bool bit_matrix::test(std::size_t r, std::size_t c) const
+{
+    check_pos(r, c);
+    return (row_data(r)[c / word_size] >> (c % word_size)) & 1;
+}
+
+void bit_matrix::set(std::size_t r, std::size_t c, bool val)
+{
+    check_pos(r, c);
+    Word bit = Word{1} << (c % word_size);
+    Word &w = row_data(r)[c / word_size];
+    w = val ? w | bit : w & ~bit;
+}
+
+bits bit_matrix::row(std::size_t r) const
+{
+    check_pos(r, 0);
+    bits b{m_cols, 0};
+    for (std::size_t i = 0; i < m_stride; i++) {
+        b.set_nbits(row_data(r)[i], i * word_size, word_size);
+    }
+    return b;
+}
+
+void bit_matrix::set_row(std::size_t r, const bits_view &v)
+{
+    if (r >= m_rows) {
+        throw std::out_of_range("Position is out of range");
+    }
+    if (v.width() != m_cols) {
+        throw std::invalid_argument("The width of bits must be the same");
+    }
+    for (std::size_t i = 0; i < m_stride; i++) {
+        row_data(r)[i] = v.get_nbits(i * word_size, word_size);
+    }
+}
+
+bool bit_matrix::operator==(const bit_matrix &rhs) const
+{
+    return m_rows == rhs.m_rows && m_cols == rhs.m_cols &&
+           m_data == rhs.m_data;
+}
+
+bit_matrix &bit_matrix::operator^=(const bit_matrix &rhs)
+{
+    if (m_rows != rhs.m_rows || m_cols != rhs.m_cols) {
+        throw std::invalid_argument("The shape of matrices must be the same");
+    }
+    for (std::size_t i = 0; i < m_data.size(); i++) {
+        m_data[i] ^= rhs.m_data[i];
+    }
+    return *this;
+}
+
+bit_matrix operator^(bit_matrix lhs, const bit_matrix &rhs)
+{
+    lhs ^= rhs;
+    return lhs;
+}
+
+bit_matrix bit_matrix::transpose() const
+{
+    bit_matrix res{m_cols, m_rows};
+    Word tile[word_size];
+
+    /* Tile (i, j) holds rows 64i.. and word j, it lands at (j, i) */
+    for (std::size_t i = 0; i < res.m_stride; i++) {
+        for (std::size_t j = 0; j < m_stride; j++) {
+            for (std::size_t k = 0; k < word_size; k++) {
+                std::size_t r = i * word_size + k;
+                tile[k] = r < m_rows ? row_data(r)[j] : 0;
+            }
+            utils::transpose64(tile);
+            for (std::size_t k = 0; k < word_size; k++) {
+                std::size_t r = j * word_size + k;
+                if (r < res.m_rows) {
+                    res.row_data(r)[i] = tile[k];
+                }
+            }
+        }
+    }
+    return res;
+}
+
+void bit_matrix::swap_rows(std::size_t a, std::size_t b)
+{
+    std::swap_ranges(row_data(a), row_data(a) + m_stride, row_data(b));
+}
+
+void bit_matrix::xor_row(std::size_t dst, std::size_t src, std::size_t from)
+{
+    Word *d = row_data(dst);
+    const Word *s = row_data(src);
+    for (std::size_t i = from; i < m_stride; i++) {
+        d[i] ^= s[i];
+    }
+}
+
+std::size_t bit_matrix::eliminate(bit_matrix *other)
+{
+    /* Gauss-Jordan, clearing each pivot column a word at a time */
+    std::size_t r = 0;
+    for (std::size_t c = 0; c < m_cols && r < m_rows; c++) {
+        std::size_t w = c / word_size;
+        Word bit = Word{1} << (c % word_size);
+
+        std::size_t p = r;
+        while (p < m_rows && !(row_data(p)[w] & bit)) {
+            p++;
+        }
+        if (p == m_rows) {
+            continue;
+        }
+        swap_rows(p, r);
+        if (other) {
+            other->swap_rows(p, r);
+        }
+
+        for (std::size_t i = 0; i < m_rows; i++) {
+            if (i != r && (row_data(i)[w] & bit)) {
+                xor_row(i, r, w);
+                if (other) {
+                    other->xor_row(i, r);
+                }
+            }
+        }
+        r++;
+    }
+    return r;
+}
+
+std::size_t bit_matrix::echelonize()
+{
+    return eliminate(nullptr);
+}
+
+std::size_t bit_matrix::rank() const
+{
+    bit_matrix m{*this};
+    return m.echelonize();
+}
+
+bit_matrix bit_matrix::inverse() const
+{
+    if (m_rows != m_cols) {
+        throw std::invalid_argument("Only square matrices can be inverted");
+    }
+
+    bit_matrix m{*this};
+    bit_matrix inv = identity(m_rows);
+    if (m.eliminate(&inv) != m_rows) {
+        throw std::domain_error("Matrix is singular");
+    }
+    return inv;
+}
+
+
+/*
+ * Product by the Method of Four Russians: the rows of b are taken eight
+ * at a time, all 256 sums of them are tabulated, and each row of a then
+ * adds the one entry picked by its eight bits in those columns. Rows are
+ * processed in column blocks so that the table stays in cache.
+ */
+bit_matrix operator*(const bit_matrix &a, const bit_matrix &b)
+{
+    using Word = bit_matrix::Word;
+    constexpr std::size_t k = bit_matrix::m4r_bits;
+
+    if (a.cols() != b.rows()) {
+        throw std::invalid_argument("The shapes of matrices do not match");
+    }
+
+    bit_matrix c{a.rows(), b.cols()};
+    std::vector<Word> table((std::size_t{1} << k) *
+                            bit_matrix::m4r_block_words);
+
+    for (std::size_t w0 = 0; w0 < b.m_stride;
+         w0 += bit_matrix::m4r_block_words) {
+        std::size_t nw =
+            std::min(bit_matrix::m4r_block_words, b.m_stride - w0);
+
+        for (std::size_t g = 0; g < b.rows(); g += k) {
+            std::size_t kk = std::min(k, b.rows() - g);
+
+            /* Entry i is the sum of the rows g + j for each bit j of i */
+            std::fill_n(table.begin(), nw, 0);
+            for (std::size_t i = 1; i < (std::size_t{1} << kk); i++) {
+                std::size_t j = __builtin_ctzll(i);
+                const Word *prev = &table[(i & (i - 1)) * nw];
+                const Word *src = b.row_data(g + j) + w0;
+                Word *dst = &table[i * nw];
+                for (std::size_t x = 0; x < nw; x++) {
+                    dst[x] = prev[x] ^ src[x];
+                }
+            }
+
+            /* The k bits never straddle a word as k divides 64 */
+            Word mask = (Word{1} << kk) - 1;
+            for (std::size_t r = 0; r < a.rows(); r++) {
+                std::size_t idx =
+                    (a.row_data(r)[g / bit_matrix::word_size] >>
+                     (g % bit_matrix::word_size)) &
+                    mask;
+                if (idx == 0) {
+                    continue;
+                }
+                const Word *src = &table[idx * nw];
+                Word *dst = c.row_data(r) + w0;
+                for (std::size_t x = 0; x < nw; x++) {
+                    dst[x] ^= src[x];
+                }
+            }
+        }
+    }
+    return c;
+}
+
+/* Matrix times column vector: bit r is the parity of row r AND v */
+bits operator*(const bit_matrix &m, const bits_view &v)
+{
+    if (v.width() != m.cols()) {
+        throw std::invalid_argument("The shapes of matrices do not match");
+    }
+
+    std::vector<uint64_t> x(m.m_stride);
+    for (std::size_t i = 0; i < x.size(); i++) {
+        x[i] = v.get_nbits(64 * i, 64);
+    }
+
+    bits res{m.rows(), 0};
+    for (std::size_t r = 0; r < m.rows(); r++) {
+        const uint64_t *row = m.row_data(r);
+        uint64_t acc = 0;
+        for (std::size_t i = 0; i < x.size(); i++) {
+            acc ^= row[i] & x[i];
+        }
+        if (__builtin_parityll(acc)) {
+            res.set(r, true);
+        }
+    }
+    return res;
+}
+
+/* Row vector times matrix: the sum of the rows selected by v */
+bits operator*(const bits_view &v, const bit_matrix &m)
+{
+    if (v.width() != m.rows()) {
+        throw std::invalid_argument("The shapes of matrices do not match");
+    }
+
+    std::vector<uint64_t> acc(m.m_stride);
+    for (std::size_t pos = 0; pos < v.width(); pos += 64) {
+        for (uint64_t w = v.get_nbits(pos, 64); w != 0; w &= w - 1) {
+            const uint64_t *row = m.row_data(pos + __builtin_ctzll(w));
+            for (std::size_t i = 0; i < acc.size(); i++) {
+                acc[i] ^= row[i];
+            }
+        }
+    }
+
+    bits res{m.cols(), 0};
+    for (std::size_t i = 0; i < acc.size(); i++) {
+        res.set_nbits(acc[i], 64 * i, 64);
+    }
+    return res;
+}
+
+}  // namespace bitsel
+
+
+#endif  // INCLUDE_BITSEL_MATRIX_HPP_
@@ -0,0 +1,290 @@
+#ifndef INCLUDE_BITSEL_MMAP_HPP_
+#define INCLUDE_BITSEL_MMAP_HPP_
+
+/* mapped_bits needs POSIX mmap, elsewhere this header declares nothing */
+#if __has_include(<sys/mman.h>) && __has_include(<unistd.h>)
+#define BITSEL_HAS_MMAP 1
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstddef>  // for size_t
+#include <stdexcept>
+#include <string>
+#include <system_error>
+
+#include "bitsel.hpp"
+
+
+namespace bitsel
+{
+
+/*
+ * Bits backed by a memory-mapped file in the binary format written by
+ * bits::write(), i.e. a 64-bit width header followed by little-endian
+ * words. The mapped words are used as storage directly, so opening a file
+ * costs the same regardless of its size.
+ */
+class mapped_bits
+{
+private:
+    using Block = bits::block_type;
+    static constexpr std::size_t block_size = bits::block_digits;
+    static constexpr std::size_t header_size = sizeof(uint64_t);
+
+    int m_fd;
+    void *m_addr;
+    std::size_t m_map_size;
+    std::size_t m_len;
+    bool m_writable;
+
+    Block *blocks() const
+    {
+        return reinterpret_cast<Block *>(static_cast<uint8_t *>(m_addr) +
+                                         header_size);
+    }
+    /* Mapped words must match the in-memory layout of bits */
+    static void check_host();
+    void map(const std::string &path, bool writable);
+    void unmap();
+
+public:
+    enum class access { read_only, read_write };
+    enum class advice { normal, sequential, random, willneed, dontneed };
+
+    explicit mapped_bits(const std::string &path,
+                         access mode = access::read_only);
+
+    /* Create (or truncate) a file holding len zero bits and map it */
+    static mapped_bits create(const std::string &path, std::size_t len);
+
+    mapped_bits(const mapped_bits &) = delete;
+    mapped_bits &operator=(const mapped_bits &) = delete;
+    mapped_bits(mapped_bits &&);
+    mapped_bits &operator=(mapped_bits &&);
+
+    ~mapped_bits() { unmap(); }
+
+    std::size_t width() const { return m_len; }
+    bool writable() const { return m_writable; }
+
+    bits_view view() const { return bits_view{blocks(), m_len}; }
+    operator bits_view() const { return view(); }
+
+    uint64_t get_nbits(std::size_t pos, std::size_t digits = block_size) const
+    {
+        return view().get_nbits(pos, digits);
+    }
+    std::size_t count() const { return view().count(); }
+    bool test(std::size_t pos) const { return view().test(pos); }
+    bool operator[](std::size_t pos) const { return view()[pos]; }
+    bits_view operator()(std::size_t s, std::size_t e) const
+    {
+        return view()(s, e);
+    }
+    bits to_bits() const { return view().to_bits(); }
+
+    void set(std::size_t pos, bool val);
+    void set_nbits(uint64_t val,
+                   std::size_t pos,
+                   std::size_t digits = block_size);
+
+    /* Write dirty pages back to the file */
+    void flush(bool async = false);
+    void advise(advice adv);
+};
+
+
+mapped_bits::mapped_bits(const std::string &path, access mode)
+    : m_fd{-1}, m_addr{nullptr}, m_map_size{0}, m_len{0}, m_writable{false}
+{
+    map(path, mode == access::read_write);
+}
+
+mapped_bits::mapped_bits(mapped_bits &&other)
+    : m_fd{other.m_fd},
+      m_addr{other.m_addr},
+      m_map_size{other.m_map_size},
+      m_len{other.m_len},
+      m_writable{other.m_writable}
+{
+    other.m_fd = -1;
+    other.m_addr = nullptr;
+    other.m_map_size = 0;
+}
+
+mapped_bits &mapped_bits::operator=(mapped_bits &&rhs)
+{
+    if (this == &rhs) {
+        return *this;
+    }
+    std::swap(rhs.m_fd, m_fd);
+    std::swap(rhs.m_addr, m_addr);
+    std::swap(rhs.m_map_size, m_map_size);
+    std::swap(rhs.m_len, m_len);
+    std::swap(rhs.m_writable, m_writable);
+
+    return *this;
+}
+
+mapped_bits mapped_bits::create(const std::string &path, std::size_t len)
+{
+    check_host();
+    int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        throw std::system_error(errno, std::generic_category(), path);
+    }
+
+    /* The payload is left as a hole of zeros */
+    std::size_t num_words = len / 64 + static_cast<std::size_t>(len % 64 != 0);
+    uint8_t header[header_size];
+    utils::store_le64(header, len);
+
+    bool ok = ::write(fd, header, header_size) ==
+                  static_cast<ssize_t>(header_size) &&
+              ::ftruncate(fd, static_cast<off_t>(header_size +
+                                                 num_words * 8)) == 0;
+    int err = errno;
+    ::close(fd);
+    if (!ok) {
+        throw std::system_error(err, std::generic_category(), path);
+    }
+
+    return mapped_bits{path, access::read_write};
+}
+
+void mapped_bits::check_host()
+{
+    if (!utils::is_little_endian) {
+        throw std::runtime_error("Mapped bits require a little-endian host");
+    }
+}
+
+void mapped_bits::map(const std::string &path, bool writable)
+{
+    check_host();
+    m_fd = ::open(path.c_str(), writable ? O_RDWR : O_RDONLY);
+    if (m_fd < 0) {
+        throw std::system_error(errno, std::generic_category(), path);
+    }
+
+    struct stat st;
+    if (::fstat(m_fd, &st) != 0) {
+        int err = errno;
+        unmap();
+        throw std::system_error(err, std::generic_category(), path);
+    }
+
+    m_map_size = static_cast<std::size_t>(st.st_size);
+    if (m_map_size < header_size) {
+        unmap();
+        throw std::invalid_argument("File is too small to hold bits");
+    }
+
+    int prot = writable ? PROT_READ | PROT_WRITE : PROT_READ;
+    m_addr = ::mmap(nullptr, m_map_size, prot, MAP_SHARED, m_fd, 0);
+    if (m_addr == MAP_FAILED) {
+        int err = errno;
+        m_addr = nullptr;
+        unmap();
+        throw std::system_error(err, std::generic_category(), path);
+    }
+    m_writable = writable;
+
+    uint64_t len = utils::load_le64(static_cast<const uint8_t *>(m_addr));
+    uint64_t num_words = len / 64 + static_cast<uint64_t>(len % 64 != 0);
+    if (num_words > (m_map_size - header_size) / 8) {
+        unmap();
+        throw std::invalid_argument("File is too small to hold bits");
+    }
+    m_len = static_cast<std::size_t>(len);
+}
+
+void mapped_bits::unmap()
+{
+    if (m_addr != nullptr) {
+        ::munmap(m_addr, m_map_size);
+        m_addr = nullptr;
+    }
+    if (m_fd >= 0) {
+        ::close(m_fd);
+        m_fd = -1;
+    }
+}
+
+void mapped_bits::set(std::size_t pos, bool val)
+{
+    if (!m_writable) {
+        throw std::logic_error("The mapping is read-only");
+    }
+    if (pos >= m_len) {
+        throw std::out_of_range("Position is out of range");
+    }
+
+    Block mask = Block{1} << (pos % block_size);
+    Block &blk = blocks()[pos / block_size];
+    blk = val ? blk | mask : blk & ~mask;
+}
+
+void mapped_bits::set_nbits(uint64_t val, std::size_t pos, std::size_t digits)
+{
+    if (!m_writable) {
+        throw std::logic_error("The mapping is read-only");
+    }
+
+    std::size_t max_num_digits = std::numeric_limits<uint64_t>::digits;
+    if (digits > max_num_digits) {
+        throw std::invalid_argument("The digits must less than " +
+                                    std::to_string(max_num_digits) + ".");
+    }
+
+    /* Early return */
+    if (pos >= m_len) {
+        return;
+    }
+
+    /* Clip the field to the width */
+    digits = std::min(digits, m_len - pos);
+
+    while (digits > 0) {
+        std::size_t offset = pos % block_size;
+        std::size_t nbits = std::min(block_size - offset, digits);
+        Block mask = static_cast<Block>((1ULL << nbits) - 1) << offset;
+        Block &blk = blocks()[pos / block_size];
+
+        blk = (blk & ~mask) | (static_cast<Block>(val << offset) & mask);
+
+        val >>= nbits;
+        pos += nbits;
+        digits -= nbits;
+    }
+}
+
+void mapped_bits::flush(bool async)
+{
+    if (::msync(m_addr, m_map_size, async ? MS_ASYNC : MS_SYNC) != 0) {
+        throw std::system_error(errno, std::generic_category(), "msync");
+    }
+}
+
+void mapped_bits::advise(advice adv)
+{
+    int a = adv == advice::sequential ? MADV_SEQUENTIAL
+            : adv == advice::random   ? MADV_RANDOM
+            : adv == advice::willneed ? MADV_WILLNEED
+            : adv == advice::dontneed ? MADV_DONTNEED
+                                      : MADV_NORMAL;
+    if (::madvise(m_addr, m_map_size, a) != 0) {
+        throw std::system_error(errno, std::generic_category(), "madvise");
+    }
+}
+
+}  // namespace bitsel
+
+#endif  // __has_include(<sys/mman.h>) && __has_include(<unistd.h>)
+
+
+#endif  // INCLUDE_BITSEL_MMAP_HPP_
@@ -0,0 +1,501 @@
+#ifndef INCLUDE_BITSEL_ROPE_HPP_
+#define INCLUDE_BITSEL_ROPE_HPP_
+
+#include <algorithm>
+#include <cstddef>  // for size_t
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "bitsel.hpp"
+
+
+namespace bitsel
+{
+
+/*
+ * A rope of bits for very long values that are edited in the middle.
+ *
+ * The bits live in immutable chunks of up to leaf_bits bits at the leaves
+ * of a height-balanced (AVL) tree, lowest bits leftmost. Insertion,
+ * erasure, concatenation and splitting are O(log n) joins and splits of
+ * the tree; a leaf that is cut refers to the same chunk with a different
+ * range instead of copying it. Nodes are shared and never modified, so
+ * copying a rope is O(1) and gives an independent snapshot.
+ *
+ * Positions follow bits: erase(s, e) and operator()(s, e) take the high
+ * and low ends of an inclusive range, and append() adds above.
+ */
+class bits_rope
+{
+private:
+    using Word = uint64_t;
+    static constexpr std::size_t word_size = 64;
+
+    struct node;
+    using node_ptr = std::shared_ptr<const node>;
+    using chunk_ptr = std::shared_ptr<const std::vector<Word>>;
+
+    struct node {
+        std::size_t len;
+        std::size_t height;
+        node_ptr left;
+        node_ptr right;
+        /* Leaves only: len bits of chunk starting at bit offset */
+        chunk_ptr chunk;
+        std::size_t offset;
+
+        bool is_leaf() const { return chunk != nullptr; }
+    };
+
+    node_ptr m_root;
+
+    explicit bits_rope(node_ptr root) : m_root{std::move(root)} {}
+
+    static std::size_t height(const node_ptr &t) { return t ? t->height : 0; }
+    static std::size_t length(const node_ptr &t) { return t ? t->len : 0; }
+    /* n <= 64 bits of p from bit pos */
+    static Word read(const Word *p, std::size_t pos, std::size_t n);
+
+    static node_ptr make_leaf(chunk_ptr c, std::size_t offset, std::size_t len);
+    static node_ptr make_node(node_ptr l, node_ptr r);
+    static node_ptr rotate_left(const node_ptr &t);
+    static node_ptr rotate_right(const node_ptr &t);
+    /* One leaf holding l below r */
+    static node_ptr merge_leaves(const node &l, const node &r);
+    static node_ptr join_right(const node_ptr &l, const node_ptr &r);
+    static node_ptr join_left(const node_ptr &l, const node_ptr &r);
+    /* l below r */
+    static node_ptr join(const node_ptr &l, const node_ptr &r);
+    /* The bits below pos and the rest */
+    static std::pair<node_ptr, node_ptr> split(const node_ptr &t,
+                                               std::size_t pos);
+    static node_ptr build(const bits_view &v, std::size_t pos, std::size_t len);
+
+public:
+    static constexpr std::size_t leaf_bits = 4096;
+
+    /* Reads a rope from a position on, up to 64 bits at a time */
+    class cursor
+    {
+    private:
+        node_ptr m_root;
+        std::vector<const node *> m_stack;
+        const node *m_leaf;
+        std::size_t m_pos;
+        std::size_t m_remaining;
+
+    public:
+        explicit cursor(const bits_rope &r, std::size_t pos = 0);
+
+        std::size_t remaining() const { return m_remaining; }
+        bool done() const { return m_remaining == 0; }
+        /* The next min(n, 64) bits, zero past the end */
+        uint64_t next(std::size_t n = word_size);
+    };
+
+    bits_rope() = default;
+    explicit bits_rope(const bits_view &v);
+
+    std::size_t width() const { return length(m_root); }
+    bool empty() const { return m_root == nullptr; }
+    /* Height of the tree, logarithmic in the number of leaves */
+    std::size_t height() const { return height(m_root); }
+    /* Number of leaves, at most 2 * width() / leaf_bits + 1 */
+    std::size_t num_leaves() const;
+
+    bool test(std::size_t pos) const;
+    uint64_t get_nbits(std::size_t pos, std::size_t digits = word_size) const;
+    std::size_t count() const;
+
+    void insert(std::size_t pos, const bits_rope &v);
+    void insert(std::size_t pos, const bits_view &v);
+    void erase(std::size_t s, std::size_t e);
+    bits_rope &append(const bits_rope &v);
+    bits_rope &append(const bits_view &v);
+
+    /* The bits below pos and the rest */
+    std::pair<bits_rope, bits_rope> split(std::size_t pos) const;
+    bits_rope operator()(std::size_t s, std::size_t e) const;
+
+    bits to_bits() const;
+    bool operator==(const bits_rope &rhs) const;
+    bool operator!=(const bits_rope &rhs) const { return !(*this == rhs); }
+};
+
+
+bits_rope::Word bits_rope::read(const Word *p, std::size_t pos, std::size_t n)
+{
+    std::size_t q = pos / word_size, r = pos % word_size;
+    Word w = p[q] >> r;
+    if (r != 0 && r + n > word_size) {
+        w |= p[q + 1] << (word_size - r);
+    }
+    return n == word_size ? w : w & ((Word{1} << n) - 1);
+}
+
+bits_rope::node_ptr bits_rope::make_leaf(chunk_ptr c,
+                                         std::size_t offset,
+                                         std::size_t len)
+{
+    if (len == 0) {
+        return nullptr;
+    }
+    return std::make_shared<const node>(
+        node{len, 1, nullptr, nullptr, std::move(c), offset});
+}
+
+bits_rope::node_ptr bits_rope::make_node(node_ptr l, node_ptr r)
+{
+    std::size_t len = length(l) + length(r);
+    std::size_t h = std::max(height(l), height(r)) + 1;
+    return std::make_shared<const node>(
+        node{len, h, std::move(l), std::move(r), nullptr, 0});
+}
+
+bits_rope::node_ptr bits_rope::rotate_left(const node_ptr &t)
+{
+    const node_ptr &r = t->right;
+    return make_node(make_node(t->left, r->left), r->right);
+}
+
+bits_rope::node_ptr bits_rope::rotate_right(const node_ptr &t)
+{
+    const node_ptr &l = t->left;
+    return make_node(l->left, make_node(l->right, t->right));
+}
+
+/* Join when l is more than one level taller, down its right spine */
+bits_rope::node_ptr bits_rope::join_right(const node_ptr &l, const node_ptr &r)
+{
+    const node_ptr &a = l->left, &c = l->right;
+    if (height(c) <= height(r) + 1) {
+        node_ptr t = make_node(c, r);
+        if (height(t) <= height(a) + 1) {
+            return make_node(a, t);
+        }
+        return rotate_left(make_node(a, rotate_right(t)));
+    }
+
+    node_ptr t = join_right(c, r);
+    node_ptr res = make_node(a, t);
+    return height(t) <= height(a) + 1 ? res : rotate_left(res);
+}
+
+bits_rope::node_ptr bits_rope::join_left(const node_ptr &l, const node_ptr &r)
+{
+    const node_ptr &c = r->left, &a = r->right;
+    if (height(c) <= height(l) + 1) {
+        node_ptr t = make_node(l, c);
+        if (height(t) <= height(a) + 1) {
+            return make_node(t, a);
+        }
+        return rotate_right(make_node(rotate_left(t), a));
+    }
+
+    node_ptr t = join_left(l, c);
+    node_ptr res = make_node(t, a);
+    return height(t) <= height(a) + 1 ? res : rotate_right(res);
+}
+
+bits_rope::node_ptr bits_rope::merge_leaves(const node &l, const node &r)
+{
+    std::size_t len = l.len + r.len;
+    std::vector<Word> words((len + word_size - 1) / word_size, 0);
+    for (std::size_t pos = 0; pos < len; pos += word_size) {
+        std::size_t n = std::min(word_size, len - pos);
+        Word w = 0;
+        for (std::size_t got = 0; got < n;) {
+            const node &leaf = pos + got < l.len ? l : r;
+            std::size_t at = pos + got < l.len ? pos + got : pos + got - l.len;
+            std::size_t take = std::min(n - got, leaf.len - at);
+            w |= read(leaf.chunk->data(), leaf.offset + at, take) << got;
+            got += take;
+        }
+        words[pos / word_size] = w;
+    }
+    return make_leaf(
+        std::make_shared<const std::vector<Word>>(std::move(words)), 0, len);
+}
+
+bits_rope::node_ptr bits_rope::join(const node_ptr &l, const node_ptr &r)
+{
+    if (!l) {
+        return r;
+    }
+    if (!r) {
+        return l;
+    }
+
+    /*
+     * The leaves that meet at the seam are merged when they fit in one, so
+     * that no two neighbouring leaves hold leaf_bits bits or fewer and
+     * small edits do not fragment the rope.
+     */
+    const node *a = l.get(), *b = r.get();
+    while (!a->is_leaf()) {
+        a = a->right.get();
+    }
+    while (!b->is_leaf()) {
+        b = b->left.get();
+    }
+    if (a->len + b->len <= leaf_bits) {
+        if (l->is_leaf() && r->is_leaf()) {
+            return merge_leaves(*l, *r);
+        }
+        auto lp = split(l, l->len - a->len);
+        auto rp = split(r, b->len);
+        node_ptr mid = merge_leaves(*lp.second, *rp.first);
+        return join(join(lp.first, mid), rp.second);
+    }
+
+    if (height(l) > height(r) + 1) {
+        return join_right(l, r);
+    }
+    if (height(r) > height(l) + 1) {
+        return join_left(l, r);
+    }
+    return make_node(l, r);
+}
+
+std::pair<bits_rope::node_ptr, bits_rope::node_ptr> bits_rope::split(
+    const node_ptr &t,
+    std::size_t pos)
+{
+    if (pos == 0) {
+        return {nullptr, t};
+    }
+    if (pos >= length(t)) {
+        return {t, nullptr};
+    }
+    if (t->is_leaf()) {
+        return {make_leaf(t->chunk, t->offset, pos),
+                make_leaf(t->chunk, t->offset + pos, t->len - pos)};
+    }
+
+    std::size_t llen = length(t->left);
+    if (pos <= llen) {
+        auto p = split(t->left, pos);
+        return {p.first, join(p.second, t->right)};
+    }
+    auto p = split(t->right, pos - llen);
+    return {join(t->left, p.first), p.second};
+}
+
+bits_rope::node_ptr bits_rope::build(const bits_view &v,
+                                     std::size_t pos,
+                                     std::size_t len)
+{
+    if (len <= leaf_bits) {
+        std::vector<Word> words((len + word_size - 1) / word_size);
+        for (std::size_t i = 0; i < words.size(); i++) {
+            std::size_t n = std::min(word_size, len - i * word_size);
+            words[i] = v.get_nbits(pos + i * word_size, n);
+        }
+        return make_leaf(
+            std::make_shared<const std::vector<Word>>(std::move(words)), 0,
+            len);
+    }
+
+    /* Halve on a leaf boundary, so heights differ by at most one */
+    std::size_t leaves = (len + leaf_bits - 1) / leaf_bits;
+    std::size_t mid = leaves / 2 * leaf_bits;
+    return make_node(build(v, pos, mid), build(v, pos + mid, len - mid));
+}
+
+
+bits_rope::cursor::cursor(const bits_rope &r, std::size_t pos)
+    : m_root{r.m_root},
+      m_leaf{nullptr},
+      m_pos{0},
+      m_remaining{pos < r.width() ? r.width() - pos : 0}
+{
+    if (m_remaining == 0) {
+        return;
+    }
+
+    /* Down to the leaf holding pos, keeping the right parts to visit */
+    const node *t = m_root.get();
+    while (!t->is_leaf()) {
+        std::size_t llen = length(t->left);
+        if (pos < llen) {
+            m_stack.push_back(t->right.get());
+            t = t->left.get();
+        } else {
+            pos -= llen;
+            t = t->right.get();
+        }
+    }
+    m_leaf = t;
+    m_pos = pos;
+}
+
+uint64_t bits_rope::cursor::next(std::size_t n)
+{
+    n = std::min(n, word_size);
+    Word res = 0;
+    std::size_t got = 0;
+    while (got < n && m_remaining > 0) {
+        if (m_pos == m_leaf->len) {
+            const node *t = m_stack.back();
+            m_stack.pop_back();
+            while (!t->is_leaf()) {
+                m_stack.push_back(t->right.get());
+                t = t->left.get();
+            }
+            m_leaf = t;
+            m_pos = 0;
+        }
+
+        std::size_t take = std::min({n - got, m_leaf->len - m_pos,
+                                     m_remaining});
+        res |= read(m_leaf->chunk->data(), m_leaf->offset + m_pos, take)
+               << got;
+        got += take;
+        m_pos += take;
+        m_remaining -= take;
+    }
+    return res;
+}
+
+
+bits_rope::bits_rope(const bits_view &v)
+    : m_root{v.width() ? build(v, 0, v.width()) : nullptr}
+{
+}
+
+bool bits_rope::test(std::size_t pos) const
+{
+    if (pos >= width()) {
+        throw std::out_of_range("Position is out of range");
+    }
+    return cursor{*this, pos}.next(1);
+}
+
+uint64_t bits_rope::get_nbits(std::size_t pos, std::size_t digits) const
+{
+    if (digits > word_size) {
+        throw std::invalid_argument("The number of bits must less than " +
+                                    std::to_string(word_size) + ".");
+    }
+    return cursor{*this, pos}.next(digits);
+}
+
+std::size_t bits_rope::num_leaves() const
+{
+    std::size_t res = 0;
+    std::vector<const node *> stack;
+    if (m_root) {
+        stack.push_back(m_root.get());
+    }
+    while (!stack.empty()) {
+        const node *t = stack.back();
+        stack.pop_back();
+        if (t->is_leaf()) {
+            res++;
+        } else {
+            stack.push_back(t->left.get());
+            stack.push_back(t->right.get());
+        }
+    }
+    return res;
+}
+
+std::size_t bits_rope::count() const
+{
+    std::size_t res = 0;
+    for (cursor c{*this}; !c.done();) {
+        res += __builtin_popcountll(c.next());
+    }
+    return res;
+}
+
+void bits_rope::insert(std::size_t pos, const bits_rope &v)
+{
+    if (pos > width()) {
+        throw std::out_of_range("Position is out of range");
+    }
+    auto p = split(m_root, pos);
+    m_root = join(join(p.first, v.m_root), p.second);
+}
+
+void bits_rope::insert(std::size_t pos, const bits_view &v)
+{
+    insert(pos, bits_rope{v});
+}
+
+void bits_rope::erase(std::size_t s, std::size_t e)
+{
+    if (s >= width() || s < e) {
+        throw std::out_of_range("range error");
+    }
+    auto lo = split(m_root, e);
+    auto hi = split(lo.second, s - e + 1);
+    m_root = join(lo.first, hi.second);
+}
+
+bits_rope &bits_rope::append(const bits_rope &v)
+{
+    m_root = join(m_root, v.m_root);
+    return *this;
+}
+
+bits_rope &bits_rope::append(const bits_view &v)
+{
+    return append(bits_rope{v});
+}
+
+std::pair<bits_rope, bits_rope> bits_rope::split(std::size_t pos) const
+{
+    if (pos > width()) {
+        throw std::out_of_range("Position is out of range");
+    }
+    auto p = split(m_root, pos);
+    return {bits_rope{p.first}, bits_rope{p.second}};
+}
+
+bits_rope bits_rope::operator()(std::size_t s, std::size_t e) const
+{
+    if (s >= width() || s < e) {
+        throw std::out_of_range("range error");
+    }
+    auto hi = split(m_root, s + 1);
+    return bits_rope{split(hi.first, e).second};
+}
+
+bits bits_rope::to_bits() const
+{
+    bits b{width(), 0};
+    std::size_t pos = 0;
+    for (cursor c{*this}; !c.done(); pos += word_size) {
+        b.set_nbits(c.next(), pos, word_size);
+    }
+    return b;
+}
+
+bool bits_rope::operator==(const bits_rope &rhs) const
+{
+    if (width() != rhs.width()) {
+        return false;
+    }
+    for (cursor a{*this}, b{rhs}; !a.done();) {
+        if (a.next() != b.next()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/* hi above lo, sharing the nodes of both */
+bits_rope cat(const bits_rope &hi, const bits_rope &lo)
+{
+    bits_rope res{lo};
+    return res.append(hi);
+}
+
+}  // namespace bitsel
+
+
+#endif  // INCLUDE_BITSEL_ROPE_HPP_
@@ -0,0 +1,207 @@
+#ifndef INCLUDE_BITSEL_SEARCH_HPP_
+#define INCLUDE_BITSEL_SEARCH_HPP_
+
+#include <algorithm>
+#include <cstddef>  // for size_t
+#include <exception>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include "bitsel.hpp"
+
+
+namespace bitsel
+{
+
+/*
+ * A collection of equal-width binary codes packed back to back in 64-bit
+ * words, for nearest-neighbour search under the Hamming distance.
+ *
+ * Codes of a few hundred bits fit in a handful of words, so scanning the
+ * packed array streams through memory with no per-code indirection.
+ */
+class fingerprint_set
+{
+private:
+    using Word = uint64_t;
+    static constexpr std::size_t word_size = 64;
+
+    std::size_t m_width;
+    std::size_t m_words;
+    std::vector<Word> m_data;
+
+    /* Fewer codes than this per thread are not worth a thread */
+    static constexpr std::size_t min_codes_per_thread = 1 << 14;
+
+    std::vector<Word> pack(const bits_view &code) const;
+    std::size_t distance(const Word *code, const Word *query) const;
+
+public:
+    struct match {
+        std::size_t index;
+        std::size_t distance;
+
+        bool operator<(const match &rhs) const
+        {
+            return distance != rhs.distance ? distance < rhs.distance
+                                            : index < rhs.index;
+        }
+        bool operator==(const match &rhs) const
+        {
+            return index == rhs.index && distance == rhs.distance;
+        }
+    };
+
+    explicit fingerprint_set(std::size_t width);
+
+    std::size_t width() const { return m_width; }
+    std::size_t size() const { return m_words ? m_data.size() / m_words : 0; }
+
+    void reserve(std::size_t n) { m_data.reserve(n * m_words); }
+    void push_back(const bits_view &code);
+    bits operator[](std::size_t i) const;
+
+    /*
+     * The k codes closest to query, nearest first, ties broken by index.
+     * The scan is split across threads (all hardware threads when 0).
+     */
+    std::vector<match> top_k(const bits_view &query,
+                             std::size_t k,
+                             std::size_t threads = 0) const;
+};
+
+
+fingerprint_set::fingerprint_set(std::size_t width)
+    : m_width{width},
+      m_words{width / word_size +
+              static_cast<std::size_t>(width % word_size != 0)}
+{
+}
+
+std::vector<fingerprint_set::Word> fingerprint_set::pack(
+    const bits_view &code) const
+{
+    if (code.width() != m_width) {
+        throw std::invalid_argument("The width of bits must be the same");
+    }
+
+    std::vector<Word> words(m_words);
+    for (std::size_t i = 0; i < m_words; i++) {
+        words[i] = code.get_nbits(i * word_size, word_size);
+    }
+    return words;
+}
+
+void fingerprint_set::push_back(const bits_view &code)
+{
+    auto words = pack(code);
+    m_data.insert(m_data.end(), words.begin(), words.end());
+}
+
+bits fingerprint_set::operator[](std::size_t i) const
+{
+    if (i >= size()) {
+        throw std::out_of_range("Position is out of range");
+    }
+
+    bits b{m_width, 0};
+    for (std::size_t j = 0; j < m_words; j++) {
+        b.set_nbits(m_data[i * m_words + j], j * word_size, word_size);
+    }
+    return b;
+}
+
+std::size_t fingerprint_set::distance(const Word *code,
+                                      const Word *query) const
+{
+    std::size_t res = 0;
+    for (std::size_t i = 0; i < m_words; i++) {
+        res += __builtin_popcountll(code[i] ^ query[i]);
+    }
+    return res;
+}
+
+std::vector<fingerprint_set::match> fingerprint_set::top_k(
+    const bits_view &query,
+    std::size_t k,
+    std::size_t threads) const
+{
+    auto q = pack(query);
+    std::size_t n = size();
+    k = std::min(k, n);
+    if (k == 0) {
+        return {};
+    }
+
+    if (threads == 0) {
+        threads = std::max<std::size_t>(std::thread::hardware_concurrency(), 1);
+    }
+    threads = std::max<std::size_t>(
+        std::min(threads, n / min_codes_per_thread), 1);
+
+    /* Each thread keeps a max-heap of its k best, merged at the end */
+    std::vector<std::vector<match>> best(threads);
+    auto scan = [&](std::size_t t) {
+        std::size_t begin = n * t / threads, end = n * (t + 1) / threads;
+        auto &heap = best[t];
+        heap.reserve(k + 1);
+
+        for (std::size_t i = begin; i < end; i++) {
+            std::size_t d = distance(m_data.data() + i * m_words, q.data());
+            if (heap.size() == k && d >= heap.front().distance) {
+                continue;
+            }
+            heap.push_back(match{i, d});
+            std::push_heap(heap.begin(), heap.end());
+            if (heap.size() > k) {
+                std::pop_heap(heap.begin(), heap.end());
+                heap.pop_back();
+            }
+        }
+    };
+
+    /* Exceptions are carried back so they reach the caller, not terminate */
+    std::vector<std::exception_ptr> errors(threads);
+    auto run = [&](std::size_t t) {
+        try {
+            scan(t);
+        } catch (...) {
+            errors[t] = std::current_exception();
+        }
+    };
+
+    std::vector<std::thread> workers;
+    try {
+        for (std::size_t t = 1; t < threads; t++) {
+            workers.emplace_back(run, t);
+        }
+    } catch (...) {
+        for (auto &w : workers) {
+            w.join();
+        }
+        throw;
+    }
+    run(0);
+    for (auto &w : workers) {
+        w.join();
+    }
+    for (const auto &e : errors) {
+        if (e) {
+            std::rethrow_exception(e);
+        }
+    }
+
+    std::vector<match> res;
+    for (const auto &heap : best) {
+        res.insert(res.end(), heap.begin(), heap.end());
+    }
+    std::partial_sort(res.begin(), res.begin() + k, res.end());
+    res.resize(k);
+    return res;
+}
+
+}  // namespace bitsel
+
+
+#endif  // INCLUDE_BITSEL_SEARCH_HPP_
@@ -0,0 +1,1014 @@
+#ifndef INCLUDE_BITSEL_SIM_HPP_
+#define INCLUDE_BITSEL_SIM_HPP_
+
+#include <algorithm>
+#include <array>
+#include <cstddef>  // for size_t
+#include <stdexcept>
+#include <vector>
+
+#include "bitsel.hpp"
+
+
+namespace bitsel
+{
+
+/*
+ * A synchronous circuit: inputs, constants, registers and combinational
+ * operations over them. Every node is a signal of a fixed width, named by
+ * the index returned when it is created.
+ *
+ * Operands of the bitwise and arithmetic operations must have the same
+ * width; cat() and slice() change widths. Registers are created first and
+ * connected to their next value later, so that feedback can be described.
+ */
+class netlist
+{
+public:
+    using signal = std::size_t;
+
+    enum class op {
+        input,
+        constant,
+        reg,
+        bit_and,
+        bit_or,
+        bit_xor,
+        bit_not,
+        add,
+        sub,
+        eq,
+        lt,
+        mux,
+        slice,
+        cat
+    };
+
+    struct node {
+        op kind;
+        std::size_t width;
+        /* Operands, or the next value of a register */
+        std::array<signal, 3> args;
+        /* Lowest bit of a slice */
+        std::size_t lo;
+        /* Value of a constant, initial value of a register */
+        bits value;
+    };
+
+private:
+    std::vector<node> m_nodes;
+
+    static constexpr signal unconnected = ~signal{0};
+
+    signal add_node(op kind,
+                    std::size_t width,
+                    std::array<signal, 3> args = {},
+                    std::size_t lo = 0,
+                    bits value = bits{});
+    void check_signal(signal s) const;
+    void check_same_width(signal a, signal b) const;
+
+public:
+    std::size_t size() const { return m_nodes.size(); }
+    const node &operator[](signal s) const { return m_nodes[s]; }
+    std::size_t width(signal s) const { return m_nodes[s].width; }
+
+    static std::size_t num_args(op kind);
+    /* Whether s is computed from other signals in the same cycle */
+    bool is_comb(signal s) const;
+    /* The combinational nodes ordered by level, operands first */
+    std::vector<signal> levelize() const;
+
+    signal input(std::size_t width);
+    signal constant(const bits &value);
+    signal reg(std::size_t width);
+    signal reg(const bits &init);
+    /* Set the value a register takes at the next clock edge */
+    void connect(signal r, signal next);
+
+    signal bit_and(signal a, signal b);
+    signal bit_or(signal a, signal b);
+    signal bit_xor(signal a, signal b);
+    signal bit_not(signal a);
+    /* Modulo 2^width */
+    signal add(signal a, signal b);
+    signal sub(signal a, signal b);
+    /* One-bit results, lt compares as unsigned */
+    signal eq(signal a, signal b);
+    signal lt(signal a, signal b);
+    /* a when the one-bit sel is set, b otherwise */
+    signal mux(signal sel, signal a, signal b);
+    /* Bits hi down to lo, as bits::operator() */
+    signal slice(signal a, std::size_t hi, std::size_t lo);
+    /* hi above lo */
+    signal cat(signal hi, signal lo);
+};
+
+
+netlist::signal netlist::add_node(op kind,
+                                  std::size_t width,
+                                  std::array<signal, 3> args,
+                                  std::size_t lo,
+                                  bits value)
+{
+    if (width == 0) {
+        throw std::invalid_argument("The width of a signal must be positive");
+    }
+    m_nodes.push_back(node{kind, width, args, lo, std::move(value)});
+    return m_nodes.size() - 1;
+}
+
+void netlist::check_signal(signal s) const
+{
+    if (s >= m_nodes.size()) {
+        throw std::out_of_range("Signal is out of range");
+    }
+}
+
+void netlist::check_same_width(signal a, signal b) const
+{
+    check_signal(a);
+    check_signal(b);
+    if (width(a) != width(b)) {
+        throw std::invalid_argument("The width of bits must be the same");
+    }
+}
+
+std::size_t netlist::num_args(op kind)
+{
+    switch (kind) {
+    case op::input:
+    case op::constant:
+    case op::reg:
+        return 0;
+    case op::bit_not:
+    case op::slice:
+        return 1;
+    case op::mux:
+        return 3;
+    default:
+        return 2;
+    }
+}
+
+bool netlist::is_comb(signal s) const
+{
+    return num_args(m_nodes[s].kind) != 0;
+}
+
+std::vector<netlist::signal> netlist::levelize() const
+{
+    /* Kahn's algorithm, recording the level of each node */
+    std::size_t n = m_nodes.size();
+    std::vector<std::size_t> pending(n, 0), level(n, 0);
+    std::vector<std::vector<signal>> users(n);
+    std::vector<signal> ready, order;
+    for (signal s = 0; s < n; s++) {
+        if (!is_comb(s)) {
+            ready.push_back(s);
+            continue;
+        }
+        for (std::size_t j = 0; j < num_args(m_nodes[s].kind); j++) {
+            users[m_nodes[s].args[j]].push_back(s);
+            pending[s]++;
+        }
+    }
+    while (!ready.empty()) {
+        signal s = ready.back();
+        ready.pop_back();
+        if (is_comb(s)) {
+            order.push_back(s);
+        }
+        for (signal u : users[s]) {
+            level[u] = std::max(level[u], level[s] + 1);
+            if (--pending[u] == 0) {
+                ready.push_back(u);
+            }
+        }
+    }
+
+    /* Operands precede their users, so every node has been reached */
+    std::stable_sort(order.begin(), order.end(), [&](signal a, signal b) {
+        return level[a] < level[b];
+    });
+    return order;
+}
+
+netlist::signal netlist::input(std::size_t width)
+{
+    return add_node(op::input, width);
+}
+
+netlist::signal netlist::constant(const bits &value)
+{
+    return add_node(op::constant, value.width(), {}, 0, value);
+}
+
+netlist::signal netlist::reg(std::size_t width)
+{
+    return reg(bits{width, 0});
+}
+
+netlist::signal netlist::reg(const bits &init)
+{
+    return add_node(op::reg, init.width(), {unconnected, 0, 0}, 0, init);
+}
+
+void netlist::connect(signal r, signal next)
+{
+    check_same_width(r, next);
+    if (m_nodes[r].kind != op::reg) {
+        throw std::invalid_argument("Only registers can be connected");
+    }
+    m_nodes[r].args[0] = next;
+}
+
+netlist::signal netlist::bit_and(signal a, signal b)
+{
+    check_same_width(a, b);
+    return add_node(op::bit_and, width(a), {a, b, 0});
+}
+
+netlist::signal netlist::bit_or(signal a, signal b)
+{
+    check_same_width(a, b);
+    return add_node(op::bit_or, width(a), {a, b, 0});
+}
+
+netlist::signal netlist::bit_xor(signal a, signal b)
+{
+    check_same_width(a, b);
+    return add_node(op::bit_xor, width(a), {a, b, 0});
+}
+
+netlist::signal netlist::bit_not(signal a)
+{
+    check_signal(a);
+    return add_node(op::bit_not, width(a), {a, 0, 0});
+}
+
+netlist::signal netlist::add(signal a, signal b)
+{
+    check_same_width(a, b);
+    return add_node(op::add, width(a), {a, b, 0});
+}
+
+netlist::signal netlist::sub(signal a, signal b)
+{
+    check_same_width(a, b);
+    return add_node(op::sub, width(a), {a, b, 0});
+}
+
+netlist::signal netlist::eq(signal a, signal b)
+{
+    check_same_width(a, b);
+    return add_node(op::eq, 1, {a, b, 0});
+}
+
+netlist::signal netlist::lt(signal a, signal b)
+{
+    check_same_width(a, b);
+    return add_node(op::lt, 1, {a, b, 0});
+}
+
+netlist::signal netlist::mux(signal sel, signal a, signal b)
+{
+    check_signal(sel);
+    check_same_width(a, b);
+    if (width(sel) != 1) {
+        throw std::invalid_argument("The select of a mux must be one bit");
+    }
+    return add_node(op::mux, width(a), {sel, a, b});
+}
+
+netlist::signal netlist::slice(signal a, std::size_t hi, std::size_t lo)
+{
+    check_signal(a);
+    if (hi >= width(a) || hi < lo) {
+        throw std::out_of_range("range error");
+    }
+    return add_node(op::slice, hi - lo + 1, {a, 0, 0}, lo);
+}
+
+netlist::signal netlist::cat(signal hi, signal lo)
+{
+    check_signal(hi);
+    check_signal(lo);
+    return add_node(op::cat, width(hi) + width(lo), {hi, lo, 0});
+}
+
+
+/*
+ * Compiled, event-driven evaluation of a netlist.
+ *
+ * Construction levelizes the combinational nodes (registers and inputs
+ * break the cycles) and compiles them into a flat list of instructions in
+ * level order, whose operands are pre-resolved word offsets into a single
+ * arena holding every signal as 64-bit words. Evaluation walks the list
+ * once and only runs instructions with an operand that changed since they
+ * last ran.
+ *
+ * step() settles the logic, loads every register with its next value at
+ * once and settles again, so peek() always sees a consistent state.
+ */
+class simulator
+{
+private:
+    using Word = uint64_t;
+    using signal = netlist::signal;
+    using op = netlist::op;
+
+    struct instr {
+        op kind;
+        std::size_t dst;
+        std::size_t nwords;
+        std::size_t width;
+        std::array<std::size_t, 3> args;
+        /* Words of the first operand */
+        std::size_t arg_words;
+        /* Width of the low operand of a cat, lowest bit of a slice */
+        std::size_t param;
+        signal node;
+    };
+
+    struct latch {
+        std::size_t reg;
+        std::size_t next;
+        /* Staging slot for the next value */
+        std::size_t stage;
+        std::size_t nwords;
+        signal node;
+    };
+
+    std::vector<netlist::node> m_nodes;
+    std::vector<Word> m_arena;
+    std::vector<std::size_t> m_offset;
+
+    std::vector<instr> m_code;
+    std::vector<latch> m_latches;
+
+    /* Instructions reading each signal, as ranges into m_fanout */
+    std::vector<std::size_t> m_fanout_begin;
+    std::vector<std::size_t> m_fanout;
+
+    std::vector<char> m_dirty;
+    std::size_t m_first_dirty;
+    std::size_t m_evaluated;
+    uint64_t m_cycle;
+    std::vector<Word> m_scratch;
+
+    static std::size_t num_words(std::size_t width)
+    {
+        return (width + 63) / 64;
+    }
+    /* 64 bits of the nwords words at p starting at bit pos */
+    static Word load(const Word *p, std::size_t nwords, std::size_t pos);
+
+    void compile(const netlist &nl);
+    void mark_fanout(signal s);
+    bool exec(const instr &in);
+    void write(signal s, const bits_view &v);
+
+public:
+    explicit simulator(const netlist &nl);
+
+    /* Set an input, the change takes effect at the next eval() */
+    void poke(signal s, const bits_view &v);
+    bits peek(signal s) const;
+
+    /* Settle the combinational logic */
+    void eval();
+    void step(uint64_t cycles = 1);
+
+    uint64_t cycle() const { return m_cycle; }
+    /* Number of instructions run so far */
+    std::size_t evaluated() const { return m_evaluated; }
+};
+
+
+simulator::simulator(const netlist &nl)
+    : m_nodes(nl.size()),
+      m_offset(nl.size()),
+      m_first_dirty{0},
+      m_evaluated{0},
+      m_cycle{0}
+{
+    std::size_t size = 0;
+    std::size_t max_words = 0;
+    for (signal s = 0; s < nl.size(); s++) {
+        m_nodes[s] = nl[s];
+        m_offset[s] = size;
+        size += num_words(nl.width(s));
+        max_words = std::max(max_words, num_words(nl.width(s)));
+    }
+
+    /* Registers load their next value through a staging slot */
+    for (signal s = 0; s < nl.size(); s++) {
+        if (nl[s].kind != op::reg) {
+            continue;
+        }
+        if (nl[s].args[0] >= nl.size()) {
+            throw std::logic_error("Register is not connected");
+        }
+        std::size_t nwords = num_words(nl.width(s));
+        m_latches.push_back(
+            latch{m_offset[s], m_offset[nl[s].args[0]], size, nwords, s});
+        size += num_words(nl.width(s));
+    }
+    m_arena.assign(size, 0);
+    m_scratch.resize(max_words);
+
+    for (signal s = 0; s < nl.size(); s++) {
+        if (nl[s].kind == op::constant || nl[s].kind == op::reg) {
+            write(s, nl[s].value);
+        }
+    }
+
+    compile(nl);
+    m_dirty.assign(m_code.size(), 1);
+    eval();
+}
+
+void simulator::compile(const netlist &nl)
+{
+    /* Compile in level order, then index the readers of each signal */
+    std::size_t n = m_nodes.size();
+    std::vector<std::vector<std::size_t>> readers(n);
+    for (signal s : nl.levelize()) {
+        const auto &nd = m_nodes[s];
+        instr in{};
+        in.kind = nd.kind;
+        in.dst = m_offset[s];
+        in.nwords = num_words(nd.width);
+        in.width = nd.width;
+        in.arg_words = num_words(m_nodes[nd.args[0]].width);
+        in.param = nd.lo;
+        in.node = s;
+        for (std::size_t j = 0; j < netlist::num_args(nd.kind); j++) {
+            in.args[j] = m_offset[nd.args[j]];
+            readers[nd.args[j]].push_back(m_code.size());
+        }
+        if (nd.kind == op::cat) {
+            in.param = m_nodes[nd.args[1]].width;
+        }
+        m_code.push_back(in);
+    }
+
+    m_fanout_begin.assign(n + 1, 0);
+    for (signal s = 0; s < n; s++) {
+        m_fanout_begin[s + 1] = m_fanout_begin[s] + readers[s].size();
+        m_fanout.insert(m_fanout.end(), readers[s].begin(), readers[s].end());
+    }
+}
+
+simulator::Word simulator::load(const Word *p,
+                                std::size_t nwords,
+                                std::size_t pos)
+{
+    std::size_t q = pos / 64, r = pos % 64;
+    Word lo = q < nwords ? p[q] : 0;
+    Word hi = r && q + 1 < nwords ? p[q + 1] : 0;
+    return r ? lo >> r | hi << (64 - r) : lo;
+}
+
+void simulator::mark_fanout(signal s)
+{
+    for (std::size_t i = m_fanout_begin[s]; i < m_fanout_begin[s + 1]; i++) {
+        m_dirty[m_fanout[i]] = 1;
+        m_first_dirty = std::min(m_first_dirty, m_fanout[i]);
+    }
+}
+
+/* Run one instruction, return whether its output changed */
+bool simulator::exec(const instr &in)
+{
+    const Word *a = m_arena.data() + in.args[0];
+    const Word *b = m_arena.data() + in.args[1];
+    const Word *c = m_arena.data() + in.args[2];
+    Word *s = m_scratch.data();
+    std::size_t n = in.nwords;
+
+    switch (in.kind) {
+    case op::bit_and:
+        for (std::size_t i = 0; i < n; i++) {
+            s[i] = a[i] & b[i];
+        }
+        break;
+    case op::bit_or:
+        for (std::size_t i = 0; i < n; i++) {
+            s[i] = a[i] | b[i];
+        }
+        break;
+    case op::bit_xor:
+        for (std::size_t i = 0; i < n; i++) {
+            s[i] = a[i] ^ b[i];
+        }
+        break;
+    case op::bit_not:
+        for (std::size_t i = 0; i < n; i++) {
+            s[i] = ~a[i];
+        }
+        break;
+    case op::add:
+    case op::sub: {
+        /* a - b is a + ~b + 1 */
+        bool sub = in.kind == op::sub;
+        __uint128_t carry = sub ? 1 : 0;
+        for (std::size_t i = 0; i < n; i++) {
+            __uint128_t t = carry + a[i] + (sub ? ~b[i] : b[i]);
+            s[i] = static_cast<Word>(t);
+            carry = t >> 64;
+        }
+        break;
+    }
+    case op::eq:
+    case op::lt: {
+        /* Find the highest differing word */
+        std::size_t i = in.arg_words;
+        while (i > 0 && a[i - 1] == b[i - 1]) {
+            i--;
+        }
+        s[0] = in.kind == op::eq ? i == 0 : i > 0 && a[i - 1] < b[i - 1];
+        break;
+    }
+    case op::mux:
+        /* The select is a, the inputs are b and c */
+        std::copy_n(a[0] & 1 ? b : c, n, s);
+        break;
+    case op::slice:
+        for (std::size_t i = 0; i < n; i++) {
+            s[i] = load(a, in.arg_words, in.param + 64 * i);
+        }
+        break;
+    case op::cat: {
+        /* lo as is, then hi shifted up by the width of lo */
+        std::size_t lo_words = num_words(in.param);
+        std::copy_n(b, lo_words, s);
+        std::fill(s + lo_words, s + n, 0);
+        std::size_t q = in.param / 64, r = in.param % 64;
+        std::size_t hi_words = num_words(in.width - in.param);
+        for (std::size_t i = 0; i < hi_words; i++) {
+            s[q + i] |= a[i] << r;
+            if (r && q + i + 1 < n) {
+                s[q + i + 1] |= a[i] >> (64 - r);
+            }
+        }
+        break;
+    }
+    default:
+        break;
+    }
+
+    if (in.width % 64 != 0) {
+        s[n - 1] &= (Word{1} << (in.width % 64)) - 1;
+    }
+
+    Word *dst = m_arena.data() + in.dst;
+    if (std::equal(s, s + n, dst)) {
+        return false;
+    }
+    std::copy_n(s, n, dst);
+    return true;
+}
+
+void simulator::write(signal s, const bits_view &v)
+{
+    Word *dst = m_arena.data() + m_offset[s];
+    for (std::size_t i = 0; i < num_words(v.width()); i++) {
+        dst[i] = v.get_nbits(64 * i, 64);
+    }
+}
+
+void simulator::poke(signal s, const bits_view &v)
+{
+    if (s >= m_nodes.size() || m_nodes[s].kind != op::input) {
+        throw std::invalid_argument("Only inputs can be poked");
+    }
+    if (v.width() != m_nodes[s].width) {
+        throw std::invalid_argument("The width of bits must be the same");
+    }
+
+    const Word *old = m_arena.data() + m_offset[s];
+    for (std::size_t i = 0; i < num_words(v.width()); i++) {
+        if (old[i] != v.get_nbits(64 * i, 64)) {
+            write(s, v);
+            mark_fanout(s);
+            return;
+        }
+    }
+}
+
+bits simulator::peek(signal s) const
+{
+    if (s >= m_nodes.size()) {
+        throw std::out_of_range("Signal is out of range");
+    }
+
+    std::size_t len = m_nodes[s].width;
+    const Word *src = m_arena.data() + m_offset[s];
+    bits b{len, 0};
+    for (std::size_t i = 0; i < num_words(len); i++) {
+        b.set_nbits(src[i], 64 * i, std::min<std::size_t>(64, len - 64 * i));
+    }
+    return b;
+}
+
+void simulator::eval()
+{
+    for (std::size_t k = m_first_dirty; k < m_code.size(); k++) {
+        if (!m_dirty[k]) {
+            continue;
+        }
+        m_dirty[k] = 0;
+        m_evaluated++;
+        if (exec(m_code[k])) {
+            mark_fanout(m_code[k].node);
+        }
+    }
+    m_first_dirty = m_code.size();
+}
+
+void simulator::step(uint64_t cycles)
+{
+    for (; cycles > 0; cycles--) {
+        eval();
+
+        /* Stage every next value before loading any register */
+        for (const auto &l : m_latches) {
+            std::copy_n(m_arena.data() + l.next, l.nwords,
+                        m_arena.data() + l.stage);
+        }
+        for (const auto &l : m_latches) {
+            Word *reg = m_arena.data() + l.reg;
+            const Word *next = m_arena.data() + l.stage;
+            if (!std::equal(next, next + l.nwords, reg)) {
+                std::copy_n(next, l.nwords, reg);
+                mark_fanout(l.node);
+            }
+        }
+
+        eval();
+        m_cycle++;
+    }
+}
+
+
+
+/*
+ * Bit-parallel simulation of many independent test cases at once.
+ *
+ * Every bit of a signal is stored as a row of words holding that bit for
+ * all the cases, one case per bit position (bit slicing). Bitwise
+ * operations then handle 64 cases per word, additions and comparisons
+ * become gate-level ripple chains over the rows, and slice() and cat()
+ * just move rows. The rows are contiguous, so the loops over a row
+ * vectorize to whatever SIMD width the target offers.
+ *
+ * Values go in and out either per case or, through a 64x64 transpose, for
+ * a whole batch of cases at once. Every eval() runs the whole netlist,
+ * since with many cases almost every signal changes anyway.
+ */
+class parallel_simulator
+{
+private:
+    using Word = uint64_t;
+    using signal = netlist::signal;
+    using op = netlist::op;
+
+    struct instr {
+        op kind;
+        std::size_t dst;
+        std::size_t width;
+        std::array<std::size_t, 3> args;
+        /* Width of the operands, lowest bit of a slice */
+        std::size_t param;
+    };
+
+    struct latch {
+        std::size_t reg;
+        std::size_t next;
+        std::size_t stage;
+        std::size_t nwords;
+    };
+
+    std::size_t m_cases;
+    /* Words in a row, i.e. per bit of a signal */
+    std::size_t m_row;
+
+    std::vector<netlist::node> m_nodes;
+    std::vector<Word> m_arena;
+    std::vector<std::size_t> m_offset;
+    std::vector<instr> m_code;
+    std::vector<latch> m_latches;
+    std::vector<Word> m_carry;
+    uint64_t m_cycle;
+    /* Whether no input changed since the last eval() */
+    bool m_settled;
+
+    Word *row(signal s, std::size_t bit)
+    {
+        return m_arena.data() + m_offset[s] + bit * m_row;
+    }
+    const Word *row(signal s, std::size_t bit) const
+    {
+        return m_arena.data() + m_offset[s] + bit * m_row;
+    }
+
+    void check_case(signal s, std::size_t c) const;
+    /* Carry out of a + b + carry over width rows, sum to dst if given */
+    void ripple(const Word *a,
+                const Word *b,
+                bool invert_b,
+                std::size_t width,
+                Word *dst);
+    void exec(const instr &in);
+
+public:
+    parallel_simulator(const netlist &nl, std::size_t cases = 64);
+
+    std::size_t cases() const { return m_cases; }
+
+    /* Set or get the value of one case */
+    void poke(signal s, std::size_t c, const bits_view &v);
+    bits peek(signal s, std::size_t c) const;
+    /* Set or get every case, values[c] being case c */
+    void poke(signal s, const std::vector<bits> &values);
+    std::vector<bits> peek(signal s) const;
+
+    void eval();
+    void step(uint64_t cycles = 1);
+
+    uint64_t cycle() const { return m_cycle; }
+};
+
+
+parallel_simulator::parallel_simulator(const netlist &nl, std::size_t cases)
+    : m_cases{cases},
+      m_row{(cases + 63) / 64},
+      m_nodes(nl.size()),
+      m_offset(nl.size()),
+      m_carry(m_row),
+      m_cycle{0},
+      m_settled{false}
+{
+    if (cases == 0) {
+        throw std::invalid_argument("The number of cases must be positive");
+    }
+
+    std::size_t size = 0;
+    for (signal s = 0; s < nl.size(); s++) {
+        m_nodes[s] = nl[s];
+        m_offset[s] = size;
+        size += nl.width(s) * m_row;
+    }
+    for (signal s = 0; s < nl.size(); s++) {
+        if (nl[s].kind != op::reg) {
+            continue;
+        }
+        if (nl[s].args[0] >= nl.size()) {
+            throw std::logic_error("Register is not connected");
+        }
+        m_latches.push_back(latch{m_offset[s], m_offset[nl[s].args[0]], size,
+                                  nl.width(s) * m_row});
+        size += nl.width(s) * m_row;
+    }
+    m_arena.assign(size, 0);
+
+    /* Constants and initial values are the same in every case */
+    for (signal s = 0; s < nl.size(); s++) {
+        if (nl[s].kind != op::constant && nl[s].kind != op::reg) {
+            continue;
+        }
+        for (std::size_t i = 0; i < nl.width(s); i++) {
+            std::fill_n(row(s, i), m_row, nl[s].value.test(i) ? ~Word{0} : 0);
+        }
+    }
+
+    for (signal s : nl.levelize()) {
+        const auto &nd = m_nodes[s];
+        instr in{};
+        in.kind = nd.kind;
+        in.dst = m_offset[s];
+        in.width = nd.width;
+        in.param = nd.kind == op::slice ? nd.lo : m_nodes[nd.args[0]].width;
+        if (nd.kind == op::cat) {
+            in.param = m_nodes[nd.args[1]].width;
+        }
+        for (std::size_t j = 0; j < netlist::num_args(nd.kind); j++) {
+            in.args[j] = m_offset[nd.args[j]];
+        }
+        m_code.push_back(in);
+    }
+    eval();
+}
+
+void parallel_simulator::check_case(signal s, std::size_t c) const
+{
+    if (s >= m_nodes.size() || c >= m_cases) {
+        throw std::out_of_range("Position is out of range");
+    }
+}
+
+void parallel_simulator::ripple(const Word *a,
+                                const Word *b,
+                                bool invert_b,
+                                std::size_t width,
+                                Word *dst)
+{
+    Word inv = invert_b ? ~Word{0} : 0;
+    std::fill(m_carry.begin(), m_carry.end(), inv);
+    for (std::size_t i = 0; i < width; i++) {
+        for (std::size_t k = 0; k < m_row; k++) {
+            Word x = a[i * m_row + k], y = b[i * m_row + k] ^ inv;
+            Word c = m_carry[k];
+            if (dst) {
+                dst[i * m_row + k] = x ^ y ^ c;
+            }
+            m_carry[k] = (x & y) | (c & (x ^ y));
+        }
+    }
+}
+
+void parallel_simulator::exec(const instr &in)
+{
+    const Word *a = m_arena.data() + in.args[0];
+    const Word *b = m_arena.data() + in.args[1];
+    const Word *c = m_arena.data() + in.args[2];
+    Word *d = m_arena.data() + in.dst;
+    std::size_t n = in.width * m_row;
+
+    switch (in.kind) {
+    case op::bit_and:
+        for (std::size_t i = 0; i < n; i++) {
+            d[i] = a[i] & b[i];
+        }
+        break;
+    case op::bit_or:
+        for (std::size_t i = 0; i < n; i++) {
+            d[i] = a[i] | b[i];
+        }
+        break;
+    case op::bit_xor:
+        for (std::size_t i = 0; i < n; i++) {
+            d[i] = a[i] ^ b[i];
+        }
+        break;
+    case op::bit_not:
+        for (std::size_t i = 0; i < n; i++) {
+            d[i] = ~a[i];
+        }
+        break;
+    case op::add:
+    case op::sub:
+        /* a - b is a + ~b + 1 */
+        ripple(a, b, in.kind == op::sub, in.width, d);
+        break;
+    case op::eq:
+        std::fill_n(d, m_row, 0);
+        for (std::size_t i = 0; i < in.param * m_row; i++) {
+            d[i % m_row] |= a[i] ^ b[i];
+        }
+        for (std::size_t k = 0; k < m_row; k++) {
+            d[k] = ~d[k];
+        }
+        break;
+    case op::lt:
+        /* a < b exactly when a - b borrows */
+        ripple(a, b, true, in.param, nullptr);
+        for (std::size_t k = 0; k < m_row; k++) {
+            d[k] = ~m_carry[k];
+        }
+        break;
+    case op::mux:
+        /* The select is a, the inputs are b and c */
+        for (std::size_t i = 0; i < n; i++) {
+            Word m = a[i % m_row];
+            d[i] = c[i] ^ ((b[i] ^ c[i]) & m);
+        }
+        break;
+    case op::slice:
+        std::copy_n(a + in.param * m_row, n, d);
+        break;
+    case op::cat:
+        std::copy_n(b, in.param * m_row, d);
+        std::copy_n(a, n - in.param * m_row, d + in.param * m_row);
+        break;
+    default:
+        break;
+    }
+}
+
+void parallel_simulator::poke(signal s, std::size_t c, const bits_view &v)
+{
+    check_case(s, c);
+    if (m_nodes[s].kind != op::input) {
+        throw std::invalid_argument("Only inputs can be poked");
+    }
+    if (v.width() != m_nodes[s].width) {
+        throw std::invalid_argument("The width of bits must be the same");
+    }
+
+    m_settled = false;
+    Word bit = Word{1} << (c % 64);
+    for (std::size_t i = 0; i < v.width(); i++) {
+        Word &w = row(s, i)[c / 64];
+        w = v[i] ? w | bit : w & ~bit;
+    }
+}
+
+bits parallel_simulator::peek(signal s, std::size_t c) const
+{
+    check_case(s, c);
+    bits b{m_nodes[s].width, 0};
+    for (std::size_t i = 0; i < b.width(); i++) {
+        b.set(i, (row(s, i)[c / 64] >> (c % 64)) & 1);
+    }
+    return b;
+}
+
+void parallel_simulator::poke(signal s, const std::vector<bits> &values)
+{
+    check_case(s, 0);
+    if (values.size() != m_cases) {
+        throw std::invalid_argument("A value is needed for every case");
+    }
+    for (std::size_t c = 0; c < m_cases; c++) {
+        if (values[c].width() != m_nodes[s].width) {
+            throw std::invalid_argument("The width of bits must be the same");
+        }
+    }
+    if (m_nodes[s].kind != op::input) {
+        throw std::invalid_argument("Only inputs can be poked");
+    }
+
+    m_settled = false;
+
+    /* 64 cases by 64 bits at a time, transposed into 64 rows */
+    std::size_t len = m_nodes[s].width;
+    Word tile[64];
+    for (std::size_t g = 0; g < m_row; g++) {
+        for (std::size_t pos = 0; pos < len; pos += 64) {
+            for (std::size_t j = 0; j < 64; j++) {
+                std::size_t c = g * 64 + j;
+                tile[j] = c < m_cases ? values[c].get_nbits(pos, 64) : 0;
+            }
+            utils::transpose64(tile);
+            for (std::size_t i = 0; i < 64 && pos + i < len; i++) {
+                row(s, pos + i)[g] = tile[i];
+            }
+        }
+    }
+}
+
+std::vector<bits> parallel_simulator::peek(signal s) const
+{
+    check_case(s, 0);
+    std::size_t len = m_nodes[s].width;
+    std::vector<bits> values(m_cases, bits{len, 0});
+
+    Word tile[64];
+    for (std::size_t g = 0; g < m_row; g++) {
+        for (std::size_t pos = 0; pos < len; pos += 64) {
+            for (std::size_t i = 0; i < 64; i++) {
+                tile[i] = pos + i < len ? row(s, pos + i)[g] : 0;
+            }
+            utils::transpose64(tile);
+            std::size_t n = std::min<std::size_t>(64, len - pos);
+            for (std::size_t j = 0; j < 64 && g * 64 + j < m_cases; j++) {
+                values[g * 64 + j].set_nbits(tile[j], pos, n);
+            }
+        }
+    }
+    return values;
+}
+
+void parallel_simulator::eval()
+{
+    for (const auto &in : m_code) {
+        exec(in);
+    }
+    m_settled = true;
+}
+
+void parallel_simulator::step(uint64_t cycles)
+{
+    Word *arena = m_arena.data();
+    for (; cycles > 0; cycles--) {
+        if (!m_settled) {
+            eval();
+        }
+        for (const auto &l : m_latches) {
+            std::copy_n(arena + l.next, l.nwords, arena + l.stage);
+        }
+        for (const auto &l : m_latches) {
+            std::copy_n(arena + l.stage, l.nwords, arena + l.reg);
+        }
+        eval();
+        m_cycle++;
+    }
+}
+
+}  // namespace bitsel
+
+
+#endif  // INCLUDE_BITSEL_SIM_HPP_
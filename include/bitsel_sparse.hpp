@@ -0,0 +1,725 @@
+#ifndef INCLUDE_BITSEL_SPARSE_HPP_
+#define INCLUDE_BITSEL_SPARSE_HPP_
+
+#include <algorithm>
+#include <cstddef>  // for size_t
+#include <iterator>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include "bitsel.hpp"
+
+
+namespace bitsel
+{
+
+/*
+ * A compressed sequence of bits in the style of Roaring bitmaps.
+ *
+ * The bits are split into chunks of 65536 bits. Empty chunks are not
+ * stored and every other chunk picks the smallest of three containers:
+ *   - array:  sorted positions of the set bits (up to 4096 of them)
+ *   - bitmap: 1024 plain 64-bit words
+ *   - run:    sorted [first, last] ranges of set bits
+ * Bitwise operations work chunk by chunk on the containers directly.
+ */
+class sparse_bits
+{
+private:
+    static constexpr std::size_t chunk_bits = 1 << 16;
+    static constexpr std::size_t chunk_words = chunk_bits / 64;
+    static constexpr std::size_t array_max = 4096;
+
+    using Words = std::vector<uint64_t>;
+
+    struct chunk {
+        enum class kind { array, bitmap, run };
+
+        std::size_t key;
+        kind type;
+        std::size_t card;
+        std::vector<uint16_t> values;
+        Words words;
+        std::vector<std::pair<uint16_t, uint16_t>> runs;
+
+        bool contains(uint16_t v) const;
+        Words to_words() const;
+        /* Call f(i, w) for the words i of the chunk that have bits set */
+        template <typename F>
+        void for_each_word(F f) const;
+        std::size_t size_in_bytes() const;
+
+        static chunk from_words(std::size_t key, const Words &w);
+        static chunk from_array(std::size_t key, std::vector<uint16_t> v);
+        static chunk from_runs(std::size_t key,
+                               std::vector<std::pair<uint16_t, uint16_t>> r);
+    };
+
+    std::vector<chunk> m_chunks;
+    std::size_t m_len;
+
+    std::vector<chunk>::iterator find_chunk(std::size_t key);
+    std::vector<chunk>::const_iterator find_chunk(std::size_t key) const;
+    Words dense_words(const bits_view &b, std::size_t key) const;
+    /* Set or clear v in a run container, v currently the other value */
+    static void set_run(chunk &c, uint16_t v, bool val);
+
+    static chunk and_chunk(const chunk &a, const chunk &b);
+    static chunk or_chunk(const chunk &a, const chunk &b);
+    static chunk xor_chunk(const chunk &a, const chunk &b);
+
+    template <typename Op>
+    static sparse_bits merge(const sparse_bits &lhs,
+                             const sparse_bits &rhs,
+                             bool keep_unmatched,
+                             Op op);
+    /* Apply op to a copy of rhs and each word of lhs */
+    template <typename Op>
+    static bits merge_dense(const sparse_bits &lhs,
+                            const bits_view &rhs,
+                            Op op);
+
+public:
+    sparse_bits() : sparse_bits{0} {}
+    explicit sparse_bits(std::size_t len) : m_chunks{}, m_len{len} {}
+    explicit sparse_bits(const bits_view &b);
+
+    std::size_t width() const { return m_len; }
+    bool empty() const { return m_len == 0; }
+
+    bits to_bits() const;
+
+    bool test(std::size_t pos) const;
+    bool operator[](std::size_t pos) const;
+    void set(std::size_t pos, bool val);
+    std::size_t count() const;
+
+    /* Approximate heap footprint of the containers */
+    std::size_t size_in_bytes() const;
+
+    bool operator==(const sparse_bits &) const;
+
+    sparse_bits &operator&=(const sparse_bits &);
+    sparse_bits &operator|=(const sparse_bits &);
+    sparse_bits &operator^=(const sparse_bits &);
+    sparse_bits &operator&=(const bits_view &);
+
+    friend sparse_bits operator&(const sparse_bits &, const sparse_bits &);
+    friend sparse_bits operator|(const sparse_bits &, const sparse_bits &);
+    friend sparse_bits operator^(const sparse_bits &, const sparse_bits &);
+    friend bits operator|(const sparse_bits &, const bits_view &);
+    friend bits operator^(const sparse_bits &, const bits_view &);
+};
+
+
+bool sparse_bits::chunk::contains(uint16_t v) const
+{
+    switch (type) {
+    case kind::array:
+        return std::binary_search(values.begin(), values.end(), v);
+    case kind::bitmap:
+        return static_cast<bool>((words[v / 64] >> (v % 64)) & 1);
+    case kind::run: {
+        auto it = std::upper_bound(
+            runs.begin(), runs.end(), v,
+            [](uint16_t x, const std::pair<uint16_t, uint16_t> &r) {
+                return x < r.first;
+            });
+        return it != runs.begin() && v <= std::prev(it)->second;
+    }
+    }
+    return false;
+}
+
+sparse_bits::Words sparse_bits::chunk::to_words() const
+{
+    if (type == kind::bitmap) {
+        return words;
+    }
+
+    Words w(chunk_words, 0);
+    for_each_word([&w](std::size_t i, uint64_t x) { w[i] |= x; });
+    return w;
+}
+
+template <typename F>
+void sparse_bits::chunk::for_each_word(F f) const
+{
+    switch (type) {
+    case kind::array:
+        /* Gather the values that share a word */
+        for (std::size_t j = 0; j < values.size();) {
+            std::size_t i = values[j] / 64;
+            uint64_t x = 0;
+            for (; j < values.size() && values[j] / 64 == i; j++) {
+                x |= 1ULL << (values[j] % 64);
+            }
+            f(i, x);
+        }
+        break;
+    case kind::bitmap:
+        for (std::size_t i = 0; i < chunk_words; i++) {
+            if (words[i] != 0) {
+                f(i, words[i]);
+            }
+        }
+        break;
+    case kind::run:
+        /* Runs never touch, but two of them may share a word */
+        for (const auto &r : runs) {
+            std::size_t s = r.first, e = r.second;
+            for (std::size_t i = s / 64; i <= e / 64; i++) {
+                uint64_t lo = i == s / 64 ? ~0ULL << (s % 64) : ~0ULL;
+                uint64_t hi = i == e / 64 ? ~0ULL >> (63 - e % 64) : ~0ULL;
+                f(i, lo & hi);
+            }
+        }
+        break;
+    }
+}
+
+std::size_t sparse_bits::chunk::size_in_bytes() const
+{
+    return values.size() * sizeof(uint16_t) + words.size() * sizeof(uint64_t) +
+           runs.size() * sizeof(runs[0]);
+}
+
+sparse_bits::chunk sparse_bits::chunk::from_words(std::size_t key,
+                                                  const Words &w)
+{
+    std::size_t card = 0, num_runs = 0;
+    uint64_t carry = 0;
+    for (auto x : w) {
+        card += __builtin_popcountll(x);
+        /* A run starts at every set bit whose predecessor is clear */
+        num_runs += __builtin_popcountll(x & ~(x << 1 | carry));
+        carry = x >> 63;
+    }
+
+    chunk c{key, kind::bitmap, card, {}, {}, {}};
+    std::size_t array_bytes = card * sizeof(uint16_t);
+    std::size_t run_bytes = num_runs * sizeof(c.runs[0]);
+    std::size_t bitmap_bytes = chunk_words * sizeof(uint64_t);
+
+    if (run_bytes < std::min(array_bytes, bitmap_bytes)) {
+        c.type = kind::run;
+        c.runs.reserve(num_runs);
+        /* Starts and ends come in order, each end closing the oldest run */
+        std::size_t closed = 0;
+        carry = 0;
+        for (std::size_t i = 0; i < chunk_words; i++) {
+            uint64_t x = w[i];
+            uint64_t next = i + 1 < chunk_words ? w[i + 1] & 1 : 0;
+            for (uint64_t y = x & ~(x << 1 | carry); y != 0; y &= y - 1) {
+                auto b = static_cast<uint16_t>(i * 64 + __builtin_ctzll(y));
+                c.runs.emplace_back(b, b);
+            }
+            for (uint64_t y = x & ~(x >> 1 | next << 63); y != 0; y &= y - 1) {
+                c.runs[closed++].second =
+                    static_cast<uint16_t>(i * 64 + __builtin_ctzll(y));
+            }
+            carry = x >> 63;
+        }
+    } else if (card <= array_max) {
+        c.type = kind::array;
+        c.values.reserve(card);
+        for (std::size_t i = 0; i < chunk_words; i++) {
+            for (uint64_t x = w[i]; x != 0; x &= x - 1) {
+                c.values.push_back(
+                    static_cast<uint16_t>(i * 64 + __builtin_ctzll(x)));
+            }
+        }
+    } else {
+        c.words = w;
+    }
+    return c;
+}
+
+sparse_bits::chunk sparse_bits::chunk::from_array(std::size_t key,
+                                                  std::vector<uint16_t> v)
+{
+    if (v.size() > array_max) {
+        chunk c{key, kind::array, v.size(), std::move(v), {}, {}};
+        return from_words(key, c.to_words());
+    }
+    return chunk{key, kind::array, v.size(), std::move(v), {}, {}};
+}
+
+sparse_bits::chunk sparse_bits::chunk::from_runs(
+    std::size_t key,
+    std::vector<std::pair<uint16_t, uint16_t>> r)
+{
+    std::size_t card = 0;
+    for (const auto &x : r) {
+        card += x.second - x.first + 1;
+    }
+    chunk c{key, kind::run, card, {}, {}, std::move(r)};
+
+    /* Fall back to a denser container when runs do not pay off */
+    std::size_t run_bytes = c.runs.size() * sizeof(c.runs[0]);
+    if (run_bytes >= std::min(card * sizeof(uint16_t),
+                              chunk_words * sizeof(uint64_t))) {
+        return from_words(key, c.to_words());
+    }
+    return c;
+}
+
+sparse_bits::sparse_bits(const bits_view &b) : m_chunks{}, m_len{b.width()}
+{
+    for (std::size_t key = 0; key * chunk_bits < m_len; key++) {
+        Words w = dense_words(b, key);
+        if (std::any_of(w.begin(), w.end(), [](uint64_t x) { return x; })) {
+            m_chunks.push_back(chunk::from_words(key, w));
+        }
+    }
+}
+
+sparse_bits::Words sparse_bits::dense_words(const bits_view &b,
+                                            std::size_t key) const
+{
+    Words w(chunk_words, 0);
+    std::size_t base = key * chunk_bits;
+    for (std::size_t i = 0; i < chunk_words && base + i * 64 < b.width();
+         i++) {
+        w[i] = b.get_nbits(base + i * 64, 64);
+    }
+    return w;
+}
+
+std::vector<sparse_bits::chunk>::iterator sparse_bits::find_chunk(
+    std::size_t key)
+{
+    return std::lower_bound(
+        m_chunks.begin(), m_chunks.end(), key,
+        [](const chunk &c, std::size_t k) { return c.key < k; });
+}
+
+std::vector<sparse_bits::chunk>::const_iterator sparse_bits::find_chunk(
+    std::size_t key) const
+{
+    return std::lower_bound(
+        m_chunks.begin(), m_chunks.end(), key,
+        [](const chunk &c, std::size_t k) { return c.key < k; });
+}
+
+bits sparse_bits::to_bits() const
+{
+    bits b{m_len, 0};
+    for (const auto &c : m_chunks) {
+        Words w = c.to_words();
+        for (std::size_t i = 0; i < chunk_words; i++) {
+            if (w[i] != 0) {
+                b.set_nbits(w[i], c.key * chunk_bits + i * 64, 64);
+            }
+        }
+    }
+    return b;
+}
+
+bool sparse_bits::test(std::size_t pos) const
+{
+    if (pos >= m_len) {
+        throw std::out_of_range("Position is out of range");
+    }
+    return this->operator[](pos);
+}
+
+bool sparse_bits::operator[](std::size_t pos) const
+{
+    auto it = find_chunk(pos / chunk_bits);
+    if (it == m_chunks.end() || it->key != pos / chunk_bits) {
+        return false;
+    }
+    return it->contains(static_cast<uint16_t>(pos % chunk_bits));
+}
+
+void sparse_bits::set(std::size_t pos, bool val)
+{
+    if (pos >= m_len) {
+        throw std::out_of_range("Position is out of range");
+    }
+    if (this->operator[](pos) == val) {
+        return;
+    }
+
+    std::size_t key = pos / chunk_bits;
+    auto v = static_cast<uint16_t>(pos % chunk_bits);
+    auto it = find_chunk(key);
+    if (it == m_chunks.end() || it->key != key) {
+        m_chunks.insert(it, chunk::from_array(key, {v}));
+        return;
+    }
+
+    /* Edit the container in place and only re-pick it at a threshold */
+    chunk &c = *it;
+    if (val) {
+        c.card++;
+    } else {
+        c.card--;
+    }
+    if (c.type == chunk::kind::array) {
+        auto vit = std::lower_bound(c.values.begin(), c.values.end(), v);
+        if (val) {
+            c.values.insert(vit, v);
+        } else {
+            c.values.erase(vit);
+        }
+        if (c.card > array_max) {
+            c = chunk::from_words(key, c.to_words());
+        }
+    } else if (c.type == chunk::kind::bitmap) {
+        c.words[v / 64] ^= 1ULL << (v % 64);
+        if (c.card <= array_max) {
+            c = chunk::from_words(key, c.words);
+        }
+    } else {
+        set_run(c, v, val);
+        std::size_t run_bytes = c.runs.size() * sizeof(c.runs[0]);
+        if (run_bytes >= std::min(c.card * sizeof(uint16_t),
+                                  chunk_words * sizeof(uint64_t))) {
+            c = chunk::from_words(key, c.to_words());
+        }
+    }
+
+    if (it->card == 0) {
+        m_chunks.erase(it);
+    }
+}
+
+void sparse_bits::set_run(chunk &c, uint16_t v, bool val)
+{
+    auto &runs = c.runs;
+    /* The first run that starts after v */
+    auto it = std::upper_bound(
+        runs.begin(), runs.end(), v,
+        [](uint16_t x, const std::pair<uint16_t, uint16_t> &r) {
+            return x < r.first;
+        });
+
+    if (!val) {
+        /* v lies in the run before it: shrink, drop or split that run */
+        auto &r = *std::prev(it);
+        if (r.first == r.second) {
+            runs.erase(std::prev(it));
+        } else if (v == r.first) {
+            r.first++;
+        } else if (v == r.second) {
+            r.second--;
+        } else {
+            uint16_t last = r.second;
+            r.second = v - 1;
+            runs.emplace(it, v + 1, last);
+        }
+        return;
+    }
+
+    bool joins_prev = it != runs.begin() && std::prev(it)->second + 1 == v;
+    bool joins_next = it != runs.end() && v + 1 == it->first;
+    if (joins_prev && joins_next) {
+        std::prev(it)->second = it->second;
+        runs.erase(it);
+    } else if (joins_prev) {
+        std::prev(it)->second = v;
+    } else if (joins_next) {
+        it->first = v;
+    } else {
+        runs.emplace(it, v, v);
+    }
+}
+
+std::size_t sparse_bits::count() const
+{
+    std::size_t res = 0;
+    for (const auto &c : m_chunks) {
+        res += c.card;
+    }
+    return res;
+}
+
+std::size_t sparse_bits::size_in_bytes() const
+{
+    std::size_t res = m_chunks.size() * sizeof(chunk);
+    for (const auto &c : m_chunks) {
+        res += c.size_in_bytes();
+    }
+    return res;
+}
+
+bool sparse_bits::operator==(const sparse_bits &rhs) const
+{
+    if (m_len != rhs.m_len || m_chunks.size() != rhs.m_chunks.size()) {
+        return false;
+    }
+    for (std::size_t i = 0; i < m_chunks.size(); i++) {
+        const chunk &a = m_chunks[i], &b = rhs.m_chunks[i];
+        if (a.key != b.key || a.card != b.card) {
+            return false;
+        }
+        if (a.type == b.type && a.type == chunk::kind::array) {
+            if (a.values != b.values) {
+                return false;
+            }
+        } else if (a.to_words() != b.to_words()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+sparse_bits::chunk sparse_bits::and_chunk(const chunk &a, const chunk &b)
+{
+    using kind = chunk::kind;
+
+    if (a.type == kind::array || b.type == kind::array) {
+        const chunk &arr = a.type == kind::array ? a : b;
+        const chunk &other = a.type == kind::array ? b : a;
+        std::vector<uint16_t> v;
+        if (other.type == kind::array) {
+            std::set_intersection(arr.values.begin(), arr.values.end(),
+                                  other.values.begin(), other.values.end(),
+                                  std::back_inserter(v));
+        } else {
+            std::copy_if(arr.values.begin(), arr.values.end(),
+                         std::back_inserter(v),
+                         [&other](uint16_t x) { return other.contains(x); });
+        }
+        return chunk::from_array(a.key, std::move(v));
+    }
+
+    if (a.type == kind::run && b.type == kind::run) {
+        std::vector<std::pair<uint16_t, uint16_t>> r;
+        for (std::size_t i = 0, j = 0;
+             i < a.runs.size() && j < b.runs.size();) {
+            uint16_t s = std::max(a.runs[i].first, b.runs[j].first);
+            uint16_t e = std::min(a.runs[i].second, b.runs[j].second);
+            if (s <= e) {
+                r.emplace_back(s, e);
+            }
+            if (a.runs[i].second < b.runs[j].second) {
+                i++;
+            } else {
+                j++;
+            }
+        }
+        return chunk::from_runs(a.key, std::move(r));
+    }
+
+    Words w = a.to_words();
+    Words x = b.to_words();
+    for (std::size_t i = 0; i < chunk_words; i++) {
+        w[i] &= x[i];
+    }
+    return chunk::from_words(a.key, w);
+}
+
+sparse_bits::chunk sparse_bits::or_chunk(const chunk &a, const chunk &b)
+{
+    using kind = chunk::kind;
+
+    if (a.type == kind::array && b.type == kind::array) {
+        std::vector<uint16_t> v;
+        std::set_union(a.values.begin(), a.values.end(), b.values.begin(),
+                       b.values.end(), std::back_inserter(v));
+        return chunk::from_array(a.key, std::move(v));
+    }
+
+    if (a.type == kind::run && b.type == kind::run) {
+        std::vector<std::pair<uint16_t, uint16_t>> all, r;
+        std::merge(a.runs.begin(), a.runs.end(), b.runs.begin(), b.runs.end(),
+                   std::back_inserter(all));
+        for (const auto &x : all) {
+            if (!r.empty() && x.first <= r.back().second + 1) {
+                r.back().second = std::max(r.back().second, x.second);
+            } else {
+                r.push_back(x);
+            }
+        }
+        return chunk::from_runs(a.key, std::move(r));
+    }
+
+    Words w = a.to_words();
+    if (b.type == kind::array) {
+        for (auto v : b.values) {
+            w[v / 64] |= 1ULL << (v % 64);
+        }
+    } else {
+        Words x = b.to_words();
+        for (std::size_t i = 0; i < chunk_words; i++) {
+            w[i] |= x[i];
+        }
+    }
+    return chunk::from_words(a.key, w);
+}
+
+sparse_bits::chunk sparse_bits::xor_chunk(const chunk &a, const chunk &b)
+{
+    using kind = chunk::kind;
+
+    if (a.type == kind::array && b.type == kind::array) {
+        std::vector<uint16_t> v;
+        std::set_symmetric_difference(a.values.begin(), a.values.end(),
+                                      b.values.begin(), b.values.end(),
+                                      std::back_inserter(v));
+        return chunk::from_array(a.key, std::move(v));
+    }
+
+    Words w = a.to_words();
+    if (b.type == kind::array) {
+        for (auto v : b.values) {
+            w[v / 64] ^= 1ULL << (v % 64);
+        }
+    } else {
+        Words x = b.to_words();
+        for (std::size_t i = 0; i < chunk_words; i++) {
+            w[i] ^= x[i];
+        }
+    }
+    return chunk::from_words(a.key, w);
+}
+
+template <typename Op>
+sparse_bits sparse_bits::merge(const sparse_bits &lhs,
+                               const sparse_bits &rhs,
+                               bool keep_unmatched,
+                               Op op)
+{
+    sparse_bits res{std::max(lhs.m_len, rhs.m_len)};
+    auto it = lhs.m_chunks.begin(), jt = rhs.m_chunks.begin();
+
+    while (it != lhs.m_chunks.end() || jt != rhs.m_chunks.end()) {
+        if (jt == rhs.m_chunks.end() ||
+            (it != lhs.m_chunks.end() && it->key < jt->key)) {
+            if (keep_unmatched) {
+                res.m_chunks.push_back(*it);
+            }
+            ++it;
+        } else if (it == lhs.m_chunks.end() || jt->key < it->key) {
+            if (keep_unmatched) {
+                res.m_chunks.push_back(*jt);
+            }
+            ++jt;
+        } else {
+            chunk c = op(*it, *jt);
+            if (c.card != 0) {
+                res.m_chunks.push_back(std::move(c));
+            }
+            ++it;
+            ++jt;
+        }
+    }
+    return res;
+}
+
+sparse_bits operator&(const sparse_bits &lhs, const sparse_bits &rhs)
+{
+    return sparse_bits::merge(lhs, rhs, false, sparse_bits::and_chunk);
+}
+
+sparse_bits operator|(const sparse_bits &lhs, const sparse_bits &rhs)
+{
+    return sparse_bits::merge(lhs, rhs, true, sparse_bits::or_chunk);
+}
+
+sparse_bits operator^(const sparse_bits &lhs, const sparse_bits &rhs)
+{
+    return sparse_bits::merge(lhs, rhs, true, sparse_bits::xor_chunk);
+}
+
+sparse_bits &sparse_bits::operator&=(const sparse_bits &rhs)
+{
+    *this = *this & rhs;
+    return *this;
+}
+
+sparse_bits &sparse_bits::operator|=(const sparse_bits &rhs)
+{
+    *this = *this | rhs;
+    return *this;
+}
+
+sparse_bits &sparse_bits::operator^=(const sparse_bits &rhs)
+{
+    *this = *this ^ rhs;
+    return *this;
+}
+
+sparse_bits &sparse_bits::operator&=(const bits_view &rhs)
+{
+    /* Only chunks present on this side can survive */
+    std::vector<chunk> res;
+    for (const auto &c : m_chunks) {
+        chunk d;
+        if (c.type == chunk::kind::array) {
+            std::vector<uint16_t> v;
+            std::size_t base = c.key * chunk_bits;
+            std::copy_if(c.values.begin(), c.values.end(),
+                         std::back_inserter(v), [&](uint16_t x) {
+                             return base + x < rhs.width() && rhs[base + x];
+                         });
+            d = chunk::from_array(c.key, std::move(v));
+        } else {
+            Words w = c.to_words();
+            Words x = dense_words(rhs, c.key);
+            for (std::size_t i = 0; i < chunk_words; i++) {
+                w[i] &= x[i];
+            }
+            d = chunk::from_words(c.key, w);
+        }
+        if (d.card != 0) {
+            res.push_back(std::move(d));
+        }
+    }
+    m_chunks = std::move(res);
+    m_len = std::max(m_len, rhs.width());
+    return *this;
+}
+
+sparse_bits operator&(sparse_bits lhs, const bits_view &rhs)
+{
+    lhs &= rhs;
+    return lhs;
+}
+
+sparse_bits operator&(const bits_view &lhs, sparse_bits rhs)
+{
+    rhs &= lhs;
+    return rhs;
+}
+
+template <typename Op>
+bits sparse_bits::merge_dense(const sparse_bits &lhs,
+                              const bits_view &rhs,
+                              Op op)
+{
+    bits res = rhs.to_bits();
+    if (res.width() < lhs.m_len) {
+        res = res.zext(lhs.m_len);
+    }
+    for (const auto &c : lhs.m_chunks) {
+        std::size_t base = c.key * chunk_bits;
+        c.for_each_word([&](std::size_t i, uint64_t x) {
+            std::size_t pos = base + i * 64;
+            res.set_nbits(op(res.get_nbits(pos, 64), x), pos, 64);
+        });
+    }
+    return res;
+}
+
+/* OR and XOR against dense bits are dense, so they produce bits */
+bits operator|(const sparse_bits &lhs, const bits_view &rhs)
+{
+    return sparse_bits::merge_dense(
+        lhs, rhs, [](uint64_t a, uint64_t b) { return a | b; });
+}
+
+bits operator^(const sparse_bits &lhs, const bits_view &rhs)
+{
+    return sparse_bits::merge_dense(
+        lhs, rhs, [](uint64_t a, uint64_t b) { return a ^ b; });
+}
+
+}  // namespace bitsel
+
+
+#endif  // INCLUDE_BITSEL_SPARSE_HPP_
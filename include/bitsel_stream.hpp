@@ -0,0 +1,421 @@
+#ifndef INCLUDE_BITSEL_STREAM_HPP_
+#define INCLUDE_BITSEL_STREAM_HPP_
+
+#include <cstddef>  // for size_t
+#include <cstring>  // for memcpy
+#include <iostream>
+#include <limits>
+#include <stdexcept>
+#include <vector>
+
+#include "bitsel.hpp"
+
+
+namespace bitsel
+{
+
+/*
+ * How fields are packed into bytes:
+ *   - lsb_first: bit 0 of byte 0 comes first, fields are little-endian
+ *   - msb_first: bit 7 of byte 0 comes first, fields are big-endian
+ */
+enum class bit_order { lsb_first, msb_first };
+
+
+namespace utils
+{
+
+/* Load 8 bytes as a word whose first byte holds the first bits */
+template <bit_order Order>
+uint64_t load_stream_word(const uint8_t *p)
+{
+    uint64_t w;
+    std::memcpy(&w, p, sizeof(w));
+    if ((Order == bit_order::lsb_first) != is_little_endian) {
+        w = __builtin_bswap64(w);
+    }
+    return w;
+}
+
+template <bit_order Order>
+void store_stream_word(uint8_t *p, uint64_t w)
+{
+    if ((Order == bit_order::lsb_first) != is_little_endian) {
+        w = __builtin_bswap64(w);
+    }
+    std::memcpy(p, &w, sizeof(w));
+}
+
+}  // namespace utils
+
+
+/*
+ * Sequential reader of variable-length fields from bits, a byte buffer or
+ * an input stream. Bits are staged in a 64-bit buffer which is refilled a
+ * word at a time, so each field costs a shift and a mask.
+ *
+ * bits and bits_view sources are read as their little-endian byte stream.
+ */
+template <bit_order Order = bit_order::lsb_first>
+class bit_reader
+{
+private:
+    static constexpr std::size_t word_size = 64;
+    static constexpr std::size_t chunk_size = 4096;
+
+    const uint8_t *m_ptr;
+    const uint8_t *m_end;
+    uint64_t m_buf;
+    std::size_t m_avail;
+    std::size_t m_pos;
+    std::size_t m_limit;
+
+    std::istream *m_is;
+    std::vector<uint8_t> m_chunk;
+
+    bool fetch();
+    void refill();
+    uint64_t take(std::size_t n);
+
+public:
+    bit_reader(const uint8_t *data, std::size_t size);
+    explicit bit_reader(bits_view v);
+    explicit bit_reader(std::istream &is);
+
+    bit_reader(const bit_reader &) = delete;
+    bit_reader &operator=(const bit_reader &) = delete;
+
+    /* Number of bits consumed so far */
+    std::size_t position() const { return m_pos; }
+    /* Whether every bit has been consumed (always false for streams) */
+    bool eof() const { return m_pos == m_limit; }
+
+    uint64_t read(std::size_t n);
+    bool read_bit() { return static_cast<bool>(read(1)); }
+    bits read_bits(std::size_t n);
+    void skip(std::size_t n);
+};
+
+/*
+ * Sequential writer of variable-length fields into bits, a byte buffer or
+ * an output stream. Whole 64-bit words are emitted at once; flush() pushes
+ * out the remaining bits and moves to the next byte boundary.
+ *
+ * Writing into bits or a buffer overwrites bits in place and leaves the
+ * unwritten part of the last byte untouched.
+ */
+template <bit_order Order = bit_order::lsb_first>
+class bit_writer
+{
+private:
+    static constexpr std::size_t word_size = 64;
+
+    uint8_t *m_ptr;
+    uint8_t *m_end;
+    uint64_t m_buf;
+    std::size_t m_count;
+    std::size_t m_pos;
+    std::size_t m_limit;
+
+    std::ostream *m_os;
+
+    void emit(uint64_t w);
+
+public:
+    bit_writer(uint8_t *data, std::size_t size);
+    explicit bit_writer(bits &b);
+    explicit bit_writer(std::ostream &os);
+
+    bit_writer(const bit_writer &) = delete;
+    bit_writer &operator=(const bit_writer &) = delete;
+
+    ~bit_writer() { flush(); }
+
+    /* Number of bits written so far */
+    std::size_t position() const { return m_pos; }
+
+    void write(uint64_t val, std::size_t n);
+    void write_bit(bool val) { write(val, 1); }
+    void write_bits(const bits_view &v);
+    void flush();
+};
+
+
+template <bit_order Order>
+bit_reader<Order>::bit_reader(const uint8_t *data, std::size_t size)
+    : m_ptr{data},
+      m_end{data + size},
+      m_buf{0},
+      m_avail{0},
+      m_pos{0},
+      m_limit{size * 8},
+      m_is{nullptr}
+{
+}
+
+template <bit_order Order>
+bit_reader<Order>::bit_reader(bits_view v)
+    : bit_reader{reinterpret_cast<const uint8_t *>(v.data()) + v.offset() / 8,
+                 (v.offset() % 8 + v.width() + 7) / 8}
+{
+    static_assert(utils::is_little_endian,
+                  "byte access to bits requires a little-endian host");
+
+    /* Drop the bits in front of an unaligned view */
+    std::size_t lead = v.offset() % 8;
+    m_limit = lead + v.width();
+    skip(lead);
+    m_limit -= lead;
+    m_pos = 0;
+}
+
+template <bit_order Order>
+bit_reader<Order>::bit_reader(std::istream &is)
+    : m_ptr{nullptr},
+      m_end{nullptr},
+      m_buf{0},
+      m_avail{0},
+      m_pos{0},
+      m_limit{std::numeric_limits<std::size_t>::max()},
+      m_is{&is},
+      m_chunk(chunk_size)
+{
+}
+
+template <bit_order Order>
+bool bit_reader<Order>::fetch()
+{
+    if (m_is == nullptr) {
+        return false;
+    }
+    m_is->read(reinterpret_cast<char *>(m_chunk.data()), m_chunk.size());
+    m_ptr = m_chunk.data();
+    m_end = m_ptr + m_is->gcount();
+    return m_ptr != m_end;
+}
+
+template <bit_order Order>
+void bit_reader<Order>::refill()
+{
+    if (m_end - m_ptr >= 8) {
+        /*
+         * Branchless refill: OR in a whole word and advance by the bytes
+         * that fit. Bits above m_avail are the upcoming stream bits, so
+         * OR-ing them again later is harmless.
+         */
+        uint64_t w = utils::load_stream_word<Order>(m_ptr);
+        m_buf |= Order == bit_order::lsb_first ? w << m_avail : w >> m_avail;
+        std::size_t nbytes = (word_size - 1 - m_avail) / 8;
+        m_ptr += nbytes;
+        m_avail += nbytes * 8;
+        return;
+    }
+
+    while (m_avail <= word_size - 8) {
+        if (m_ptr == m_end && !fetch()) {
+            break;
+        }
+        uint64_t byte = *m_ptr++;
+        m_buf |= Order == bit_order::lsb_first
+                     ? byte << m_avail
+                     : byte << (word_size - 8 - m_avail);
+        m_avail += 8;
+    }
+}
+
+template <bit_order Order>
+uint64_t bit_reader<Order>::take(std::size_t n)
+{
+    if (m_limit - m_pos < n) {
+        throw std::out_of_range("Read past the end of the stream");
+    }
+    if (m_avail < n) {
+        refill();
+        if (m_avail < n) {
+            throw std::out_of_range("Read past the end of the stream");
+        }
+    }
+
+    uint64_t val;
+    if (Order == bit_order::lsb_first) {
+        val = m_buf & ((1ULL << n) - 1);
+        m_buf >>= n;
+    } else {
+        val = n == 0 ? 0 : m_buf >> (word_size - n);
+        m_buf <<= n;
+    }
+    m_avail -= n;
+    m_pos += n;
+    return val;
+}
+
+template <bit_order Order>
+uint64_t bit_reader<Order>::read(std::size_t n)
+{
+    if (n > word_size) {
+        throw std::invalid_argument("The number of bits must less than 64.");
+    }
+
+    /* A refill guarantees at least 57 bits */
+    if (n > word_size - 8) {
+        if (Order == bit_order::lsb_first) {
+            uint64_t lo = take(32);
+            return lo | take(n - 32) << 32;
+        }
+        uint64_t hi = take(n - 32);
+        return hi << 32 | take(32);
+    }
+    return take(n);
+}
+
+template <bit_order Order>
+bits bit_reader<Order>::read_bits(std::size_t n)
+{
+    bits b{n, 0};
+    for (std::size_t i = 0; i < n; i += word_size) {
+        std::size_t nbits = std::min(word_size, n - i);
+        if (Order == bit_order::lsb_first) {
+            b.set_nbits(read(nbits), i, nbits);
+        } else {
+            b.set_nbits(read(nbits), n - i - nbits, nbits);
+        }
+    }
+    return b;
+}
+
+template <bit_order Order>
+void bit_reader<Order>::skip(std::size_t n)
+{
+    for (; n > word_size; n -= word_size) {
+        read(word_size);
+    }
+    read(n);
+}
+
+
+template <bit_order Order>
+bit_writer<Order>::bit_writer(uint8_t *data, std::size_t size)
+    : m_ptr{data},
+      m_end{data + size},
+      m_buf{0},
+      m_count{0},
+      m_pos{0},
+      m_limit{size * 8},
+      m_os{nullptr}
+{
+}
+
+template <bit_order Order>
+bit_writer<Order>::bit_writer(bits &b)
+    : bit_writer{reinterpret_cast<uint8_t *>(b.data()), (b.width() + 7) / 8}
+{
+    static_assert(utils::is_little_endian,
+                  "byte access to bits requires a little-endian host");
+    m_limit = b.width();
+}
+
+template <bit_order Order>
+bit_writer<Order>::bit_writer(std::ostream &os)
+    : m_ptr{nullptr},
+      m_end{nullptr},
+      m_buf{0},
+      m_count{0},
+      m_pos{0},
+      m_limit{std::numeric_limits<std::size_t>::max()},
+      m_os{&os}
+{
+}
+
+template <bit_order Order>
+void bit_writer<Order>::emit(uint64_t w)
+{
+    uint8_t bytes[8];
+    utils::store_stream_word<Order>(m_os ? bytes : m_ptr, w);
+    if (m_os) {
+        m_os->write(reinterpret_cast<const char *>(bytes), sizeof(bytes));
+    } else {
+        m_ptr += sizeof(bytes);
+    }
+}
+
+template <bit_order Order>
+void bit_writer<Order>::write(uint64_t val, std::size_t n)
+{
+    if (n > word_size) {
+        throw std::invalid_argument("The number of bits must less than 64.");
+    }
+    if (m_limit - m_pos < n) {
+        throw std::out_of_range("Write past the end of the stream");
+    }
+    if (n < word_size) {
+        val &= (1ULL << n) - 1;
+    }
+    m_pos += n;
+
+    /* The buffer is emitted as soon as it is full, so m_count < 64 */
+    if (m_count + n < word_size) {
+        m_buf |= Order == bit_order::lsb_first
+                     ? val << m_count
+                     : (n == 0 ? 0 : val << (word_size - m_count - n));
+        m_count += n;
+        return;
+    }
+
+    std::size_t first = word_size - m_count;
+    std::size_t rest = n - first;
+    if (Order == bit_order::lsb_first) {
+        emit(m_buf | val << m_count);
+        m_buf = rest == 0 ? 0 : val >> first;
+    } else {
+        emit(m_buf | val >> rest);
+        m_buf = rest == 0 ? 0 : val << (word_size - rest);
+    }
+    m_count = rest;
+}
+
+template <bit_order Order>
+void bit_writer<Order>::write_bits(const bits_view &v)
+{
+    for (std::size_t i = 0; i < v.width(); i += word_size) {
+        std::size_t nbits = std::min(word_size, v.width() - i);
+        if (Order == bit_order::lsb_first) {
+            write(v.get_nbits(i, nbits), nbits);
+        } else {
+            write(v.get_nbits(v.width() - i - nbits, nbits), nbits);
+        }
+    }
+}
+
+template <bit_order Order>
+void bit_writer<Order>::flush()
+{
+    for (std::size_t i = 0; i < m_count; i += 8) {
+        std::size_t nbits = std::min<std::size_t>(8, m_count - i);
+        uint8_t byte, mask;
+        if (Order == bit_order::lsb_first) {
+            byte = static_cast<uint8_t>(m_buf >> i);
+            mask = static_cast<uint8_t>((1U << nbits) - 1);
+        } else {
+            byte = static_cast<uint8_t>(m_buf >> (word_size - 8 - i));
+            mask = static_cast<uint8_t>(0xFF << (8 - nbits));
+        }
+
+        if (m_os) {
+            m_os->put(static_cast<char>(byte & mask));
+        } else {
+            *m_ptr = (*m_ptr & ~mask) | (byte & mask);
+            m_ptr++;
+        }
+    }
+
+    /* Continue at the next byte boundary */
+    m_pos += (8 - m_count % 8) % 8;
+    m_pos = std::min(m_pos, m_limit);
+    m_buf = 0;
+    m_count = 0;
+}
+
+}  // namespace bitsel
+
+
+#endif  // INCLUDE_BITSEL_STREAM_HPP_
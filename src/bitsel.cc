@@ -1 +1,15 @@
 #include <bitsel.hpp>
+#include <bitsel_atomic.hpp>
+#include <bitsel_crc.hpp>
+#include <bitsel_expr.hpp>
+#include <bitsel_gf2.hpp>
+#include <bitsel_lfsr.hpp>
+#include <bitsel_matrix.hpp>
+#if __has_include(<sys/mman.h>) && __has_include(<unistd.h>)
+#include <bitsel_mmap.hpp>
+#endif
+#include <bitsel_rope.hpp>
+#include <bitsel_search.hpp>
+#include <bitsel_sim.hpp>
+#include <bitsel_sparse.hpp>
+#include <bitsel_stream.hpp>
@@ -3,9 +3,28 @@
 #include <gtest/gtest_pred_impl.h>
 
 #include "bitsel.hpp"
+#include "bitsel_atomic.hpp"
+#include "bitsel_crc.hpp"
+#include "bitsel_expr.hpp"
+#include "bitsel_gf2.hpp"
+#include "bitsel_lfsr.hpp"
+#include "bitsel_matrix.hpp"
+#include "bitsel_mmap.hpp"
+#include "bitsel_rope.hpp"
+#include "bitsel_search.hpp"
+#include "bitsel_sim.hpp"
+#include "bitsel_sparse.hpp"
+#include "bitsel_stream.hpp"
 
 #include <array>
+#include <chrono>
+#include <fstream>
 #include <limits>
+#include <map>
+#include <set>
+#include <sstream>
+#include <thread>
+#include <unordered_map>
 
 using namespace bitsel;
 using namespace bitsel::literals;
@@ -335,6 +354,12 @@ TEST(SliceTestValid, AdvancedTest)
     EXPECT_EQ(b2a(44, 13), b2b);
 }
 
+TEST(SliceTestValid, FullWidthTest)
+{
+    bits b = "0xDEADBEEF"_u(32_w);
+    EXPECT_EQ(b(31, 0), b);
+}
+
 TEST(SliceTestInValid, BasicTest)
 {
     EXPECT_THROW(
@@ -427,6 +452,16 @@ TEST(SetNBitsTest, BasicTest)
     EXPECT_TRUE(c == 0xDEAFEEDBABEDBEEF_u(64_w));
 }
 
+TEST(SetNBitsTest, AlignedTest)
+{
+    bits b = bits::zeros(96);
+    b.set_nbits(0xFFFFFFFF, 32, 32);
+    EXPECT_EQ(b, "0x00000000FFFFFFFF00000000"_u(96_w));
+
+    b.set_nbits(0x0123456789ABCDEF, 16, 64);
+    EXPECT_EQ(b, "0x00000123456789ABCDEF0000"_u(96_w));
+}
+
 TEST(EmptyTest, BasicTest)
 {
     bits b;
@@ -574,6 +609,44 @@ TEST(CatTest, BasicTest)
     EXPECT_EQ(g, "0xEADBEEFDDDEADBEEF"_u());
 }
 
+TEST(CatTest, VariadicTest)
+{
+    bits a{"0b01010"};
+    bits b{"0b01100"};
+    bits c{"0b11001"};
+    EXPECT_EQ(cat(a, b, c), "0b010100110011001"_u());
+    EXPECT_EQ(cat(a, b, c), (bits{a, b, c}));
+    EXPECT_EQ(cat(bits{}, a, bits{}), a);
+    EXPECT_FALSE(cat(a.as_signed(), b, c.as_signed()).is_signed());
+
+    /* Pieces of every alignment against a bit by bit reference */
+    uint64_t seed = 3;
+    std::vector<bits> parts;
+    std::size_t total = 0;
+    for (std::size_t w : {0, 1, 31, 32, 33, 64, 7, 100, 5, 96}) {
+        bits p{w, 0};
+        for (std::size_t i = 0; i < w; i += 64) {
+            seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+            p.set_nbits(seed, i, 64);
+        }
+        parts.push_back(p);
+        total += w;
+    }
+
+    bits all = {parts[0], parts[1], parts[2], parts[3], parts[4],
+                parts[5], parts[6], parts[7], parts[8], parts[9]};
+    EXPECT_EQ(all, cat(parts[0], parts[1], parts[2], parts[3], parts[4],
+                       parts[5], parts[6], parts[7], parts[8], parts[9]));
+    ASSERT_EQ(all.width(), total);
+    std::size_t pos = total;
+    for (const auto &p : parts) {
+        pos -= p.width();
+        for (std::size_t i = 0; i < p.width(); i++) {
+            ASSERT_EQ(all[pos + i], p[i]);
+        }
+    }
+}
+
 TEST(RightShiftTest, ZeroLengthTest)
 {
     bits b;
@@ -818,6 +891,13 @@ TEST(PlusTest, BasicTest)
     EXPECT_EQ(d, "0x8A5B79ADCDE"_u(44_w));
 }
 
+TEST(PlusTest, CarryTest)
+{
+    EXPECT_EQ(bits::zeros(64) + bits::zeros(64), bits::zeros(64));
+    EXPECT_EQ(bits(96, 0xFFFFFFFFFFFFFFFF) + bits(96, 1),
+              "0x000000010000000000000000"_u(96_w));
+}
+
 TEST(SubtractTest, ZeroLengthTest)
 {
     bits a;
@@ -1048,3 +1128,2006 @@ TEST(CountTest, BasicTest)
     bits b3 = "0xDEADBEEF"_u(32_w);
     EXPECT_EQ(b3.count(), 24);
 }
+
+TEST(AtomicBitsTest, BasicTest)
+{
+    bits b = "0xDEADBEEFCAFEBABE1234"_u(80_w);
+    atomic_bits ab{b};
+    EXPECT_EQ(ab.width(), 80);
+    EXPECT_EQ(ab.load(), b);
+    EXPECT_EQ(ab.count(), b.count());
+
+    EXPECT_FALSE(ab.test(0));
+    EXPECT_FALSE(ab.test_and_set(0));
+    EXPECT_TRUE(ab.test_and_set(0));
+    ab.reset(2);
+    ab.set(79, false);
+    EXPECT_EQ(ab.load(), "0x5EADBEEFCAFEBABE1231"_u(80_w));
+
+    EXPECT_THROW(ab.test(80), std::out_of_range);
+    EXPECT_THROW(ab.set(80), std::out_of_range);
+}
+
+TEST(AtomicBitsTest, FetchOrTest)
+{
+    atomic_bits ab{bits{100, 0xF0}};
+    bits old = ab.fetch_or(bits::ones(72), 4);
+    EXPECT_EQ(old, bits(72, 0xF));
+    bits expected = {bits::zeros(24), bits::ones(72), bits::zeros(4)};
+    EXPECT_EQ(ab.load(), expected);
+
+    EXPECT_THROW(ab.fetch_or(bits::ones(8), 93), std::out_of_range);
+}
+
+TEST(AtomicBitsTest, FindFirstZeroAndSetTest)
+{
+    atomic_bits ab{bits{70, 0xFF}};
+    EXPECT_EQ(ab.find_first_zero_and_set(), 8);
+    EXPECT_EQ(ab.find_first_zero_and_set(), 9);
+    EXPECT_EQ(ab.find_first_zero_and_set(66), 66);
+    EXPECT_EQ(ab.find_first_zero_and_set(64), 64);
+
+    atomic_bits full{bits::ones(70)};
+    EXPECT_EQ(full.find_first_zero_and_set(), atomic_bits::npos);
+}
+
+TEST(AtomicBitsTest, ConcurrentTest)
+{
+    constexpr std::size_t num_threads = 4;
+    constexpr std::size_t width = 1000;
+
+    /* Interleaved writers hit the same words */
+    atomic_bits ab{width};
+    std::vector<std::thread> writers;
+    for (std::size_t t = 0; t < num_threads; t++) {
+        writers.emplace_back([&ab, t] {
+            for (std::size_t i = t; i < width; i += num_threads) {
+                ab.set(i, true, std::memory_order_relaxed);
+            }
+        });
+    }
+    for (auto &th : writers) {
+        th.join();
+    }
+    EXPECT_EQ(ab.load(), bits::ones(width));
+
+    /* Every slot is handed out exactly once */
+    atomic_bits slots{width};
+    std::array<std::vector<std::size_t>, num_threads> claimed;
+    std::vector<std::thread> allocators;
+    for (std::size_t t = 0; t < num_threads; t++) {
+        allocators.emplace_back([&slots, &claimed, t] {
+            std::size_t pos;
+            while ((pos = slots.find_first_zero_and_set()) !=
+                   atomic_bits::npos) {
+                claimed[t].push_back(pos);
+            }
+        });
+    }
+    for (auto &th : allocators) {
+        th.join();
+    }
+
+    std::vector<std::size_t> all;
+    for (const auto &c : claimed) {
+        all.insert(all.end(), c.begin(), c.end());
+    }
+    std::sort(all.begin(), all.end());
+    ASSERT_EQ(all.size(), width);
+    for (std::size_t i = 0; i < width; i++) {
+        EXPECT_EQ(all[i], i);
+    }
+}
+
+TEST(SerializationTest, BufferTest)
+{
+    bits b = "0xDEADBEEFCAFEBABE1234"_u(80_w);
+    ASSERT_EQ(b.serialized_size(), 24);
+
+    std::array<uint8_t, 24> buf;
+    EXPECT_EQ(b.serialize_into(buf.data(), buf.size()), 24);
+
+    /* Width header, then little-endian words */
+    EXPECT_EQ(buf[0], 80);
+    EXPECT_EQ(buf[7], 0);
+    EXPECT_EQ(buf[8], 0x34);
+    EXPECT_EQ(buf[9], 0x12);
+    EXPECT_EQ(buf[16], 0xAD);
+    EXPECT_EQ(buf[17], 0xDE);
+    EXPECT_EQ(buf[18], 0);
+
+    bits c;
+    EXPECT_EQ(c.deserialize_from(buf.data(), buf.size()), 24);
+    EXPECT_EQ(c, b);
+
+    EXPECT_THROW(b.serialize_into(buf.data(), 23), std::out_of_range);
+    EXPECT_THROW(c.deserialize_from(buf.data(), 16), std::out_of_range);
+}
+
+TEST(SerializationTest, StreamTest)
+{
+    std::stringstream ss;
+    bits b0;
+    bits b1 = "0b101"_u(3_w);
+    bits b2 = bits::ones(64);
+    b0.write(ss);
+    b1.write(ss);
+    b2.write(ss);
+    EXPECT_EQ(ss.str().size(), 8 + 16 + 16);
+
+    bits c0{4, 0xF}, c1, c2;
+    c0.read(ss);
+    c1.read(ss);
+    c2.read(ss);
+    EXPECT_EQ(c0, b0);
+    EXPECT_EQ(c1, b1);
+    EXPECT_EQ(c2, b2);
+
+    EXPECT_THROW(c0.read(ss), std::runtime_error);
+}
+
+TEST(SerializationTest, TruncatedStreamTest)
+{
+    std::stringstream ss;
+    bits::ones(100).write(ss);
+    std::string data = ss.str();
+
+    /* A short payload and a hostile width both fail cleanly */
+    std::stringstream cut{data.substr(0, data.size() - 1)};
+    bits b{4, 0xF};
+    EXPECT_THROW(b.read(cut), std::runtime_error);
+    EXPECT_EQ(b, bits(4, 0xF));
+
+    uint8_t header[8];
+    utils::store_le64(header, uint64_t{1} << 62);
+    std::stringstream huge{std::string(header, header + 8) + data};
+    EXPECT_THROW(b.read(huge), std::runtime_error);
+}
+
+TEST(SerializationTest, BatchTest)
+{
+    std::vector<bits> v = {"0xABADBABE"_u(32_w), bits::zeros(100),
+                           "0o7"_u(3_w), bits{}};
+
+    std::stringstream ss;
+    write(ss, v);
+    EXPECT_EQ(ss.str().size(), serialized_size(v));
+
+    std::vector<bits> w;
+    read(ss, w);
+    EXPECT_EQ(w, v);
+
+    std::vector<uint8_t> buf(serialized_size(v));
+    EXPECT_EQ(serialize_into(v, buf.data(), buf.size()), buf.size());
+    std::vector<bits> u;
+    EXPECT_EQ(deserialize_from(u, buf.data(), buf.size()), buf.size());
+    EXPECT_EQ(u, v);
+}
+
+TEST(BitsViewTest, BasicTest)
+{
+    bits b = "0xDEADBEEFCAFEBABE1234"_u(80_w);
+    bits_view v = b;
+    EXPECT_EQ(v.width(), 80);
+    EXPECT_EQ(v.count(), b.count());
+    EXPECT_EQ(v.get_nbits(20, 32), b.get_nbits(20, 32));
+    EXPECT_TRUE(v[2]);
+    EXPECT_FALSE(v[3]);
+    EXPECT_THROW(v.test(80), std::out_of_range);
+    EXPECT_TRUE(v == b);
+    EXPECT_TRUE(b == v);
+    EXPECT_EQ(v.to_bits(), b);
+}
+
+TEST(BitsViewTest, SliceTest)
+{
+    bits b = "0xDEADBEEFCAFEBABE1234"_u(80_w);
+    bits_view v = b;
+
+    bits_view s = v(75, 4);
+    EXPECT_EQ(s.width(), 72);
+    EXPECT_EQ(s.to_bits(), b(75, 4));
+    EXPECT_EQ(s, b(75, 4));
+    EXPECT_EQ(s.count(), b(75, 4).count());
+    EXPECT_EQ(s(39, 8), b(75, 4)(39, 8));
+    EXPECT_EQ(s.to_string(), b(75, 4).to_string());
+
+    EXPECT_THROW(v(80, 0), std::out_of_range);
+    EXPECT_THROW(v(3, 4), std::out_of_range);
+}
+
+#ifdef BITSEL_HAS_MMAP
+TEST(MappedBitsTest, ReadOnlyTest)
+{
+    std::string path = testing::TempDir() + "bitsel_mapped_ro.bin";
+    bits b = "0xDEADBEEFCAFEBABE1234"_u(80_w);
+    {
+        std::ofstream ofs{path, std::ios::binary};
+        b.write(ofs);
+    }
+
+    mapped_bits m{path};
+    EXPECT_EQ(m.width(), 80);
+    EXPECT_FALSE(m.writable());
+    EXPECT_EQ(m.view(), b);
+    EXPECT_EQ(m.count(), b.count());
+    EXPECT_EQ(m.get_nbits(20, 32), b.get_nbits(20, 32));
+    EXPECT_EQ(m(63, 16), b(63, 16));
+    EXPECT_THROW(m.set(0, true), std::logic_error);
+
+    m.advise(mapped_bits::advice::sequential);
+    std::remove(path.c_str());
+}
+
+TEST(MappedBitsTest, ReadWriteTest)
+{
+    std::string path = testing::TempDir() + "bitsel_mapped_rw.bin";
+    {
+        mapped_bits m = mapped_bits::create(path, 100);
+        EXPECT_EQ(m.width(), 100);
+        EXPECT_EQ(m.count(), 0);
+
+        m.set(99, true);
+        m.set_nbits(0xCAFEBABE, 16, 32);
+        m.flush();
+    }
+
+    std::ifstream ifs{path, std::ios::binary};
+    bits b;
+    b.read(ifs);
+    EXPECT_EQ(b, "0x8000000000000CAFEBABE0000"_u(100_w));
+
+    EXPECT_THROW(mapped_bits{path + ".missing"}, std::system_error);
+    std::remove(path.c_str());
+}
+#endif
+
+TEST(BitReaderTest, BitsTest)
+{
+    bits b = "0xDEADBEEFCAFEBABE1234"_u(80_w);
+    bit_reader<> r{b};
+    EXPECT_EQ(r.read(4), 0x4);
+    EXPECT_EQ(r.read(8), 0x23);
+    EXPECT_EQ(r.read(60), 0xADBEEFCAFEBABE1);
+    EXPECT_FALSE(r.eof());
+    EXPECT_EQ(r.read_bits(8), "0xDE"_u(8_w));
+    EXPECT_TRUE(r.eof());
+    EXPECT_THROW(r.read(1), std::out_of_range);
+
+    /* Unaligned view */
+    bit_reader<> rv{bits_view{b}(75, 3)};
+    EXPECT_EQ(rv.read_bits(73), b(75, 3));
+}
+
+TEST(BitReaderTest, BytesTest)
+{
+    std::array<uint8_t, 3> buf = {0xBF, 0x12, 0x34};
+
+    bit_reader<bit_order::msb_first> m{buf.data(), buf.size()};
+    EXPECT_EQ(m.read(3), 0b101);
+    EXPECT_EQ(m.read(5), 0x1F);
+    EXPECT_EQ(m.read(12), 0x123);
+    EXPECT_EQ(m.position(), 20);
+
+    bit_reader<bit_order::lsb_first> l{buf.data(), buf.size()};
+    EXPECT_EQ(l.read(3), 0b111);
+    EXPECT_EQ(l.read(5), 0b10111);
+    EXPECT_EQ(l.read(16), 0x3412);
+}
+
+TEST(BitWriterTest, BytesTest)
+{
+    std::array<uint8_t, 2> buf = {0, 0xFF};
+    {
+        bit_writer<bit_order::msb_first> w{buf.data(), buf.size()};
+        w.write(0b101, 3);
+        w.write(0x1F, 5);
+        w.write(0x0, 4);
+        EXPECT_THROW(w.write(0, 5), std::out_of_range);
+    }
+    EXPECT_EQ(buf[0], 0xBF);
+    EXPECT_EQ(buf[1], 0x0F);
+
+    buf = {0, 0xFF};
+    {
+        bit_writer<bit_order::lsb_first> w{buf.data(), buf.size()};
+        w.write(0b101, 3);
+        w.write(0x1F, 5);
+        w.write(0x0, 4);
+    }
+    EXPECT_EQ(buf[0], 0xFD);
+    EXPECT_EQ(buf[1], 0xF0);
+}
+
+TEST(BitWriterTest, BitsTest)
+{
+    bits b = bits::ones(80);
+    {
+        bit_writer<> w{b};
+        w.write(0x1234, 16);
+        w.write(0xCAFEBABE, 32);
+        w.write_bits("0xDEADBEE"_u(28_w));
+    }
+    EXPECT_EQ(b, "0xFDEADBEECAFEBABE1234"_u(80_w));
+}
+
+template <bit_order Order>
+void round_trip_test()
+{
+    std::vector<std::pair<uint64_t, std::size_t>> fields;
+    uint64_t seed = 0x9E3779B97F4A7C15;
+    for (std::size_t i = 0; i < 500; i++) {
+        seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+        std::size_t n = seed % 65;
+        uint64_t val = n == 64 ? seed : seed & ((1ULL << n) - 1);
+        fields.emplace_back(val, n);
+    }
+
+    std::stringstream ss;
+    {
+        bit_writer<Order> w{ss};
+        for (const auto &f : fields) {
+            w.write(f.first, f.second);
+        }
+    }
+
+    bit_reader<Order> r{ss};
+    for (const auto &f : fields) {
+        ASSERT_EQ(r.read(f.second), f.first);
+    }
+}
+
+TEST(BitStreamTest, RoundTripTest)
+{
+    round_trip_test<bit_order::lsb_first>();
+    round_trip_test<bit_order::msb_first>();
+}
+
+TEST(SparseBitsTest, ConversionTest)
+{
+    bits b = bits::zeros(300000);
+    /* array chunk */
+    b.set(3, true);
+    b.set(40000, true);
+    /* run chunk */
+    b.set_nbits(~0ULL, 70000, 64);
+    b.set_nbits(~0ULL, 70064, 64);
+    /* bitmap chunk */
+    for (std::size_t i = 140000; i < 200000; i += 3) {
+        b.set(i, true);
+    }
+    /* partial last chunk */
+    b.set(299999, true);
+
+    sparse_bits s{b};
+    EXPECT_EQ(s.width(), b.width());
+    EXPECT_EQ(s.count(), b.count());
+    EXPECT_EQ(s.to_bits(), b);
+    EXPECT_TRUE(s[40000]);
+    EXPECT_TRUE(s[70127]);
+    EXPECT_FALSE(s[70128]);
+    EXPECT_THROW(s.test(300000), std::out_of_range);
+    EXPECT_LT(s.size_in_bytes(), b.width() / 8 / 2);
+}
+
+TEST(SparseBitsTest, SetTest)
+{
+    sparse_bits s{200000};
+    for (std::size_t i = 0; i < 5000; i++) {
+        s.set(i * 2, true);
+    }
+    EXPECT_EQ(s.count(), 5000);
+    s.set(2, false);
+    s.set(199999, true);
+    EXPECT_FALSE(s[2]);
+    EXPECT_TRUE(s[4]);
+    EXPECT_TRUE(s[199999]);
+    EXPECT_EQ(s.count(), 5000);
+
+    for (std::size_t i = 0; i < 5000; i++) {
+        s.set(i * 2, false);
+    }
+    s.set(199999, false);
+    EXPECT_EQ(s.count(), 0);
+    EXPECT_EQ(s, sparse_bits{200000});
+}
+
+TEST(SparseBitsTest, RunEditTest)
+{
+    /* Runs across word and chunk boundaries, one up to the chunk end */
+    bits b = bits::zeros(140000);
+    for (auto r : {std::make_pair(60, 200), std::make_pair(1000, 1064),
+                   std::make_pair(65000, 66000)}) {
+        for (int i = r.first; i < r.second; i++) {
+            b.set(i, true);
+        }
+    }
+    b.set(131071, true);
+
+    sparse_bits s{b};
+    EXPECT_EQ(s.to_bits(), b);
+    EXPECT_LT(s.size_in_bytes(), 400);
+
+    /* Grow, split, join and drop runs against a dense copy */
+    uint64_t seed = 3;
+    for (int i = 0; i < 3000; i++) {
+        seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+        std::size_t pos = (seed >> 33) % 1200;
+        if (i % 3 == 0) {
+            pos += 65000;
+        }
+        bool val = (seed >> 20 & 3) != 0;
+        s.set(pos, val);
+        b.set(pos, val);
+    }
+    EXPECT_EQ(s.to_bits(), b);
+    EXPECT_EQ(s.count(), b.count());
+    EXPECT_EQ(s, sparse_bits{b});
+}
+
+TEST(SparseBitsTest, BitwiseTest)
+{
+    bits a = bits::zeros(200000), b = bits::zeros(150000);
+    for (std::size_t i = 0; i < 200000; i += 7) {
+        a.set(i, true);
+    }
+    for (std::size_t i = 0; i < 150000; i += 11) {
+        b.set(i, true);
+    }
+    a.set_nbits(~0ULL, 131072, 64);
+    b.set_nbits(~0ULL, 131100, 64);
+    for (std::size_t i = 65536; i < 66000; i++) {
+        b.set(i, true);
+    }
+
+    sparse_bits sa{a}, sb{b};
+    EXPECT_EQ((sa & sb).to_bits(), a & b);
+    EXPECT_EQ((sa | sb).to_bits(), a | b);
+    EXPECT_EQ((sa ^ sb).to_bits(), a ^ b);
+    EXPECT_EQ((sa & sb).count(), (a & b).count());
+
+    EXPECT_EQ((sa & b).to_bits(), a & b);
+    EXPECT_EQ((a & sb).to_bits(), a & b);
+    EXPECT_EQ(sa | b, a | b);
+    EXPECT_EQ(sa ^ b, a ^ b);
+    EXPECT_EQ(sb | a, b | a);
+    EXPECT_EQ(sb ^ a, b ^ a);
+    EXPECT_EQ((sb ^ a).width(), 200000);
+
+    sparse_bits sc{sa};
+    sc ^= sa;
+    EXPECT_EQ(sc.count(), 0);
+}
+
+TEST(HashTest, BasicTest)
+{
+    std::hash<bits> h;
+    EXPECT_EQ(h("0xDEADBEEF"_u(32_w)), h(bits{32, 0xDEADBEEF}));
+    EXPECT_NE(h("0xDEADBEEF"_u(32_w)), h("0xDEADBEEF"_u(33_w)));
+    EXPECT_NE(h("0xDEADBEEF"_u(32_w)), h("0xDEADBEEE"_u(32_w)));
+
+    bits wide = bits::ones(1000);
+    bits other = wide;
+    other.set(517, false);
+    EXPECT_EQ(h(wide), h(bits::ones(1000)));
+    EXPECT_NE(h(wide), h(other));
+
+    std::unordered_map<bits, int> m;
+    m[bits{8, 1}] = 1;
+    m[bits{16, 1}] = 2;
+    m[wide] = 3;
+    EXPECT_EQ(m.size(), 3);
+    EXPECT_EQ(m[bits(8, 1)], 1);
+    EXPECT_EQ(m[bits::ones(1000)], 3);
+}
+
+TEST(CompareTest, BasicTest)
+{
+    EXPECT_EQ(compare("0x10"_u(8_w), "0x10"_u(8_w)), 0);
+    EXPECT_LT(compare("0x0F"_u(8_w), "0x10"_u(8_w)), 0);
+    EXPECT_GT(compare("0x10"_u(8_w), "0x0F"_u(8_w)), 0);
+
+    /* Zero extension across widths */
+    EXPECT_EQ(compare(bits{8, 5}, bits{100, 5}), 0);
+    EXPECT_LT(compare(bits{8, 5}, bits::ones(100)), 0);
+    EXPECT_GT(compare(bits{100, 1} << 99, bits::ones(64)), 0);
+
+    EXPECT_TRUE(bits(8, 5) < bits(8, 6));
+    EXPECT_TRUE(bits(8, 5) < bits(16, 5));
+    EXPECT_FALSE(bits(16, 5) < bits(8, 5));
+    EXPECT_TRUE(bits(8, 6) > bits(64, 5));
+    EXPECT_TRUE(bits(8, 5) <= bits(8, 5));
+    EXPECT_TRUE(bits(8, 5) >= bits(8, 5));
+    EXPECT_TRUE(bits(8, 5) != bits(16, 5));
+
+    std::map<bits, int> m;
+    m[bits{8, 3}] = 3;
+    m[bits{8, 1}] = 1;
+    m[bits{70, 2}] = 2;
+    m[bits{16, 1}] = 4;
+    std::vector<int> order;
+    for (const auto &kv : m) {
+        order.push_back(kv.second);
+    }
+    EXPECT_EQ(order, (std::vector<int>{1, 4, 2, 3}));
+}
+
+TEST(SignedTest, LiteralTest)
+{
+    bits a = 5_s();
+    EXPECT_TRUE(a.is_signed());
+    EXPECT_EQ(a.width(), 4);
+    EXPECT_FALSE(a.is_negative());
+
+    bits b = 0xF_s(4_w);
+    EXPECT_TRUE(b.is_negative());
+    EXPECT_EQ(b.to_int64(), -1);
+    EXPECT_EQ("0x80"_s().to_int64(), -128);
+    EXPECT_EQ("0x80"_u().to_int64(), 128);
+
+    EXPECT_FALSE(5_u().is_signed());
+    EXPECT_TRUE(a.as_unsigned().as_signed().is_signed());
+    EXPECT_FALSE(b(3, 0).is_signed());
+}
+
+TEST(SignedTest, ExtensionTest)
+{
+    bits b = 0xA_s(4_w);
+    EXPECT_EQ(b.sext(12), "0xFFA"_s(12_w));
+    EXPECT_TRUE(b.sext(12).is_signed());
+    EXPECT_EQ(b.zext(12), "0x00A"_s(12_w));
+    EXPECT_EQ(b.sext(2), "0b10"_s(2_w));
+
+    bits w = "0x80000000"_u(32_w);
+    bits expected = {bits::ones(68), w};
+    EXPECT_EQ(w.sext(100), expected);
+    EXPECT_EQ(w.zext(100), bits(100, 0x80000000));
+}
+
+TEST(SignedTest, ShiftTest)
+{
+    bits b = "0x8000000000000001"_s(64_w);
+    b >>= 4;
+    EXPECT_EQ(b, "0xF800000000000000"_s(64_w));
+    b >>= 100;
+    EXPECT_EQ(b, bits::ones(64).as_signed());
+
+    bits u = "0x8000000000000001"_u(64_w);
+    u >>= 4;
+    EXPECT_EQ(u, "0x0800000000000000"_u(64_w));
+
+    u = "0x81"_u(8_w);
+    u.asr(3);
+    EXPECT_EQ(u, "0xF0"_u(8_w));
+    EXPECT_FALSE(u.is_signed());
+}
+
+TEST(SignedTest, ArithmeticTest)
+{
+    /* -3 + 5 over different widths */
+    bits r = 0xD_s(4_w) + 5_s(16_w);
+    EXPECT_TRUE(r.is_signed());
+    EXPECT_EQ(r.to_int64(), 2);
+
+    EXPECT_EQ((-5_s(8_w)).to_int64(), -5);
+    EXPECT_EQ(-bits::zeros(40), bits::zeros(40));
+    EXPECT_EQ((5_s(8_w) - 7_s(8_w)).to_int64(), -2);
+}
+
+TEST(SignedTest, CompareTest)
+{
+    EXPECT_LT(compare(0xF_s(4_w), 0_s(4_w)), 0);
+    EXPECT_GT(compare(0xF_u(4_w), 0_u(4_w)), 0);
+    EXPECT_EQ(compare(0xF_s(4_w), bits::ones(64).as_signed()), 0);
+    EXPECT_LT(compare(0xE_s(4_w), bits::ones(64).as_signed()), 0);
+    EXPECT_LT(compare(0x8_s(4_w), 1_u(1_w)), 0);
+    EXPECT_TRUE(0xF_s(4_w) < 1_s(8_w));
+}
+
+TEST(SignedTest, MixedOrderTest)
+{
+    bits a = bits{4, 0xF}.as_signed();
+    bits b{4, 0xF};
+    EXPECT_NE(a, b);
+    EXPECT_NE(a.hash(), b.hash());
+    EXPECT_EQ((std::set<bits>{a, b}.size()), 2);
+
+    /* Equivalent under operator< exactly when equal */
+    std::vector<bits> v = {a, b, 0x7_s(4_w), 0x7_u(4_w), 0x7_s(8_w),
+                           0xFF_s(8_w), 0xFF_u(8_w), 0x0_s(4_w), 0x0_u(4_w)};
+    for (const auto &x : v) {
+        for (const auto &y : v) {
+            EXPECT_EQ(!(x < y) && !(y < x), x == y) << x << " " << y;
+            if (x == y) {
+                EXPECT_EQ(x.hash(), y.hash());
+            }
+        }
+    }
+}
+
+TEST(RotateTest, NarrowTest)
+{
+    bits b = "0b0001011"_u(7_w);
+    EXPECT_EQ(rotl(b, 2), "0b0101100"_u(7_w));
+    EXPECT_EQ(rotl(b, 5), "0b1100010"_u(7_w));
+    EXPECT_EQ(rotr(b, 2), "0b1100010"_u(7_w));
+    EXPECT_EQ(rotl(b, 7), b);
+    EXPECT_EQ(rotr(b, 16), rotr(b, 2));
+
+    bits w = "0x8000000000000001"_u(64_w);
+    EXPECT_EQ(rotl(w, 4), "0x0000000000000018"_u(64_w));
+    EXPECT_EQ(rotr(w, 4), "0x1800000000000000"_u(64_w));
+
+    bits e;
+    EXPECT_TRUE(e.rotl(3).empty());
+}
+
+TEST(RotateTest, WideTest)
+{
+    bits b = "0xDEADBEEFCAFEBABE1234"_u(80_w);
+    for (std::size_t k = 0; k <= 80; k += 7) {
+        std::size_t s = k % 80;
+        bits expected = s == 0 ? b : cat(b(79 - s, 0), b(79, 80 - s));
+        EXPECT_EQ(rotl(b, k), expected);
+        EXPECT_EQ(rotr(rotl(b, k), k), b);
+    }
+    EXPECT_EQ(rotl(b, 32), "0xCAFEBABE1234DEADBEEF"_u(80_w));
+
+    bits c = b;
+    c.rotr(12);
+    EXPECT_EQ(c, "0x234DEADBEEFCAFEBABE1"_u(80_w));
+}
+
+TEST(RotateTest, InPlaceTest)
+{
+    /* Against a bit by bit rotate, across the word boundaries */
+    uint64_t seed = 5;
+    for (std::size_t len : {65, 127, 128, 129, 200, 1000}) {
+        bits b{len, 0};
+        for (std::size_t i = 0; i < len; i += 64) {
+            seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+            b.set_nbits(seed, i, 64);
+        }
+        for (std::size_t k : {std::size_t{1}, std::size_t{63}, len / 2,
+                              len - 64, len - 1}) {
+            bits r = rotl(b, k), expected{len, 0};
+            for (std::size_t i = 0; i < len; i++) {
+                expected.set_nbits(b.get_nbits(i, 1), (i + k) % len, 1);
+            }
+            EXPECT_EQ(r, expected) << len << " " << k;
+        }
+    }
+
+    /* The buffer is reused, reserved room included */
+    bits c = "0xDEADBEEFCAFEBABE1234"_u(80_w);
+    c.reserve(1024);
+    c.rotl(13);
+    EXPECT_EQ(c.capacity(), 1024);
+    EXPECT_EQ(c.rotr(13), "0xDEADBEEFCAFEBABE1234"_u(80_w));
+}
+
+TEST(MultiplyTest, BasicTest)
+{
+    bits p = "0xFFFF"_u(16_w) * "0xFFFF"_u(16_w);
+    EXPECT_EQ(p, "0xFFFE0001"_u(32_w));
+
+    bits q = "0xDEADBEEF"_u(32_w) * "0xCAFE"_u(20_w);
+    EXPECT_EQ(q, bits(52, 0xDEADBEEFULL * 0xCAFE));
+
+    bits r = "0x3"_u(2_w);
+    r *= "0x5"_u(3_w);
+    EXPECT_EQ(r, "0b01111"_u(5_w));
+
+    EXPECT_EQ(bits() * bits(8, 3), bits(8, 0));
+}
+
+TEST(MultiplyTest, WideTest)
+{
+    /* (2^n - 1)^2 = 2^2n - 2^(n+1) + 1 */
+    for (std::size_t n : {100, 2000, 4096, 5000}) {
+        bits expected = {bits::ones(n - 1), bits::zeros(n), bits::ones(1)};
+        EXPECT_EQ(bits::ones(n) * bits::ones(n), expected);
+    }
+
+    /* Unbalanced operands */
+    bits a = bits::ones(4096), b = bits{64, 3};
+    bits x = a.zext(4160);
+    EXPECT_EQ(a * b, (x << 1) + x);
+    EXPECT_EQ(b * a, (x << 1) + x);
+}
+
+TEST(MultiplyTest, KaratsubaTest)
+{
+    using namespace bitsel::utils;
+
+    std::vector<limb> a(75), b(75);
+    uint64_t seed = 42;
+    for (std::size_t i = 0; i < a.size(); i++) {
+        seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+        a[i] = seed;
+        seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+        b[i] = seed;
+    }
+
+    std::vector<limb> school(150, 0), kara(150);
+    mul_schoolbook(a.data(), a.size(), b.data(), b.size(), school.data(),
+                   school.size());
+    mul_karatsuba(a.data(), b.data(), a.size(), kara.data());
+    EXPECT_EQ(school, kara);
+}
+
+TEST(MultiplyTest, ShortProductTest)
+{
+    using namespace bitsel::utils;
+
+    std::vector<limb> a(150), b(150);
+    uint64_t seed = 7;
+    for (std::size_t i = 0; i < a.size(); i++) {
+        seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+        a[i] = seed;
+        seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+        b[i] = seed;
+    }
+
+    for (std::size_t n : {31, 32, 33, 64, 75, 150}) {
+        std::vector<limb> full(2 * n, 0), low(n);
+        mul_schoolbook(a.data(), n, b.data(), n, full.data(), 2 * n);
+        mul_low(a.data(), b.data(), n, low.data());
+        full.resize(n);
+        EXPECT_EQ(low, full) << n;
+    }
+
+    /* Truncation inside, at and past a Karatsuba slice */
+    for (std::size_t outn : {40, 64, 100, 150, 230}) {
+        std::vector<limb> ref(230, 0), out(outn);
+        mul_schoolbook(a.data(), 150, b.data(), 64, ref.data(), ref.size());
+        mul_limbs(a.data(), 150, b.data(), 64, out.data(), outn);
+        ref.resize(outn);
+        EXPECT_EQ(out, ref) << outn;
+    }
+}
+
+TEST(MultiplyTest, TruncatingTest)
+{
+    bits a = "0xDEADBEEFCAFEBABE"_u(64_w), b = "0x123456789"_u(36_w);
+    EXPECT_EQ(mul_lo(a, b), (a * b)(63, 0));
+    EXPECT_EQ(mul_lo(a, b, 40), (a * b)(39, 0));
+
+    bits w = bits::ones(4096);
+    EXPECT_EQ(mul_lo(w, w), (w * w)(4095, 0));
+}
+
+TEST(MultiplyTest, SignedTest)
+{
+    EXPECT_EQ((0xD_s(4_w) * 5_s(4_w)).to_int64(), -15);
+    EXPECT_EQ((0xD_s(4_w) * 0xB_s(4_w)).to_int64(), 15);
+    EXPECT_EQ((0x8_s(4_w) * 0x8_s(4_w)).to_int64(), 64);
+    EXPECT_TRUE((0x8_s(4_w) * 0x8_s(4_w)).is_signed());
+    EXPECT_EQ(mul_lo(0xF3_s(8_w), 0x7_s(8_w)).to_int64(), -91);
+}
+
+TEST(DivideTest, BasicTest)
+{
+    EXPECT_EQ(100_u(8_w) / 7_u(4_w), 14_u(8_w));
+    EXPECT_EQ(100_u(8_w) % 7_u(4_w), 2_u(4_w));
+    EXPECT_EQ(5_u(8_w) / 7_u(4_w), 0_u(8_w));
+    EXPECT_EQ(5_u(8_w) % 7_u(4_w), 5_u(4_w));
+
+    bits a = "0xDEADBEEFCAFEBABE12345678"_u(96_w);
+    bits q, r;
+    std::tie(q, r) = divmod(a, "0x1234567"_u(28_w));
+    EXPECT_EQ(q, "0xC3B6B52D42C584859D"_u(96_w));
+    EXPECT_EQ(r, "0x68434D"_u(28_w));
+
+    bits c = 17_u(8_w);
+    c /= 3_u(8_w);
+    EXPECT_EQ(c, 5_u(8_w));
+    c %= 3_u(8_w);
+    EXPECT_EQ(c, 2_u(8_w));
+
+    EXPECT_THROW(a / 0_u(8_w), std::domain_error);
+}
+
+TEST(DivideTest, MultiLimbTest)
+{
+    /* a == q * b + r and r < b, with divisors hitting the add-back step */
+    uint64_t seed = 7;
+    auto next = [&seed]() {
+        seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+        return seed;
+    };
+    for (std::size_t n : {65, 128, 200, 1000}) {
+        bits a{1500, 0}, b{n, 0};
+        for (std::size_t i = 0; i < a.width(); i += 64) {
+            a.set_nbits(next(), i, 64);
+        }
+        for (std::size_t i = 0; i < b.width(); i += 64) {
+            b.set_nbits(i + 64 >= n ? ~0ULL : next(), i, 64);
+        }
+
+        bits q, r;
+        std::tie(q, r) = divmod(a, b);
+        EXPECT_LT(r, b);
+        EXPECT_EQ(mul_lo(q, b, a.width()) + r.zext(a.width()), a);
+    }
+}
+
+TEST(DivideTest, ReciprocalTest)
+{
+    using namespace bitsel::utils;
+
+    uint64_t seed = 11;
+    auto next = [&seed]() {
+        seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+        return seed;
+    };
+
+    for (std::size_t n : {1, 5, 31, 32, 33, 64, 100, 257}) {
+        for (int kind = 0; kind < 3; kind++) {
+            /* Random, all ones and a bare power of the base */
+            std::vector<limb> d(n);
+            for (auto &x : d) {
+                x = kind == 0 ? next() : kind == 1 ? ~0ULL : 0;
+            }
+            if (kind == 2) {
+                d[n - 1] = 1;
+            }
+
+            std::vector<limb> u(2 * n + 1, 0), q(n + 2), r(n);
+            u[2 * n] = 1;
+            divmod_limbs(u.data(), u.size(), d.data(), n, q.data(), r.data());
+            /* Exact or a unit or two below */
+            auto mu = recip_limbs(d.data(), n);
+            EXPECT_EQ(sub_limbs(q.data(), q.size(), mu.data(), mu.size()), 0);
+            EXPECT_LE(q[0], 2) << n << " " << kind;
+            EXPECT_EQ(num_limbs(q), q[0] != 0) << n << " " << kind;
+
+            /* Barrett against Knuth, with more than one step */
+            std::vector<limb> v(3 * n + 5);
+            for (auto &x : v) {
+                x = next();
+            }
+            std::size_t qn = v.size() - n + 1;
+            std::vector<limb> q1(qn), r1(n), q2(qn), r2(n);
+            divmod_limbs(v.data(), v.size(), d.data(), n, q1.data(),
+                         r1.data());
+            divmod_barrett(v.data(), v.size(), d.data(), n, mu, q2.data(),
+                           r2.data());
+            EXPECT_EQ(q1, q2) << n << " " << kind;
+            EXPECT_EQ(r1, r2) << n << " " << kind;
+        }
+    }
+}
+
+TEST(DivideTest, SignedTest)
+{
+    EXPECT_EQ((0xF9_s(8_w) / 2_s(8_w)).to_int64(), -3);
+    EXPECT_EQ((0xF9_s(8_w) % 2_s(8_w)).to_int64(), -1);
+    EXPECT_EQ((7_s(8_w) / 0xFE_s(8_w)).to_int64(), -3);
+    EXPECT_EQ((7_s(8_w) % 0xFE_s(8_w)).to_int64(), 1);
+    EXPECT_EQ((0xF9_s(8_w) / 0xFE_s(8_w)).to_int64(), 3);
+    EXPECT_TRUE((0xF9_s(8_w) / 2_s(8_w)).is_signed());
+}
+
+TEST(DecimalTest, BasicTest)
+{
+    EXPECT_EQ("0d255"_u(), 0xFF_u(8_w));
+    EXPECT_EQ("0d0"_u(), 0_u(1_w));
+    EXPECT_EQ("0d100"_u(16_w), 100_u(16_w));
+    EXPECT_EQ("0d18446744073709551616"_u(), "0x10000000000000000"_u(65_w));
+
+    EXPECT_EQ(0xFF_u(8_w).to_string(num_base::dec), "255");
+    EXPECT_EQ(0_u(8_w).to_string(num_base::dec), "0");
+    EXPECT_EQ(0xF9_s(8_w).to_string(num_base::dec), "-7");
+    EXPECT_EQ(0xF9_u(8_w).to_string(num_base::dec), "249");
+}
+
+TEST(DecimalTest, LargeTest)
+{
+    /* Long enough to go through the divide-and-conquer paths */
+    std::string digits;
+    for (std::size_t i = 0; i < 3000; i++) {
+        digits.push_back(static_cast<char>('1' + i * 7 % 9));
+    }
+    bits b{"0d" + digits};
+    EXPECT_EQ(b.to_string(num_base::dec), digits);
+
+    /* 10^3000 - 1, plus one */
+    bits n{"0d" + std::string(3000, '9')};
+    n = n.zext(n.width() + 1);
+    n += bits{n.width(), 1};
+    EXPECT_EQ(n.to_string(num_base::dec), "1" + std::string(3000, '0'));
+}
+
+TEST(DecimalTest, ScalingTest)
+{
+    /* Best of a few runs, to keep scheduler noise out of the ratio */
+    auto time = [](std::size_t width) {
+        bits b{width, 0};
+        uint64_t seed = width;
+        for (std::size_t i = 0; i < width; i += 64) {
+            seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+            b.set_nbits(seed, i, 64);
+        }
+        double best = 1e9;
+        for (int i = 0; i < 3; i++) {
+            auto start = std::chrono::steady_clock::now();
+            std::string s = b.to_string(num_base::dec);
+            std::chrono::duration<double> d =
+                std::chrono::steady_clock::now() - start;
+            EXPECT_FALSE(s.empty());
+            best = std::min(best, d.count());
+        }
+        return best;
+    };
+
+    /* 16 times the width costs 256 times as much when quadratic */
+    double small = time(1 << 14), large = time(1 << 18);
+    EXPECT_LT(large / small, 160) << small << " " << large;
+}
+
+TEST(ExprTest, BasicTest)
+{
+    bits a = "0xDEADBEEFCAFEBABE1234"_u(80_w);
+    bits b = "0x0123456789ABCDEF5678"_u(80_w);
+    bits c = "0xFFFF0000FFFF0000AAAA"_u(80_w);
+    bits d = "0x3C3C"_u(16_w);
+
+    EXPECT_EQ(expr::eval(((expr::lazy(a) ^ b) & ~expr::lazy(c)) | d),
+              ((a ^ b) & ~c) | d);
+    EXPECT_EQ(expr::eval((expr::lazy(a) << 37) ^ (expr::lazy(b) >> 5)),
+              (a << 37) ^ (b >> 5));
+    EXPECT_EQ(expr::eval(expr::lazy(a) << 64), a << 64);
+    EXPECT_EQ(expr::eval(expr::select(c, a, b)), (c & a) | (~c & b));
+    EXPECT_EQ(expr::eval(~expr::lazy(d)).width(), 16);
+}
+
+TEST(ExprTest, SignedTest)
+{
+    bits a = 0xF0_s(8_w), b = 0x0F0F_s(16_w);
+    EXPECT_EQ(expr::eval(expr::lazy(a) | b), a | b);
+    EXPECT_TRUE(expr::eval(expr::lazy(a) | b).is_signed());
+    EXPECT_EQ(expr::eval(expr::lazy(a) >> 4), 0xFF_s(8_w));
+    EXPECT_EQ(expr::eval(expr::lazy(a) | 0x0F0F_u(16_w)), 0x0FFF_u(16_w));
+}
+
+TEST(ExprTest, AssignTest)
+{
+    bits x = "0x123456789ABCDEF0"_u(64_w), y = "0xFF00FF00FF00FF00"_u(64_w);
+    bits expect = (x ^ y) & ~(x << 4);
+    const bits::block_type *storage = x.data();
+
+    /* Same width: written in place, shifted operands are read first */
+    expr::assign(x, expr::lazy(x) ^ y);
+    EXPECT_EQ(x.data(), storage);
+    x ^= y;
+    expr::assign(x, (expr::lazy(x) ^ y) & ~(expr::lazy(x) << 4));
+    EXPECT_EQ(x, expect);
+
+    /* Different width: reallocated */
+    expr::assign(x, (expr::lazy(y) & 0xF_u(4_w)) | bits{100, 1});
+    EXPECT_EQ(x, bits(100, 1));
+}
+
+TEST(IntegerOperandTest, BitwiseTest)
+{
+    bits a = "0xDEADBEEFCAFEBABE12345678"_u(96_w);
+    EXPECT_EQ(a & 0xFFFF, "0x5678"_u(96_w));
+    EXPECT_EQ(0xFFFF & a, "0x5678"_u(96_w));
+    EXPECT_EQ(a | 0xF, "0xDEADBEEFCAFEBABE1234567F"_u(96_w));
+    EXPECT_EQ(a ^ ~0ULL, "0xDEADBEEF35014541EDCBA987"_u(96_w));
+    EXPECT_EQ(a & -1, a);
+    EXPECT_EQ(a ^ static_cast<__int128>(-1), ~a);
+
+    unsigned __int128 mask = static_cast<unsigned __int128>(0xFFFF) << 64;
+    EXPECT_EQ(a & mask, "0xBEEF0000000000000000"_u(96_w));
+
+    bits b = 0xFF_u(8_w);
+    b &= 0x0F0F;
+    EXPECT_EQ(b, 0x0F_u(8_w));
+}
+
+TEST(IntegerOperandTest, ArithmeticTest)
+{
+    bits a = "0xFFFFFFFFFFFFFFFFFFFFFFFFFF"_u(104_w);
+    EXPECT_EQ(a + 1, bits(104, 0));
+    EXPECT_EQ(bits(104, 0) - 1, a);
+    EXPECT_EQ(1 + a, bits(104, 0));
+    EXPECT_EQ(a + -2, a - 2);
+    EXPECT_EQ(a - 2, "0xFFFFFFFFFFFFFFFFFFFFFFFFFD"_u(104_w));
+    EXPECT_EQ(5 - 3_u(8_w), 2_u(8_w));
+
+    bits c = "0x1FFFFFFFF"_u(33_w);
+    c += 1;
+    EXPECT_EQ(c, 0_u(33_w));
+    c -= static_cast<__int128>(1) << 100;
+    EXPECT_EQ(c, 0_u(33_w));
+    c -= 1;
+    EXPECT_EQ(c, "0x1FFFFFFFF"_u(33_w));
+
+    bits s = 0x7F_s(8_w);
+    s += 1;
+    EXPECT_EQ(s.to_int64(), -128);
+    EXPECT_TRUE(s.is_signed());
+}
+
+TEST(IntegerOperandTest, CompareTest)
+{
+    EXPECT_TRUE(0_u(32_w) == 0);
+    EXPECT_TRUE(0 == 0_u(1_w));
+    EXPECT_TRUE(255_u(8_w) == 255U);
+    EXPECT_TRUE(255_u(8_w) != -1);
+    EXPECT_TRUE(0xFF_s(8_w) == -1);
+    EXPECT_TRUE(0xFF_s(8_w) < 0);
+    EXPECT_TRUE(0xFF_u(8_w) > 0);
+    EXPECT_TRUE(3 < 4_u(8_w));
+    EXPECT_TRUE(4_u(8_w) <= 4);
+    EXPECT_TRUE(4_u(8_w) >= 4LL);
+
+    bits big = "0x100000000000000000000000000000000"_u(132_w);
+    EXPECT_TRUE(big > ~static_cast<unsigned __int128>(0));
+    EXPECT_TRUE(big > std::numeric_limits<uint64_t>::max());
+}
+
+TEST(SubtractTest, WidthTest)
+{
+    /* An unsigned rhs narrower than lhs is zero-extended */
+    EXPECT_EQ("0x100"_u(12_w) - 0x1_u(4_w), "0x0FF"_u(12_w));
+    EXPECT_EQ(0x1_u(4_w) - "0x2"_u(12_w), "0xFFF"_u(12_w));
+    EXPECT_EQ("0x123456789"_u(36_w) - "0x123456789"_u(36_w), 0_u(36_w));
+
+    bits a = "0x123456789"_u(36_w);
+    const bits::block_type *storage = a.data();
+    a -= 1_u(1_w);
+    EXPECT_EQ(a, "0x123456788"_u(36_w));
+    EXPECT_EQ(a.data(), storage);
+    a -= a;
+    EXPECT_EQ(a, 0_u(36_w));
+}
+
+TEST(ArithmeticVariantTest, WrapTest)
+{
+    bits a = "0xFFFFFFFFFF"_u(40_w);
+    const bits::block_type *storage = a.data();
+    a.add_wrap(1_u(1_w));
+    EXPECT_EQ(a, 0_u(40_w));
+    EXPECT_EQ(a.data(), storage);
+
+    a.sub_wrap(2_u(8_w));
+    EXPECT_EQ(a, "0xFFFFFFFFFE"_u(40_w));
+
+    /* A wider rhs is truncated to the width */
+    a.add_wrap("0x10000000003"_u(44_w));
+    EXPECT_EQ(a, 1_u(40_w));
+
+    bits s = 0xFE_s(8_w);
+    s.add_wrap(0xF_s(4_w));
+    EXPECT_EQ(s.to_int64(), -3);
+}
+
+TEST(ArithmeticVariantTest, ExpandTest)
+{
+    EXPECT_EQ(add_expand(0xFF_u(8_w), 1_u(1_w)), 0x100_u(9_w));
+    EXPECT_EQ(add_expand(0xFFFFFFFF_u(32_w), 0xFFFFFFFF_u(32_w)),
+              "0x1FFFFFFFE"_u(33_w));
+    EXPECT_EQ(sub_expand(0_u(8_w), 1_u(8_w)), 0x1FF_u(9_w));
+
+    bits s = add_expand(0x80_s(8_w), 0x80_s(8_w));
+    EXPECT_EQ(s.width(), 9);
+    EXPECT_EQ(s.to_int64(), -256);
+    EXPECT_EQ(sub_expand(0x7F_s(8_w), 0x80_s(8_w)).to_int64(), 255);
+}
+
+TEST(ArithmeticVariantTest, CarryTest)
+{
+    bits a = "0xFFFFFFFFFFFFFFFF"_u(64_w);
+    EXPECT_TRUE(a.add_with_carry(1_u(1_w)));
+    EXPECT_EQ(a, 0_u(64_w));
+    EXPECT_FALSE(a.add_with_carry(0_u(1_w), true));
+    EXPECT_EQ(a, 1_u(64_w));
+
+    bits b = 0x7_u(3_w);
+    EXPECT_TRUE(b.add_with_carry(0x7_u(3_w), true));
+    EXPECT_EQ(b, 0x7_u(3_w));
+    EXPECT_FALSE(b.add_with_carry(0_u(3_w)));
+}
+
+TEST(ArithmeticVariantTest, SaturateTest)
+{
+    EXPECT_EQ(bits(0xF0_u(8_w)).add_sat(0x20_u(8_w)), 0xFF_u(8_w));
+    EXPECT_EQ(bits(0xF0_u(8_w)).add_sat(0x0E_u(8_w)), 0xFE_u(8_w));
+    EXPECT_EQ(bits(0x10_u(8_w)).sub_sat(0x20_u(8_w)), 0_u(8_w));
+    EXPECT_EQ(bits(0x30_u(8_w)).sub_sat(0x20_u(8_w)), 0x10_u(8_w));
+
+    EXPECT_EQ(bits(0x70_s(8_w)).add_sat(0x20_s(8_w)).to_int64(), 127);
+    EXPECT_EQ(bits(0x90_s(8_w)).add_sat(0xE0_s(8_w)).to_int64(), -128);
+    EXPECT_EQ(bits(0x90_s(8_w)).add_sat(0x20_s(8_w)).to_int64(), -80);
+    EXPECT_EQ(bits(0x90_s(8_w)).sub_sat(0x20_s(8_w)).to_int64(), -128);
+    EXPECT_EQ(bits(0x70_s(8_w)).sub_sat(0xE0_s(8_w)).to_int64(), 127);
+    EXPECT_EQ(bits(0x70_s(8_w)).sub_sat(0x20_s(8_w)).to_int64(), 80);
+
+    bits wide = bits::ones(100);
+    wide.add_sat(1_u(1_w));
+    EXPECT_EQ(wide, bits::ones(100));
+}
+
+TEST(GF2Test, ClmulTest)
+{
+    /* (x^3 + x + 1)(x + 1) = x^4 + x^3 + x^2 + 1 */
+    EXPECT_EQ(clmul(0xB_u(4_w), 0x3_u(2_w)), 0x1D_u(5_w));
+    EXPECT_EQ(clmul(0_u(0_w), 0x3_u(2_w)).width(), 0);
+
+    utils::limb hi;
+    EXPECT_EQ(utils::clmul64(~0ULL, ~0ULL, hi), 0x5555555555555555ULL);
+    EXPECT_EQ(hi, 0x5555555555555555ULL);
+
+    /* Karatsuba against schoolbook */
+    using utils::limb;
+    std::vector<limb> a(53), b(53);
+    uint64_t seed = 3;
+    for (std::size_t i = 0; i < a.size(); i++) {
+        seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+        a[i] = seed;
+        seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+        b[i] = seed;
+    }
+    std::vector<limb> school(106, 0), kara(106);
+    utils::clmul_schoolbook(a.data(), a.size(), b.data(), b.size(),
+                            school.data());
+    utils::clmul_karatsuba(a.data(), b.data(), a.size(), kara.data());
+    EXPECT_EQ(school, kara);
+}
+
+TEST(GF2Test, ModTest)
+{
+    /* x^4 + x^3 + x^2 + 1 mod x^3 + x + 1 = x^2 + x... */
+    EXPECT_EQ(gf2_mod(0x1D_u(5_w), 0xB_u(4_w)), 0x0_u(3_w));
+    EXPECT_EQ(gf2_mod(0x1C_u(5_w), 0xB_u(4_w)), 0x1_u(3_w));
+    EXPECT_EQ(gf2_mod(0x5_u(3_w), 0xB_u(4_w)), 0x5_u(3_w));
+    EXPECT_THROW(gf2_mod(0x5_u(3_w), 0_u(8_w)), std::domain_error);
+
+    /* Long input against bit-serial long division */
+    bits a{1000, 0};
+    uint64_t seed = 11;
+    for (std::size_t i = 0; i < a.width(); i += 64) {
+        seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+        a.set_nbits(seed, i, 64);
+    }
+    for (bits poly : {"0x104C11DB7"_u(33_w), "0x11D"_u(9_w),
+                      "0x100000000000000000000000000000087"_u(129_w)}) {
+        std::size_t m = poly.width() - 1;
+        bits r = a;
+        for (std::size_t i = r.width(); i-- > m;) {
+            if (r[i]) {
+                r ^= (poly.zext(r.width()) << (i - m));
+            }
+        }
+        EXPECT_EQ(gf2_mod(a, poly), r(m - 1, 0));
+    }
+}
+
+TEST(GF2Test, FieldTest)
+{
+    /* AES field: {57} * {83} = {c1} */
+    gf2_modulus aes{0x11B_u(9_w)};
+    EXPECT_EQ(aes.degree(), 8);
+    EXPECT_EQ(aes.mul(0x57_u(8_w), 0x83_u(8_w)), 0xC1_u(8_w));
+    EXPECT_EQ(gf2_mul(0x57_u(8_w), 0x13_u(8_w), 0x11B_u(9_w)), 0xFE_u(8_w));
+
+    /* Every nonzero element of GF(2^8) has order dividing 255 */
+    bits x = 0x3_u(8_w), p = 0x1_u(8_w);
+    for (int i = 0; i < 255; i++) {
+        p = aes.mul(p, x);
+    }
+    EXPECT_EQ(p, 0x1_u(8_w));
+}
+
+TEST(CRCTest, CheckTest)
+{
+    const std::string msg = "123456789";
+    auto data = reinterpret_cast<const uint8_t *>(msg.data());
+
+    EXPECT_EQ(crc_engine::crc32().compute(data, msg.size()), 0xCBF43926U);
+    EXPECT_EQ(crc_engine::crc32c().compute(data, msg.size()), 0xE3069283U);
+    EXPECT_EQ(crc_engine::crc64().compute(data, msg.size()),
+              0x995DC9BBDF1939FAULL);
+
+    /* CRC-64/ECMA-182, CRC-16/CCITT-FALSE, CRC-16/RIELLO, CRC-8, CRC-5/USB */
+    EXPECT_EQ(crc_engine(64, 0x42F0E1EBA9EA3693).compute(data, msg.size()),
+              0x6C40DF5F0B497347ULL);
+    EXPECT_EQ(crc_engine(16, 0x1021, 0xFFFF).compute(data, msg.size()),
+              0x29B1U);
+    EXPECT_EQ(crc_engine(16, 0x1021, 0xB2AA, 0, true, true)
+                  .compute(data, msg.size()),
+              0x63D0U);
+    EXPECT_EQ(crc_engine(8, 0x07).compute(data, msg.size()), 0xF4U);
+    EXPECT_EQ(crc_engine(5, 0x05, 0x1F, 0x1F, true, true)
+                  .compute(data, msg.size()),
+              0x19U);
+
+    EXPECT_THROW(crc_engine(65, 1), std::invalid_argument);
+}
+
+TEST(CRCTest, BitsTest)
+{
+    std::vector<uint8_t> bytes(77);
+    for (std::size_t i = 0; i < bytes.size(); i++) {
+        bytes[i] = static_cast<uint8_t>(i * 37 + 11);
+    }
+    bits b{bytes.size() * 8, 0};
+    for (std::size_t i = 0; i < bytes.size(); i++) {
+        b.set_nbits(bytes[i], 8 * i, 8);
+    }
+
+    for (const auto &crc :
+         {crc_engine::crc32(), crc_engine(16, 0x1021, 0xFFFF)}) {
+        uint64_t expect = crc.compute(bytes.data(), bytes.size());
+        EXPECT_EQ(crc.compute(b), expect);
+
+        /* Unaligned views read through get_nbits */
+        bits shifted = cat(b, 0_u(3_w));
+        EXPECT_EQ(crc.compute(bits_view(shifted)(shifted.width() - 1, 3)),
+                  expect);
+    }
+}
+
+TEST(CRCTest, TailTest)
+{
+    /* Bit-serial reference for a message of any length */
+    auto reference = [](const bits &msg, bool refin) {
+        uint32_t reg = 0xFFFF;
+        std::size_t nbytes = msg.width() / 8;
+        auto feed = [&reg](bool bit) {
+            bool top = ((reg >> 15) & 1) ^ bit;
+            reg = static_cast<uint32_t>((reg << 1) & 0xFFFF) ^
+                  (top ? 0x1021 : 0);
+        };
+        for (std::size_t i = 0; i < nbytes; i++) {
+            for (std::size_t j = 0; j < 8; j++) {
+                feed(msg[8 * i + (refin ? j : 7 - j)]);
+            }
+        }
+        std::size_t tail = msg.width() - nbytes * 8;
+        for (std::size_t j = 0; j < tail; j++) {
+            feed(msg[8 * nbytes + (refin ? j : tail - 1 - j)]);
+        }
+        return refin ? utils::reflect(reg, 16) : reg;
+    };
+
+    bits msg = "0x5A3C96E1F0127B"_u(53_w);
+    crc_engine normal{16, 0x1021, 0xFFFF};
+    crc_engine reflected{16, 0x1021, 0xFFFF, 0, true, true};
+    EXPECT_EQ(normal.compute(msg), reference(msg, false));
+    EXPECT_EQ(reflected.compute(msg), reference(msg, true));
+
+    bits one = 1_u(1_w);
+    EXPECT_EQ(normal.compute(one), reference(one, false));
+    EXPECT_EQ(reflected.compute(one), reference(one, true));
+}
+
+TEST(CRCTest, UpdateCombineTest)
+{
+    std::vector<uint8_t> bytes(1000);
+    for (std::size_t i = 0; i < bytes.size(); i++) {
+        bytes[i] = static_cast<uint8_t>(i * 131 + 7);
+    }
+
+    for (const auto &crc :
+         {crc_engine::crc32(), crc_engine::crc64(),
+          crc_engine(16, 0x1021, 0xFFFF),
+          crc_engine(5, 0x05, 0x1F, 0x1F, true, true)}) {
+        uint64_t whole = crc.compute(bytes.data(), bytes.size());
+        uint64_t a = crc.compute(bytes.data(), 333);
+        uint64_t b = crc.compute(bytes.data() + 333, bytes.size() - 333);
+
+        EXPECT_EQ(crc.update(a, bytes.data() + 333, bytes.size() - 333),
+                  whole);
+        EXPECT_EQ(crc.combine(a, b, (bytes.size() - 333) * 8), whole);
+        EXPECT_EQ(crc.combine(whole, crc.empty(), 0), whole);
+    }
+
+    /* Combine across an unaligned split of bits */
+    bits msg = "0x123456789ABCDEF0FEDCBA987"_u(100_w);
+    crc_engine crc = crc_engine::crc32c();
+    EXPECT_EQ(crc.combine(crc.compute(msg(63, 0)), crc.compute(msg(99, 64)),
+                          36),
+              crc.update(crc.compute(msg(63, 0)), msg(99, 64)));
+}
+
+TEST(HammingTest, DistanceTest)
+{
+    bits a = "0xDEADBEEFCAFEBABE12345678DEADBEEF1"_u(132_w);
+    bits b = "0x0123456789ABCDEF0FEDCBA987654321F"_u(132_w);
+    EXPECT_EQ(hamming_distance(a, b), (a ^ b).count());
+    EXPECT_EQ(hamming_distance(a, a), 0);
+
+    /* Different widths and unaligned views */
+    bits c = 0xFFFF_u(16_w);
+    EXPECT_EQ(hamming_distance(a, c), (a ^ c).count());
+    EXPECT_EQ(hamming_distance(bits_view(a)(100, 3), bits_view(b)(97, 0)),
+              (a(100, 3) ^ b(97, 0)).count());
+
+    bits w = bits::ones(1000);
+    EXPECT_EQ(hamming_distance(w, bits(1000, 0)), 1000);
+    EXPECT_EQ(w.count(), 1000);
+}
+
+TEST(HammingTest, TopKTest)
+{
+    fingerprint_set set{256};
+    std::vector<bits> codes;
+    uint64_t seed = 5;
+    for (std::size_t i = 0; i < 40000; i++) {
+        bits code{256, 0};
+        for (std::size_t j = 0; j < 256; j += 64) {
+            seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+            code.set_nbits(seed, j, 64);
+        }
+        set.push_back(code);
+        codes.push_back(std::move(code));
+    }
+    EXPECT_EQ(set.size(), 40000);
+    EXPECT_EQ(set[123], codes[123]);
+
+    bits query = codes[777];
+    query.set(3, !query[3]);
+
+    std::vector<fingerprint_set::match> expect;
+    for (std::size_t i = 0; i < codes.size(); i++) {
+        expect.push_back({i, hamming_distance(codes[i], query)});
+    }
+    std::sort(expect.begin(), expect.end());
+    expect.resize(10);
+
+    EXPECT_EQ(set.top_k(query, 10, 1), expect);
+    EXPECT_EQ(set.top_k(query, 10, 4), expect);
+    EXPECT_EQ(set.top_k(query, 1)[0].index, 777);
+    EXPECT_EQ(set.top_k(query, 1)[0].distance, 1);
+
+    EXPECT_THROW(set.push_back(bits(255, 0)), std::invalid_argument);
+}
+
+TEST(ReduceTest, BasicTest)
+{
+    bits z = bits::zeros(100);
+    bits o = bits::ones(100);
+    bits b = "0xDEADBEEFCAFEBABE12345678F"_u(100_w);
+
+    EXPECT_FALSE(z.any());
+    EXPECT_TRUE(z.none());
+    EXPECT_FALSE(z.all());
+    EXPECT_TRUE(o.all());
+    EXPECT_TRUE(o.any());
+    EXPECT_FALSE(b.all());
+    EXPECT_TRUE(b.any());
+
+    EXPECT_EQ(b.parity(), b.count() % 2 == 1);
+    EXPECT_FALSE(o.parity());
+    EXPECT_TRUE(bits::ones(99).parity());
+
+    /* Empty operands reduce to the identity */
+    EXPECT_TRUE(and_reduce(bits{0, 0}));
+    EXPECT_FALSE(or_reduce(bits{0, 0}));
+    EXPECT_FALSE(xor_reduce(bits{0, 0}));
+}
+
+TEST(ReduceTest, RangeTest)
+{
+    bits b = "0xFFFFFFFFFFFFFFFFF0000000000000001"_u(132_w);
+    bits_view v{b};
+
+    /* Aligned and unaligned ranges */
+    EXPECT_TRUE(and_reduce(v(131, 64)));
+    EXPECT_TRUE(and_reduce(v(130, 65)));
+    EXPECT_FALSE(and_reduce(v(131, 63)));
+    EXPECT_FALSE(or_reduce(v(63, 1)));
+    EXPECT_TRUE(or_reduce(v(63, 0)));
+    EXPECT_TRUE(or_reduce(v(100, 33)));
+    EXPECT_TRUE(xor_reduce(v(0, 0)));
+    EXPECT_FALSE(xor_reduce(v(69, 68)));
+    EXPECT_EQ(xor_reduce(v(131, 3)), v(131, 3).count() % 2 == 1);
+
+    EXPECT_EQ(v(100, 33).all(), b(100, 33).all());
+    EXPECT_EQ(v(100, 33).none(), b(100, 33).none());
+}
+
+TEST(MuxTest, MuxTest)
+{
+    bits a = "0xDEADBEEFCAFEBABE1"_u(68_w);
+    bits b = 0x1234_u(16_w);
+
+    EXPECT_EQ(mux(true, a, b), a);
+    EXPECT_EQ(mux(false, a, b), b.zext(68));
+    EXPECT_EQ(mux(false, a, b).width(), 68);
+
+    /* Signed operands are sign-extended */
+    bits c = 0xF0_u(8_w).as_signed();
+    bits d = a.as_signed();
+    EXPECT_EQ(mux(false, d, c), c.sext(68));
+    EXPECT_TRUE(mux(false, d, c).is_signed());
+    EXPECT_FALSE(mux(false, a, c).is_signed());
+}
+
+TEST(MuxTest, BlendTest)
+{
+    bits a = "0xDEADBEEFCAFEBABE1"_u(68_w);
+    bits b = "0x0123456789ABCDEF0"_u(68_w);
+    bits m = "0xFF00FF00FF00FF00F"_u(68_w);
+    EXPECT_EQ(blend(m, a, b), (a & m) | (b & ~m));
+
+    /* A narrower mask selects b above its width */
+    bits n = 0xFFFF_u(16_w);
+    EXPECT_EQ(blend(n, a, b), (a & n.zext(68)) | (b & ~n.zext(68)));
+}
+
+TEST(MuxTest, OneHotTest)
+{
+    std::vector<bits> in = {0x11_u(8_w), 0x2222_u(16_w), 0x33_u(8_w),
+                            "0x444444444"_u(36_w)};
+
+    EXPECT_EQ(mux1h(0b0010_u(4_w), in), 0x2222_u(36_w));
+    EXPECT_EQ(mux1h(0b1000_u(4_w), in), "0x444444444"_u(36_w));
+    EXPECT_EQ(mux1h(0b0101_u(4_w), in), 0x33_u(36_w));
+    EXPECT_EQ(mux1h(0b0000_u(4_w), in), bits(36, 0));
+
+    EXPECT_EQ(priority_mux(0b0110_u(4_w), in), 0x2222_u(36_w));
+    EXPECT_EQ(priority_mux(0b1001_u(4_w), in), 0x11_u(36_w));
+    EXPECT_EQ(priority_mux(0b0000_u(4_w), in), "0x444444444"_u(36_w));
+
+    /* Selects wider than a word */
+    std::vector<bits> many;
+    for (uint64_t i = 0; i < 100; i++) {
+        many.push_back(bits(8, i));
+    }
+    bits sel{100, 0};
+    sel.set(70, true);
+    sel.set(90, true);
+    EXPECT_EQ(priority_mux(sel, many), bits(8, 70));
+    EXPECT_EQ(mux1h(sel, many), bits(8, 70 | 90));
+
+    EXPECT_THROW(mux1h(0b01_u(2_w), in), std::invalid_argument);
+    EXPECT_THROW(priority_mux(bits(0, 0), {}), std::invalid_argument);
+}
+
+TEST(SimTest, CombinationalTest)
+{
+    netlist nl;
+    auto a = nl.input(100);
+    auto b = nl.input(100);
+    auto s = nl.input(1);
+    auto sum = nl.add(a, b);
+    auto diff = nl.sub(a, b);
+    auto mixed = nl.bit_xor(nl.bit_and(a, nl.bit_not(b)), b);
+    auto sel = nl.mux(s, sum, diff);
+    auto hi = nl.slice(sel, 99, 37);
+    auto joined = nl.cat(hi, nl.slice(a, 36, 0));
+    auto less = nl.lt(a, b);
+    auto same = nl.eq(a, b);
+
+    simulator sim{nl};
+    bits x = "0xDEADBEEFCAFEBABE123456789"_u(100_w);
+    bits y = "0xF0123456789ABCDEF01234567"_u(100_w);
+    sim.poke(a, x);
+    sim.poke(b, y);
+    sim.poke(s, bits(1, 1));
+    sim.eval();
+
+    EXPECT_EQ(sim.peek(sum), x + y);
+    EXPECT_EQ(sim.peek(diff), x - y);
+    EXPECT_EQ(sim.peek(mixed), (x & ~y) ^ y);
+    EXPECT_EQ(sim.peek(sel), x + y);
+    EXPECT_EQ(sim.peek(joined), cat((x + y)(99, 37), x(36, 0)));
+    EXPECT_EQ(sim.peek(less), bits(1, 1));
+    EXPECT_EQ(sim.peek(same), bits(1, 0));
+
+    sim.poke(s, bits(1, 0));
+    sim.poke(b, x);
+    sim.eval();
+    EXPECT_EQ(sim.peek(sel), bits(100, 0));
+    EXPECT_EQ(sim.peek(same), bits(1, 1));
+    EXPECT_EQ(sim.peek(less), bits(1, 0));
+}
+
+TEST(SimTest, SequentialTest)
+{
+    /* A counter and a two-stage shift register fed by it */
+    netlist nl;
+    auto en = nl.input(1);
+    auto cnt = nl.reg(70);
+    nl.connect(cnt, nl.mux(en, nl.add(cnt, nl.constant(bits(70, 1))), cnt));
+    auto s0 = nl.reg(bits(70, 7));
+    auto s1 = nl.reg(70);
+    nl.connect(s0, cnt);
+    nl.connect(s1, s0);
+
+    simulator sim{nl};
+    EXPECT_EQ(sim.peek(s0), bits(70, 7));
+
+    sim.poke(en, bits(1, 1));
+    sim.step(1000);
+    EXPECT_EQ(sim.cycle(), 1000);
+    EXPECT_EQ(sim.peek(cnt), bits(70, 1000));
+    EXPECT_EQ(sim.peek(s0), bits(70, 999));
+    EXPECT_EQ(sim.peek(s1), bits(70, 998));
+
+    /* Nothing changes once the counter stops, so nothing is evaluated */
+    sim.poke(en, bits(1, 0));
+    sim.step(2);
+    std::size_t n = sim.evaluated();
+    sim.step(100);
+    EXPECT_EQ(sim.evaluated(), n);
+    EXPECT_EQ(sim.peek(s1), bits(70, 1000));
+}
+
+TEST(SimTest, ErrorTest)
+{
+    netlist nl;
+    auto a = nl.input(8);
+    EXPECT_THROW(nl.add(a, nl.input(9)), std::invalid_argument);
+    EXPECT_THROW(nl.slice(a, 8, 0), std::out_of_range);
+    EXPECT_THROW(nl.connect(a, a), std::invalid_argument);
+
+    auto r = nl.reg(8);
+    EXPECT_THROW(simulator{nl}, std::logic_error);
+    nl.connect(r, nl.bit_not(r));
+    simulator sim{nl};
+    EXPECT_THROW(sim.poke(r, bits(8, 0)), std::invalid_argument);
+    sim.step();
+    EXPECT_EQ(sim.peek(r), bits(8, 0xFF));
+}
+
+TEST(SimTest, TransposeTest)
+{
+    uint64_t a[64], t[64];
+    uint64_t seed = 1;
+    for (std::size_t i = 0; i < 64; i++) {
+        seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+        a[i] = t[i] = seed;
+    }
+    utils::transpose64(t);
+    for (std::size_t i = 0; i < 64; i++) {
+        for (std::size_t j = 0; j < 64; j++) {
+            EXPECT_EQ((t[i] >> j) & 1, (a[j] >> i) & 1);
+        }
+    }
+}
+
+TEST(SimTest, ParallelTest)
+{
+    netlist nl;
+    auto a = nl.input(70);
+    auto b = nl.input(70);
+    auto sum = nl.add(a, b);
+    auto diff = nl.sub(a, b);
+    auto less = nl.lt(a, b);
+    auto same = nl.eq(a, b);
+    auto pick = nl.mux(less, nl.bit_xor(a, b), nl.cat(nl.slice(a, 9, 0),
+                                                       nl.slice(b, 69, 10)));
+    auto acc = nl.reg(70);
+    nl.connect(acc, nl.add(acc, a));
+
+    /* More cases than a word, not a multiple of 64 */
+    const std::size_t cases = 150;
+    parallel_simulator psim{nl, cases};
+    simulator sim{nl};
+
+    std::vector<bits> xs, ys;
+    uint64_t seed = 3;
+    for (std::size_t c = 0; c < cases; c++) {
+        bits x{70, 0}, y{70, 0};
+        for (auto *v : {&x, &y}) {
+            seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+            v->set_nbits(seed, 0, 64);
+            v->set_nbits(seed >> 58, 64, 6);
+        }
+        if (c % 10 == 0) {
+            y = x;
+        }
+        xs.push_back(x);
+        ys.push_back(y);
+    }
+    psim.poke(a, xs);
+    psim.poke(b, ys);
+    psim.step(3);
+
+    auto sums = psim.peek(sum);
+    for (std::size_t c = 0; c < cases; c++) {
+        sim.poke(a, xs[c]);
+        sim.poke(b, ys[c]);
+        sim.eval();
+        EXPECT_EQ(sums[c], sim.peek(sum));
+        EXPECT_EQ(psim.peek(diff, c), sim.peek(diff));
+        EXPECT_EQ(psim.peek(less, c), sim.peek(less));
+        EXPECT_EQ(psim.peek(same, c), sim.peek(same));
+        EXPECT_EQ(psim.peek(pick, c), sim.peek(pick));
+        EXPECT_EQ(psim.peek(acc, c), xs[c] + xs[c] + xs[c]);
+    }
+    EXPECT_EQ(psim.peek(a), xs);
+
+    /* Poking one case leaves the others alone */
+    psim.poke(a, 5, bits(70, 0));
+    psim.eval();
+    EXPECT_EQ(psim.peek(sum, 5), ys[5]);
+    EXPECT_EQ(psim.peek(sum, 6), xs[6] + ys[6]);
+
+    EXPECT_THROW(psim.peek(a, cases), std::out_of_range);
+    EXPECT_THROW(psim.poke(a, std::vector<bits>(3, bits(70, 0))),
+                 std::invalid_argument);
+}
+
+namespace
+{
+
+bit_matrix random_matrix(std::size_t rows, std::size_t cols, uint64_t &seed)
+{
+    bit_matrix m{rows, cols};
+    for (std::size_t r = 0; r < rows; r++) {
+        for (std::size_t c = 0; c < cols; c++) {
+            seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+            m.set(r, c, (seed >> 40) & 1);
+        }
+    }
+    return m;
+}
+
+}  // namespace
+
+TEST(MatrixTest, BasicTest)
+{
+    bit_matrix m{std::vector<bits>{0b011_u(3_w), 0b110_u(3_w)}};
+    EXPECT_EQ(m.rows(), 2);
+    EXPECT_EQ(m.cols(), 3);
+    EXPECT_TRUE(m.test(0, 0));
+    EXPECT_FALSE(m.test(0, 2));
+    EXPECT_EQ(m.row(1), 0b110_u(3_w));
+    EXPECT_THROW(m.test(2, 0), std::out_of_range);
+    EXPECT_THROW(m.set_row(0, 0b1_u(1_w)), std::invalid_argument);
+
+    uint64_t seed = 11;
+    bit_matrix a = random_matrix(130, 70, seed);
+    bit_matrix t = a.transpose();
+    EXPECT_EQ(t.rows(), 70);
+    EXPECT_EQ(t.cols(), 130);
+    for (std::size_t r = 0; r < 130; r++) {
+        for (std::size_t c = 0; c < 70; c++) {
+            EXPECT_EQ(t.test(c, r), a.test(r, c));
+        }
+    }
+    EXPECT_EQ(t.transpose(), a);
+    EXPECT_EQ(a ^ a, bit_matrix(130, 70));
+}
+
+TEST(MatrixTest, MultiplyTest)
+{
+    uint64_t seed = 7;
+    bit_matrix a = random_matrix(67, 150, seed);
+    bit_matrix b = random_matrix(150, 2100, seed);
+    bit_matrix c = a * b;
+
+    /* Against the definition, one entry at a time */
+    bit_matrix bt = b.transpose();
+    for (std::size_t r = 0; r < c.rows(); r++) {
+        for (std::size_t j = 0; j < c.cols(); j += 37) {
+            EXPECT_EQ(c.test(r, j), (a.row(r) & bt.row(j)).count() % 2 == 1);
+        }
+    }
+
+    bits v = random_matrix(1, 150, seed).row(0);
+    bits u = random_matrix(1, 67, seed).row(0);
+    bits av = a * v;
+    for (std::size_t r = 0; r < a.rows(); r++) {
+        EXPECT_EQ(av[r], (a.row(r) & v).count() % 2 == 1);
+    }
+    EXPECT_EQ(u * a, a.transpose() * u);
+    EXPECT_EQ(bits_view(u) * c, (u * a) * b);
+
+    EXPECT_THROW(b * a, std::invalid_argument);
+}
+
+TEST(MatrixTest, EliminationTest)
+{
+    EXPECT_EQ(bit_matrix::identity(100).rank(), 100);
+    EXPECT_EQ(bit_matrix(5, 7).rank(), 0);
+
+    /* Row 2 = row 0 + row 1 */
+    bit_matrix m{std::vector<bits>{0b1100_u(4_w), 0b0110_u(4_w),
+                                   0b1010_u(4_w)}};
+    EXPECT_EQ(m.rank(), 2);
+    EXPECT_THROW(m.inverse(), std::invalid_argument);
+
+    bit_matrix e = m;
+    EXPECT_EQ(e.echelonize(), 2);
+    EXPECT_EQ(e.row(0), 0b1010_u(4_w));
+    EXPECT_EQ(e.row(1), 0b1100_u(4_w));
+    EXPECT_EQ(e.row(2), 0b0000_u(4_w));
+
+    uint64_t seed = 3;
+    for (std::size_t tries = 0; tries < 10; tries++) {
+        bit_matrix a = random_matrix(150, 150, seed);
+        if (a.rank() < 150) {
+            EXPECT_THROW(a.inverse(), std::domain_error);
+            continue;
+        }
+        bit_matrix inv = a.inverse();
+        EXPECT_EQ(a * inv, bit_matrix::identity(150));
+        EXPECT_EQ(inv * a, bit_matrix::identity(150));
+    }
+}
+
+namespace
+{
+
+/* Reference LFSRs, one bit per step */
+bits fibonacci_ref(bits taps, bits state, std::size_t len)
+{
+    std::size_t n = taps.width();
+    bits out{len, 0};
+    for (std::size_t t = 0; t < len; t++) {
+        out.set(t, state[0]);
+        bool fb = (state & taps).count() % 2 == 1;
+        state >>= 1;
+        state.set(n - 1, fb);
+    }
+    return out;
+}
+
+bits galois_ref(bits taps, bits state, std::size_t len)
+{
+    std::size_t n = taps.width();
+    bits out{len, 0};
+    for (std::size_t t = 0; t < len; t++) {
+        bool o = state[n - 1];
+        out.set(t, o);
+        state <<= 1;
+        if (o) {
+            state ^= taps;
+        }
+    }
+    return out;
+}
+
+}  // namespace
+
+TEST(LFSRTest, SequenceTest)
+{
+    /* PRBS7, x^7 + x^6 + 1 */
+    bits taps7 = 0b1000001_u(7_w);
+    lfsr prbs7{taps7, bits::ones(7), lfsr::form::fibonacci};
+    EXPECT_EQ(prbs7.generate(300), fibonacci_ref(taps7, bits::ones(7), 300));
+
+    uint64_t seed = 9;
+    for (std::size_t n : {5, 64, 65, 100, 200}) {
+        bits taps{n, 0}, init{n, 0};
+        for (std::size_t i = 0; i < n; i += 64) {
+            seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+            taps.set_nbits(seed, i, 64);
+            seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+            init.set_nbits(seed, i, 64);
+        }
+
+        lfsr g{taps, init};
+        EXPECT_EQ(g.generate(1000), galois_ref(taps, init, 1000));
+
+        lfsr f{taps, init, lfsr::form::fibonacci};
+        EXPECT_EQ(f.state(), init);
+        EXPECT_EQ(f.generate(333), fibonacci_ref(taps, init, 333));
+        f.seed(init);
+        EXPECT_EQ(f.next_bit(), init[0]);
+    }
+}
+
+TEST(LFSRTest, JumpTest)
+{
+    bits taps7 = 0b1000001_u(7_w);
+    lfsr prbs7{taps7, 0b1010101_u(7_w), lfsr::form::fibonacci};
+    lfsr copy = prbs7;
+    copy.jump(127);
+    EXPECT_EQ(copy.state(), prbs7.state());
+    copy.jump(1);
+    EXPECT_NE(copy.state(), prbs7.state());
+
+    /* Jumping a copy ahead matches generating past the gap */
+    bits taps{241, 0};
+    taps.set(0, true);
+    taps.set(70, true);
+    taps.set(200, true);
+    for (auto f : {lfsr::form::galois, lfsr::form::fibonacci}) {
+        lfsr a{taps, bits(241, 12345), f};
+        lfsr b = a;
+        a.generate(5000);
+        b.jump(5000);
+        EXPECT_EQ(a.state(), b.state());
+        EXPECT_EQ(a.generate(100), b.generate(100));
+    }
+
+    EXPECT_THROW(lfsr(bits(0, 0), bits(0, 0)), std::invalid_argument);
+    EXPECT_THROW(lfsr(taps7, bits(8, 0)), std::invalid_argument);
+}
+
+TEST(RopeTest, BasicTest)
+{
+    bits b{10000, 0};
+    uint64_t seed = 21;
+    for (std::size_t i = 0; i < 10000; i += 64) {
+        seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+        b.set_nbits(seed, i, 64);
+    }
+
+    bits_rope r{b};
+    EXPECT_EQ(r.width(), 10000);
+    EXPECT_EQ(r.to_bits(), b);
+    EXPECT_EQ(r.count(), b.count());
+    EXPECT_EQ(r.test(4097), b[4097]);
+    EXPECT_EQ(r.get_nbits(4090, 64), b.get_nbits(4090, 64));
+    EXPECT_EQ(r(6000, 3000).to_bits(), b(6000, 3000));
+    EXPECT_THROW(r.test(10000), std::out_of_range);
+    EXPECT_THROW(r(10000, 0), std::out_of_range);
+    EXPECT_THROW(r.get_nbits(0, 65), std::invalid_argument);
+    EXPECT_THROW(b.get_nbits(0, 65), std::invalid_argument);
+
+    auto halves = r.split(4321);
+    EXPECT_EQ(halves.first.to_bits(), b(4320, 0));
+    EXPECT_EQ(halves.second.to_bits(), b(9999, 4321));
+    EXPECT_EQ(cat(halves.second, halves.first), r);
+
+    /* Copies are snapshots */
+    bits_rope snap = r;
+    r.erase(5000, 100);
+    EXPECT_EQ(snap.to_bits(), b);
+    EXPECT_EQ(r.to_bits(), cat(b(9999, 5001), b(99, 0)));
+
+    EXPECT_TRUE(bits_rope{}.empty());
+    EXPECT_EQ(bits_rope{}.append(b).to_bits(), b);
+}
+
+TEST(RopeTest, EditTest)
+{
+    bits ref = 0b1_u(1_w);
+    bits_rope r{ref};
+    uint64_t seed = 5;
+    auto rnd = [&seed](std::size_t n) {
+        seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+        return static_cast<std::size_t>(seed >> 33) % n;
+    };
+
+    for (std::size_t i = 0; i < 300; i++) {
+        std::size_t w = ref.width();
+        if (rnd(3) != 0 || w < 2000) {
+            bits v{1 + rnd(3000), 0};
+            for (std::size_t j = 0; j < v.width(); j += 64) {
+                v.set_nbits(seed, j, 64);
+            }
+            std::size_t pos = rnd(w + 1);
+            r.insert(pos, v);
+            bits hi = pos < w ? ref(w - 1, pos) : bits{0, 0};
+            bits lo = pos > 0 ? ref(pos - 1, 0) : bits{0, 0};
+            ref = cat(cat(hi, v), lo);
+        } else {
+            std::size_t e = rnd(w - 1);
+            std::size_t s = e + rnd(std::min<std::size_t>(w - 1 - e, 1500));
+            r.erase(s, e);
+            bits hi = s + 1 < w ? ref(w - 1, s + 1) : bits{0, 0};
+            bits lo = e > 0 ? ref(e - 1, 0) : bits{0, 0};
+            ref = cat(hi, lo);
+        }
+        ASSERT_EQ(r.width(), ref.width());
+    }
+    EXPECT_EQ(r.to_bits(), ref);
+
+    /* Still balanced: AVL height is below 1.45 log2 of the leaf count */
+    std::size_t leaves = 2 * ref.width() / bits_rope::leaf_bits + 1;
+    EXPECT_LE(r.num_leaves(), leaves);
+    EXPECT_LT(r.height(), 1.45 * std::log2(leaves) + 2);
+}
+
+TEST(RopeTest, SmallEditTest)
+{
+    /* Single-bit edits merge into their neighbours instead of piling up */
+    bits ref{20000, 0};
+    for (std::size_t i = 0; i < ref.width(); i += 64) {
+        ref.set_nbits(0x0123456789ABCDEFULL * (i + 1), i, 64);
+    }
+    bits_rope r{ref};
+    uint64_t seed = 9;
+    for (std::size_t i = 0; i < 2000; i++) {
+        seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+        std::size_t w = ref.width();
+        std::size_t pos = static_cast<std::size_t>(seed >> 33) % w;
+        if (i % 4 == 3) {
+            r.erase(pos, pos);
+            ref.erase(pos, pos);
+        } else {
+            bits v{1, seed >> 63};
+            r.insert(pos, v);
+            ref.insert(pos, v);
+        }
+    }
+    EXPECT_EQ(r.to_bits(), ref);
+    EXPECT_LE(r.num_leaves(), 2 * ref.width() / bits_rope::leaf_bits + 1);
+}
+
+TEST(EditTest, BasicTest)
+{
+    bits b = 0xABCD_u(16_w);
+    EXPECT_EQ(b.insert(8, 0x5_u(4_w)), 0xAB5CD_u(20_w));
+    EXPECT_EQ(b.erase(11, 8), 0xABCD_u(16_w));
+    EXPECT_EQ(b.replace(7, 4, 0x123_u(12_w)), 0xAB123D_u(24_w));
+    EXPECT_EQ(b.replace(23, 16, 0x0_u(0_w)), 0x123D_u(16_w));
+    EXPECT_EQ(b.insert(16, b), 0x123D123D_u(32_w));
+    EXPECT_EQ(b.erase(31, 0).width(), 0);
+    EXPECT_EQ(b.insert(0, 0x7_u(3_w)), 0x7_u(3_w));
+
+    bits s = 0xF0_u(8_w).as_signed();
+    s.erase(3, 0);
+    EXPECT_TRUE(s.is_signed());
+    EXPECT_TRUE(s.is_negative());
+
+    EXPECT_THROW(b.insert(4, 0x1_u(1_w)), std::out_of_range);
+    EXPECT_THROW(b.erase(3, 0), std::out_of_range);
+    EXPECT_THROW(b.erase(0, 1), std::out_of_range);
+    EXPECT_THROW(b.replace(3, 0, 0x1_u(1_w)), std::out_of_range);
+}
+
+TEST(EditTest, CapacityTest)
+{
+    bits b{1000, 0};
+    b.set_nbits(0x0123456789ABCDEFULL, 500, 64);
+    const auto *p = b.data();
+    EXPECT_EQ(b.capacity(), 1024);
+
+    /* Shrinking keeps the buffer, and the freed room is reused */
+    b.erase(999, 600);
+    EXPECT_EQ(b.data(), p);
+    EXPECT_EQ(b.capacity(), 1024);
+    b.insert(0, bits{400, 0});
+    EXPECT_EQ(b.data(), p);
+    EXPECT_EQ(b.get_nbits(900, 64), 0x0123456789ABCDEFULL);
+    EXPECT_EQ(b(999, 964), bits(36, 0));
+
+    b.reserve(5000);
+    p = b.data();
+    b.replace(10, 0, bits::ones(3000));
+    EXPECT_EQ(b.data(), p);
+    EXPECT_EQ(b.width(), 3989);
+    EXPECT_EQ(b.count(), 3000 + 64 - 32);
+}
+
+TEST(EditTest, RandomTest)
+{
+    bits ref{100, 0};
+    bits b = ref;
+    uint64_t seed = 9;
+    auto rnd = [&seed](std::size_t n) {
+        seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+        return static_cast<std::size_t>(seed >> 33) % n;
+    };
+    auto slice = [&ref](std::size_t s, std::size_t e) {
+        return s >= e && s < ref.width() ? ref(s, e) : bits{0, 0};
+    };
+
+    for (std::size_t i = 0; i < 500; i++) {
+        std::size_t w = ref.width();
+        bits v{rnd(200), 0};
+        for (std::size_t j = 0; j < v.width(); j += 64) {
+            v.set_nbits(seed, j, 64);
+        }
+
+        std::size_t op = w < 50 ? 0 : rnd(3);
+        if (op == 0) {
+            std::size_t pos = rnd(w + 1);
+            b.insert(pos, v);
+            ref = cat(cat(slice(w - 1, pos), v), slice(pos - 1, 0));
+        } else {
+            std::size_t e = rnd(w);
+            std::size_t s = e + rnd(std::min<std::size_t>(w - e, 150));
+            if (op == 1) {
+                b.erase(s, e);
+                ref = cat(slice(w - 1, s + 1), slice(e - 1, 0));
+            } else {
+                b.replace(s, e, v);
+                ref = cat(cat(slice(w - 1, s + 1), v), slice(e - 1, 0));
+            }
+        }
+        ASSERT_EQ(b, ref);
+    }
+}